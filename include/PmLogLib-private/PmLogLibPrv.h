@@ -37,20 +37,99 @@ extern "C"
 #endif
 
 
-// For now put the public context info at the top of the struct so the
-// pointers are the same. If that is changed, revise PmLogGetContext and
-// PrvResolveContextaccordingly.
+// Cache line size assumed for the shared memory layout.
+#define PMLOG_CACHE_LINE_SIZE	64
+
+
+// most processes recorded by identity as attached to one context
+#define PMLOG_CONTEXT_MAX_OWNERS	4
+
+
+// A process attached to a context.  A pid only means something in its
+// own pid namespace, so it is recorded with the inode of that namespace
+// (of /proc/self/ns/pid), and with the process start time (field 22 of
+// /proc/self/stat) to tell a reused pid apart.  pidNs is 0 if it could
+// not be read, in which case the owner is never taken for dead.
+typedef struct
+{
+	uint64_t	pidNs;			/* pid namespace inode, or 0 if unknown */
+	uint64_t	startTime;		/* clock ticks after boot */
+	int32_t		pid;			/* in pidNs, or 0 for no owner */
+	int32_t		reserved;
+}
+PmLogContextOwner;
+
+
+// The cold part of a context: its name, and whatever is only read on
+// the write path or changes at run time.  The hot part, the
+// PmLogContextInfo read by every level check, is kept in a separate
+// dense array (see PmLogGlobals) at the same index.
+//
+// Each process that gets a context attaches to it, and detaches when
+// it exits.  The first PMLOG_CONTEXT_MAX_OWNERS are recorded, so the
+// slot can also be reclaimed once they have all died; if there are more,
+// the slot is only reclaimed after the others detach cleanly.  An owner
+// in another pid namespace can't be checked, so keeps the slot until it
+// detaches.  Reclaiming a slot clears its name and bumps its generation,
+// which each process checks against the one it got the context at.
+typedef struct
+{
+	char		component[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];	/* "" if free */
+	int			facility;		/* syslog facility, or 0 for the process default */
+	uint32_t	generation;		/* bumped each time the slot is reclaimed */
+	int			numAttached;	/* attached processes, including unrecorded */
+	int			pinned;			/* by PmLogSetContextPinned, never reclaimed */
+	PmLogContextOwner	owners[ PMLOG_CONTEXT_MAX_OWNERS ];	/* attached */
+	uint64_t	numMessages;	/* messages logged at an enabled level */
+}
+PmLogContextMeta;
+
+
+// most processes whose pass levels are recorded at once
+#define PMLOG_MAX_PASS_PROCESSES	16
+
+
+// The levels of each context that a process checks in the library
+// whatever the context's level: all of them for a context it has an
+// override for, else those up to the highest elevated or backtrace
+// level of its threads.  The pass level of each context, in its
+// checkLevels, is the highest of these over all the processes, and
+// the pass floor.  Only the processes with such levels have an entry.
+// An entry is taken by its owner's pid, and only read once ready.
+typedef struct
+{
+	PmLogContextOwner	owner;			/* pid 0 if free */
+	int					ready;			/* passLevels are set */
+	int8_t				passLevels[ 1 + PMLOG_MAX_NUM_CONTEXTS ];
+}
+PmLogPassEntry;
+
+
+// A level rule recorded by PmLogSetContextLevels or for a context in
+// the [Contexts] section of the configuration, applied to the contexts
+// created after it whose names match the glob pattern.
 typedef struct
 {
-	PmLogContextInfo	info;
-	char				component[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
+	char	pattern[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
+	int		level;
+	int		facility;	/* syslog facility, or 0 to keep the inherited one */
 }
-PmLogContext_;
+PmLogLevelRule;
+
 
+// Version of the shared memory layout, kept in the low byte of the
+// signature.  It must be bumped on any change to PmLogGlobals or the
+// structures in it.
+#define PMLOG_LAYOUT_VERSION	0x10
 
 // value for globals->signature.  If it does not match the
 // expected value then the client must abort.
-#define PMLOG_SIGNATURE			0x504C6702	// 'PLg' + 0x02
+#define PMLOG_SIGNATURE			(0x504C6700 | PMLOG_LAYOUT_VERSION)	// 'PLg' + version
+
+// ftok() project id of the shared memory key.  It changes with the
+// layout version, so that libraries with different layouts get
+// segments of their own rather than one of the wrong size.
+#define PMLOG_SHM_PROJ_ID		('A' + PMLOG_LAYOUT_VERSION)
 
 
 // Flag values for PmLogGlobals.flags
@@ -58,39 +137,332 @@ enum
 {
 	kPmLogGlobalsFlag_LogProcessIds	= 0x0001,
 	kPmLogGlobalsFlag_LogThreadIds	= 0x0002,
-	kPmLogGlobalsFlag_LogToConsole	= 0x0004
+	kPmLogGlobalsFlag_LogToConsole	= 0x0004,
+	kPmLogGlobalsFlag_KVFormatJson	= 0x0008,
+	kPmLogGlobalsFlag_LogToSyslog	= 0x0010,
+	kPmLogGlobalsFlag_LogToFile		= 0x0020,
+	kPmLogGlobalsFlag_LogToSocket	= 0x0040,
+	kPmLogGlobalsFlag_FileCompress	= 0x0080,
+	kPmLogGlobalsFlag_FileBinary	= 0x0100,
+	kPmLogGlobalsFlag_TimeTsc		= 0x0200,
+	kPmLogGlobalsFlag_SyslogTimestamps	= 0x0400
 };
 
 
-// settings to control std output
+// Binary encoding of a structured record as produced by PmLogKV_.
+// All integers are unsigned LEB128 varints unless noted.
+//
+//	record:	msgId length, msgId bytes, then zero or more fields
+//	field:	u8 type (kPmLogKVType_xxx), key length, key bytes, value
+//	value:	Int64			zigzag varint
+//			Double			8 bytes, IEEE 754 bits, little-endian
+//			String, Bytes	length, bytes
+//
+// Strings are not NUL-terminated in the encoding.  Records travel to
+// the sinks encoded, with kPmLogSinkMsgFlag_KV, and the sinks that
+// write text render them into a buffer of PMLOG_KV_TEXT_BUFF_SIZE.
+// Fields that don't fit in a record of PMLOG_KV_MAX_RECORD_SIZE are
+// dropped, and the record then ends with an Int64 field
+// PMLOG_KV_TRUNCATED_KEY giving how many.
+#define PMLOG_KV_MAX_KEY_LEN		63
+#define PMLOG_KV_TEXT_BUFF_SIZE		2048
+#define PMLOG_KV_MAX_RECORD_SIZE	1024
+#define PMLOG_KV_TRUNCATED_KEY		"_truncated"
+
+
+// Built-in sinks, in the order they are called.  Each has a level mask
+// in PmLogGlobals.sinkLevels; bit n set means it takes level n.
+// Custom sinks registered with PmLogRegisterSink follow these.
+enum
+{
+	kPmLogSink_Ring		= 0,	/* flight recorder, ignores context levels */
+	kPmLogSink_Syslog,
+	kPmLogSink_Socket,
+	kPmLogSink_File,
+	kPmLogSink_StdErr,
+	kPmLogSink_StdOut,
+	kPmLogSink_NumBuiltIn
+};
+
+
+// settings for the per-process flight recorder
+typedef struct
+{
+	int		recordLevel;	/* levels <= recordLevel are recorded */
+	int		recordSize;		/* approximate ring file size in bytes */
+	char	recordDir[ 128 ];
+}
+PmLogRecorderConf;
+
+
+// settings and shared state for the direct file output.
+// All writing processes append to the same file.  The first writer to
+// see the size or age limit exceeded claims the rotation by setting
+// rotateClaim, renames the files, then bumps generation so the others
+// reopen the path.  Writers never wait for a rotation to finish.
 typedef struct
 {
-	int	stdErrMinLevel;
-	int	stdErrMaxLevel;
-	int	stdOutMinLevel;
-	int	stdOutMaxLevel;
+	char		path[ 128 ];
+	int			maxSize;		/* rotate when exceeded, 0 for no limit */
+	int			rotateSeconds;	/* rotate when older, 0 for no limit */
+	int			keepFiles;		/* number of rotated files to keep */
+	uint32_t	generation;		/* incremented on each rotation */
+	int64_t		rotateClaim;	/* time the rotation was claimed, or 0 */
+	int64_t		openTime;		/* time the current file was started */
+	uint64_t	bytes;			/* bytes written to the current file */
+	int			blockSize;		/* uncompressed size of compressed blocks */
+	int			flushMs;		/* longest a record waits for its block */
 }
-PmLogConsole;
+PmLogFileConf;
 
 
 // This is the globals data structure that is allocated as a shared
-// memory segment.  The size should be kept reasonable, e.g. < 16K. 
+// memory segment.  It is about 53K, most of it the context table: each
+// context takes a PmLogContextInfo, a PmLogContextMeta with its
+// recorded owners, and a pass level in each PmLogPassEntry.  The size should be kept
+// reasonable, as every process maps all of it.
+// It is laid out by cache line: the header, read on every write; the
+// level words, read by every level check, which should stay clean; the
+// context names and other cold data; and last the file writer state,
+// which is written by every write to the log file.
 typedef struct
 {
-	uint32_t		signature;
-	int				reserved;
-	int				maxUserContexts;
-	int				numUserContexts;
+	uint32_t			signature;
+	uint32_t			layoutSize;			/* sizeof(PmLogGlobals) */
+	int					maxUserContexts;
+	int					numUserContexts;	/* slots used so far, some may be free */
+
+	int					flags;
+	uint32_t			configGeneration;	/* incremented on each config load */
+	uint32_t			contextsSeq;		/* contexts seqlock, odd during a change */
+	char				nsName[ PMLOG_MAX_NAMESPACE_LEN + 1 ];	/* "" for the default */
+	uint32_t			sinkLevels[ kPmLogSink_NumBuiltIn ];
+	char				socketPath[ 108 ];
+	int					dumpMaxBytes;		/* data dump cap, 0 for no limit */
+	PmLogRecorderConf	recorderConf;
 
-	int				flags;
-	PmLogConsole	consoleConf;
+	// indexed by context: 0 is the global context, 1.. the user contexts
+	PmLogContextInfo	contextInfo[ 1 + PMLOG_MAX_NUM_CONTEXTS ]
+		__attribute__((aligned(PMLOG_CACHE_LINE_SIZE)));
+	PmLogContextMeta	contextMeta[ 1 + PMLOG_MAX_NUM_CONTEXTS ]
+		__attribute__((aligned(PMLOG_CACHE_LINE_SIZE)));
 
-	PmLogContext_	globalContext;
-	PmLogContext_	userContexts[ PMLOG_MAX_NUM_CONTEXTS ];
+	// oldest first; the newest rule matching a name applies
+	int					numLevelRules;
+	PmLogLevelRule		levelRules[ PMLOG_MAX_LEVEL_RULES ];
+
+	// a pass level for every context that is only ever raised: by each
+	// flight recorder level run, and by a process that finds no free
+	// entry for its pass levels
+	int					passFloor;
+	PmLogPassEntry		passEntries[ PMLOG_MAX_PASS_PROCESSES ];
+
+	PmLogFileConf		fileConf
+		__attribute__((aligned(PMLOG_CACHE_LINE_SIZE)));
 }
 PmLogGlobals;
 
 
+//#####################################################################
+
+
+// Flight recorder ring file layout.
+//
+// Each process with the flight recorder enabled maps a file named
+// <recordDir>/<progname>.<pid>.pmlogfr, which holds a PmLogRingHeader
+// followed by numSlots fixed size PmLogRingSlot entries.  Writers claim
+// slot (head % numSlots) by atomically incrementing head, clear its seq,
+// fill it in, then set seq = (claimed head value + 1).  A reader takes
+// the slots with seq in (head - numSlots, head] in seq order; slots with
+// seq 0 were being written at the time and are skipped.
+
+#define PMLOG_RING_MAGIC			0x504C4672	// 'PLFr'
+#define PMLOG_RING_VERSION			1
+#define PMLOG_RING_SLOT_SIZE		256
+#define PMLOG_RING_HEADER_SIZE		256
+#define PMLOG_RING_FILE_SUFFIX		".pmlogfr"
+
+typedef struct
+{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	headerSize;
+	uint32_t	slotSize;
+	uint32_t	numSlots;
+	int32_t		pid;
+	uint64_t	head;			/* number of slots claimed so far */
+	uint64_t	startTimeNs;	/* CLOCK_REALTIME when created */
+	char		progName[ 64 ];
+}
+PmLogRingHeader;
+
+typedef struct
+{
+	uint64_t	seq;			/* 0 while being written */
+	uint64_t	timeNs;			/* CLOCK_REALTIME */
+	int32_t		tid;
+	int16_t		level;
+	uint8_t		componentLen;
+	uint8_t		flags;			/* kPmLogRingSlotFlag_xxx */
+	uint16_t	textLen;
+	char		data[ PMLOG_RING_SLOT_SIZE - 26 ];	/* component + text */
+}
+PmLogRingSlot;
+
+#define kPmLogRingSlotFlag_KV		0x01	/* text is a PmLogKV_ record */
+
+
+//#####################################################################
+
+
+// Log file block layout.
+//
+// With LogFileCompress or LogFileFormat=binary set, each process's
+// writer thread gathers the records it would otherwise append to the
+// log file into blocks, and appends each block as a PmLogBlockHeader
+// followed by dataLen bytes of LZ4 block format data (or the records
+// as they are, if not compressed) that expand to rawLen bytes.  The
+// records are text lines or PmLogBinRecords, per the block format.
+// Blocks from different processes, and plain text lines, may be mixed
+// in one file.  Integers are in host byte order.
+//
+// The block headers are the file's sparse index: a reader can skip any
+// block whose time range or context bitmap rules it out, without
+// reading its data.  A context sets bit (contextId % 256) of
+// contextBits, where contextId is PmLogPrvContextId of its name.
+// Headers shorter than PmLogBlockHeader have no bitmap.
+
+#define PMLOG_BLOCK_MAGIC			0x504C426B	// 'PLBk'
+#define PMLOG_BLOCK_VERSION			1
+#define PMLOG_BLOCK_MAX_RAW_SIZE	(1024 * 1024)
+#define PMLOG_BLOCK_CONTEXT_BITS	256
+
+enum
+{
+	kPmLogBlockCodec_None	= 0,
+	kPmLogBlockCodec_LZ4	= 1
+};
+
+enum
+{
+	kPmLogBlockFormat_Text		= 0,
+	kPmLogBlockFormat_Binary	= 1
+};
+
+typedef struct
+{
+	uint32_t	magic;
+	uint16_t	headerSize;
+	uint8_t		version;
+	uint8_t		codec;
+	uint32_t	rawLen;
+	uint32_t	dataLen;
+	uint32_t	numRecords;
+	uint16_t	format;
+	uint16_t	reserved;
+	uint64_t	firstTimeNs;	/* CLOCK_REALTIME of the first record */
+	uint64_t	lastTimeNs;		/* CLOCK_REALTIME of the last record */
+	uint64_t	contextBits[ PMLOG_BLOCK_CONTEXT_BITS / 64 ];
+}
+PmLogBlockHeader;
+
+
+// A binary record: the header, then identLen bytes of program name,
+// componentLen bytes of context name (none for the global context), and
+// the message text, without terminators, or with kPmLogBinRecordFlag_Raw
+// the data from a raw dump, or with kPmLogBinRecordFlag_KV an encoded
+// PmLogKV_ record.  kPmLogBinRecordFlag_Elevated marks a message only
+// enabled by the logging thread's elevated level.  The header is 32
+// bytes, with no padding, and each record follows the previous one
+// directly, so records may be unaligned and are copied out to be read.
+
+typedef struct
+{
+	uint32_t	recordLen;		/* size of the whole record */
+	uint32_t	contextId;		/* PmLogPrvContextId of the context name */
+	uint64_t	timeNs;			/* CLOCK_REALTIME */
+	int32_t		pid;
+	int32_t		tid;
+	uint8_t		level;
+	uint8_t		identLen;
+	uint8_t		componentLen;
+	uint8_t		flags;			/* kPmLogBinRecordFlag_xxx */
+	uint32_t	reserved;		/* 0 */
+}
+PmLogBinRecord;
+
+// the header size is part of the file format
+typedef char PmLogBinRecordSizeCheck[ (sizeof(PmLogBinRecord) == 32) ? 1 : -1 ];
+
+#define kPmLogBinRecordFlag_Raw			0x01
+#define kPmLogBinRecordFlag_Elevated	0x02	/* by the thread's level */
+#define kPmLogBinRecordFlag_KV			0x04	/* PmLogKV_ record */
+
+
+/*********************************************************************/
+/* PmLogPrvContextId */
+/**
+@brief  Returns the id recorded in binary records and block context
+		bitmaps for a context name: its 32-bit FNV-1a hash, which stays
+		the same across processes and reboots.
+**********************************************************************/
+static inline uint32_t PmLogPrvContextId(const char* name, size_t nameLen)
+{
+	uint32_t	h;
+	size_t		i;
+
+	h = 2166136261u;
+	for (i = 0; i < nameLen; i++)
+	{
+		h = (h ^ (uint8_t) name[ i ]) * 16777619u;
+	}
+
+	return h;
+}
+
+
+// size of the hash table PmLogPrvCompress works in
+#define PMLOG_COMPRESS_HASH_SIZE	4096
+
+// the most PmLogPrvCompress output can take for n bytes of input
+#define PMLOG_COMPRESS_BOUND(n)		((n) + ((n) / 255) + 16)
+
+
+/*********************************************************************/
+/* PmLogPrvCompress */
+/**
+@brief  Compresses srcLen bytes into dst in LZ4 block format, using
+		hashTable (PMLOG_COMPRESS_HASH_SIZE entries) as scratch space.
+		dstSize must be at least PMLOG_COMPRESS_BOUND(srcLen).
+		Returns the compressed size, or 0 if dstSize is too small.
+**********************************************************************/
+size_t PmLogPrvCompress(const void* src, size_t srcLen, void* dst,
+	size_t dstSize, uint32_t* hashTable);
+
+
+/*********************************************************************/
+/* PmLogPrvDecompress */
+/**
+@brief  Expands LZ4 block format data into dst.  Returns false if the
+		data is malformed or would expand to more than dstSize bytes,
+		otherwise true with the expanded size in *dstLenP.
+**********************************************************************/
+bool PmLogPrvDecompress(const void* src, size_t srcLen, void* dst,
+	size_t dstSize, size_t* dstLenP);
+
+
+/*********************************************************************/
+/* PmLogPrvKVRender */
+/**
+@brief  Renders an encoded PmLogKV_ record as NUL-terminated logfmt
+		text, or JSON if json is set, cut short if it doesn't fit in
+		buffSize bytes.  Returns false if the record is malformed or
+		truncated, leaving the text of the fields before the bad one.
+**********************************************************************/
+bool PmLogPrvKVRender(const void* rec, size_t recLen, bool json,
+	char* buff, size_t buffSize);
+
+
 /*********************************************************************/
 /* PmLogPrvGlobals */
 /**
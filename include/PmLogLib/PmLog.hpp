@@ -0,0 +1,540 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+/**
+* @brief  This header file specifies the C++ front end to PmLogLib
+*
+* The PMLOG_PRINT family of macros is the C++ counterpart of PmLogPrint.
+* The format string must be a string literal.  It is parsed at compile
+* time and checked against the argument types, so a mismatch is a
+* compile error regardless of compiler warning settings.  Arguments are
+* forwarded by reference straight to the library, with std::string and
+* enumeration values converted in place; nothing is copied to the heap.
+*
+* As with the C macros, the inline enabled check is made before any of
+* the arguments are evaluated.
+*
+* <em>Example usage:</em>
+*
+* @code
+*	PMLOG_INFO(gMyContext, "connected to %s:%d", hostName, port);
+* @endcode
+*
+* @file PmLog.hpp
+* <hr>
+**/
+
+#ifndef PMLOG_HPP
+#define PMLOG_HPP
+
+
+#include "PmLogLib.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+
+#if __cplusplus < 201402L
+	#error "PmLog.hpp requires C++14 or later"
+#endif
+
+
+namespace pmlog
+{
+namespace detail
+{
+
+
+//#####################################################################
+
+
+/*********************************************************************/
+/* TypeList */
+/**
+@brief  Carries the argument types of a log call to the format checker.
+**********************************************************************/
+template <typename... Args>
+struct TypeList
+{
+};
+
+
+/*********************************************************************/
+/* ArgTypes */
+/**
+@brief  Only used in decltype() to capture the argument types of a log
+		call without evaluating the arguments.
+**********************************************************************/
+template <typename... Args>
+TypeList<Args...> ArgTypes(const char* fmt, Args&&... args);
+
+
+/*********************************************************************/
+/* ArgKind */
+/**
+@brief  The classes of argument the format checker distinguishes.
+**********************************************************************/
+enum class ArgKind
+{
+	Integer,
+	Float,
+	LongDouble,
+	String,
+	Pointer,
+	Other
+};
+
+
+/*********************************************************************/
+/* ArgInfo */
+/**
+@brief  The kind and (for integers) size of an argument after the
+		default argument promotions.
+**********************************************************************/
+struct ArgInfo
+{
+	ArgKind		kind;
+	std::size_t	size;
+};
+
+
+/*********************************************************************/
+/* IsString */
+/**
+@brief  True for the types that can be passed for a %s conversion.
+**********************************************************************/
+template <typename T>
+struct IsString : std::integral_constant<bool,
+	std::is_same<T, char*>::value ||
+	std::is_same<T, const char*>::value ||
+	std::is_same<T, std::string>::value>
+{
+};
+
+
+/*********************************************************************/
+/* InfoOf */
+/**
+@brief  Classifies an argument type for the format checker.
+**********************************************************************/
+template <typename T>
+constexpr ArgInfo InfoOf()
+{
+	using U = typename std::decay<T>::type;
+
+	using I = typename std::conditional<std::is_enum<U>::value,
+		std::underlying_type<U>, std::decay<U>>::type::type;
+
+	return
+		IsString<U>::value
+			? ArgInfo{ ArgKind::String, sizeof(char*) } :
+		(std::is_integral<I>::value)
+			? ArgInfo{ ArgKind::Integer,
+				(sizeof(I) < sizeof(int)) ? sizeof(int) : sizeof(I) } :
+		std::is_same<U, long double>::value
+			? ArgInfo{ ArgKind::LongDouble, sizeof(long double) } :
+		std::is_floating_point<U>::value
+			? ArgInfo{ ArgKind::Float, sizeof(double) } :
+		(std::is_pointer<U>::value || std::is_null_pointer<U>::value)
+			? ArgInfo{ ArgKind::Pointer, sizeof(void*) } :
+		ArgInfo{ ArgKind::Other, 0 };
+}
+
+
+/*********************************************************************/
+/* IntSizeFor */
+/**
+@brief  Returns the integer argument size required by the given length
+		modifier, or 0 for "int or smaller".
+**********************************************************************/
+constexpr std::size_t IntSizeFor(char len1, char len2)
+{
+	return
+		(len1 == 'l' && len2 == 'l')	? sizeof(long long) :
+		(len1 == 'l')					? sizeof(long) :
+		(len1 == 'j')					? sizeof(intmax_t) :
+		(len1 == 'z')					? sizeof(size_t) :
+		(len1 == 't')					? sizeof(ptrdiff_t) :
+		0;
+}
+
+
+/*********************************************************************/
+/* ArgMatches */
+/**
+@brief  Returns true if the argument is acceptable for the conversion
+		with the given length modifier.
+**********************************************************************/
+constexpr bool ArgMatches(const ArgInfo& arg, char conv, char len1, char len2)
+{
+	return
+		// integer conversions
+		((conv == 'd') || (conv == 'i') || (conv == 'o') ||
+		 (conv == 'u') || (conv == 'x') || (conv == 'X'))
+			? ((arg.kind == ArgKind::Integer) &&
+				((IntSizeFor(len1, len2) == 0)
+					? ((len1 != 'L') && (arg.size <= sizeof(int)))
+					: (arg.size == IntSizeFor(len1, len2)))) :
+		(conv == 'c')
+			? ((arg.kind == ArgKind::Integer) && (len1 == 0) &&
+				(arg.size <= sizeof(int))) :
+		// floating point conversions
+		((conv == 'f') || (conv == 'F') || (conv == 'e') ||
+		 (conv == 'E') || (conv == 'g') || (conv == 'G') ||
+		 (conv == 'a') || (conv == 'A'))
+			? ((len1 == 'L')
+				? (arg.kind == ArgKind::LongDouble)
+				: ((arg.kind == ArgKind::Float) &&
+					((len1 == 0) || (len1 == 'l' && len2 == 0)))) :
+		(conv == 's')
+			? ((arg.kind == ArgKind::String) && (len1 == 0)) :
+		(conv == 'p')
+			? ((arg.kind == ArgKind::Pointer) ||
+				(arg.kind == ArgKind::String)) && (len1 == 0) :
+		// %n and unknown conversions are rejected
+		false;
+}
+
+
+/*********************************************************************/
+/* IsDigit */
+/**
+@brief  Whether c is a decimal digit, as <cctype>'s isdigit can't be
+		used in a constant expression.
+**********************************************************************/
+constexpr bool IsDigit(char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+
+/*********************************************************************/
+/* CheckFormat */
+/**
+@brief  Parses a printf format string and returns true if and only if
+		the conversions match the given argument kinds in number and
+		type.
+**********************************************************************/
+constexpr bool CheckFormat(const char* fmt, const ArgInfo* args,
+	std::size_t numArgs)
+{
+	std::size_t	argIndex = 0;
+	char		len1 = 0;
+	char		len2 = 0;
+
+	if (fmt == nullptr)
+	{
+		return false;
+	}
+
+	while (*fmt != 0)
+	{
+		if (*fmt++ != '%')
+		{
+			continue;
+		}
+
+		if (*fmt == '%')
+		{
+			fmt++;
+			continue;
+		}
+
+		// flags
+		while ((*fmt == '-') || (*fmt == '+') || (*fmt == ' ') ||
+			(*fmt == '#') || (*fmt == '0') || (*fmt == '\''))
+		{
+			fmt++;
+		}
+
+		// width
+		if (*fmt == '*')
+		{
+			if ((argIndex >= numArgs) ||
+				!ArgMatches(args[ argIndex++ ], 'd', 0, 0))
+			{
+				return false;
+			}
+			fmt++;
+		}
+		while (IsDigit(*fmt))
+		{
+			fmt++;
+		}
+
+		// precision
+		if (*fmt == '.')
+		{
+			fmt++;
+			if (*fmt == '*')
+			{
+				if ((argIndex >= numArgs) ||
+					!ArgMatches(args[ argIndex++ ], 'd', 0, 0))
+				{
+					return false;
+				}
+				fmt++;
+			}
+			while (IsDigit(*fmt))
+			{
+				fmt++;
+			}
+		}
+
+		// length modifier
+		len1 = 0;
+		len2 = 0;
+		if ((*fmt == 'h') || (*fmt == 'l'))
+		{
+			len1 = *fmt++;
+			if (*fmt == len1)
+			{
+				len2 = *fmt++;
+			}
+		}
+		else if ((*fmt == 'j') || (*fmt == 'z') || (*fmt == 't') ||
+			(*fmt == 'L'))
+		{
+			len1 = *fmt++;
+		}
+
+		// conversion
+		if ((*fmt == 0) || (argIndex >= numArgs) ||
+			!ArgMatches(args[ argIndex++ ], *fmt, len1, len2))
+		{
+			return false;
+		}
+		fmt++;
+	}
+
+	return (argIndex == numArgs);
+}
+
+
+/*********************************************************************/
+/* CheckFormat */
+/**
+@brief  Type list form of CheckFormat, for use by the macros.
+**********************************************************************/
+template <typename... Args>
+constexpr bool CheckFormat(const char* fmt, TypeList<Args...>)
+{
+	// the extra element keeps the array non-empty with no arguments
+	const ArgInfo args[] = { InfoOf<Args>()..., { ArgKind::Other, 0 } };
+
+	return CheckFormat(fmt, args, sizeof...(Args));
+}
+
+
+/*********************************************************************/
+/* FormatChecked */
+/**
+@brief  Turns the result of CheckFormat into a compile error.
+**********************************************************************/
+template <bool ok>
+struct FormatChecked
+{
+	static_assert(ok, "PmLog format string does not match the arguments");
+
+	static constexpr bool value = ok;
+};
+
+
+//#####################################################################
+
+
+/*********************************************************************/
+/* PassArg */
+/**
+@brief  Converts a captured argument to the type passed through the
+		variable argument list.
+**********************************************************************/
+inline const char* PassArg(const std::string& s)
+{
+	return s.c_str();
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_enum<T>::value,
+	typename std::underlying_type<T>::type>::type
+PassArg(T v)
+{
+	return static_cast<typename std::underlying_type<T>::type>(v);
+}
+
+template <typename T>
+inline typename std::enable_if<!std::is_enum<typename std::decay<T>::type>::value &&
+	!std::is_same<typename std::decay<T>::type, std::string>::value, T&&>::type
+PassArg(T&& v)
+{
+	return std::forward<T>(v);
+}
+
+
+/*********************************************************************/
+/* Print */
+/**
+@brief  Passes a checked log call on to PmLogPrint_.
+**********************************************************************/
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+#pragma GCC diagnostic ignored "-Wformat-security"
+
+template <typename... Args>
+inline PmLogErr Print(PmLogContext context, PmLogLevel level,
+	const char* fmt, Args&&... args)
+{
+	return PmLogPrint_(context, level, fmt,
+		PassArg(std::forward<Args>(args))...);
+}
+
+#pragma GCC diagnostic pop
+
+
+}	// namespace detail
+
+
+/*********************************************************************/
+/* ThreadLevelScope */
+/**
+@brief  Elevates the calling thread's level for the lifetime of the
+		object, as PmLogElevateThreadLevel and PmLogRestoreThreadLevel,
+		e.g. to trace one request:
+
+			pmlog::ThreadLevelScope trace(kPmLogLevel_Debug);
+**********************************************************************/
+class ThreadLevelScope
+{
+public:
+	explicit ThreadLevelScope(PmLogLevel level)
+	{
+		(void) PmLogElevateThreadLevel(level, &savedLevel);
+	}
+
+	~ThreadLevelScope()
+	{
+		(void) PmLogRestoreThreadLevel(savedLevel);
+	}
+
+	ThreadLevelScope(const ThreadLevelScope&) = delete;
+	ThreadLevelScope& operator=(const ThreadLevelScope&) = delete;
+
+private:
+	PmLogLevel	savedLevel;
+};
+
+
+}	// namespace pmlog
+
+
+//#####################################################################
+
+
+// expands to the first of the macro arguments, i.e. the format
+#define PMLOG_FIRST_ARG_(...)			PMLOG_FIRST_ARG_HELPER_(__VA_ARGS__, 0)
+#define PMLOG_FIRST_ARG_HELPER_(first, ...)	first
+
+
+/*********************************************************************/
+/* PMLOG_CHECK_FORMAT_ */
+/**
+@brief  Compile-time check of a format string literal and its arguments.
+		The arguments are only used in decltype(), so are not evaluated.
+
+proto:	bool PMLOG_CHECK_FORMAT_(const char* fmt, ...);
+**********************************************************************/
+#define PMLOG_CHECK_FORMAT_(...)	\
+	::pmlog::detail::FormatChecked< ::pmlog::detail::CheckFormat(	\
+		PMLOG_FIRST_ARG_(__VA_ARGS__),	\
+		decltype(::pmlog::detail::ArgTypes(__VA_ARGS__))()) >::value
+
+
+/*********************************************************************/
+/* PMLOG_PRINT */
+/**
+@brief  Logs the specified formatted text, tagged with the specified
+		level, to the specified context.
+
+proto:	PmLogErr PMLOG_PRINT(PmLogContext context, PmLogLevel level,
+			const char* fmt, ...);
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_InvalidFormat
+			kPmLogErr_LevelDisabled
+**********************************************************************/
+#define	PMLOG_PRINT(context, level, ...)	\
+	((PMLOG_CHECK_FORMAT_(__VA_ARGS__) && PmLogIsEnabled(context, level))	\
+		? ::pmlog::detail::Print(context, level, __VA_ARGS__)	\
+		: static_cast<PmLogErr>(kPmLogErr_LevelDisabled))
+
+
+/*********************************************************************/
+/* PMLOG_ERROR */
+/**
+@brief  Logs the specified formatted text, tagged as error level,
+		to the specified context.
+
+proto:	void PMLOG_ERROR(PmLogContext context, const char* fmt, ...);
+**********************************************************************/
+#define	PMLOG_ERROR(context, ...)	\
+	(void) PMLOG_PRINT(context, kPmLogLevel_Error, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PMLOG_WARNING */
+/**
+@brief  Logs the specified formatted text, tagged as warning level,
+		to the specified context.
+
+proto:	void PMLOG_WARNING(PmLogContext context, const char* fmt, ...);
+**********************************************************************/
+#define	PMLOG_WARNING(context, ...)	\
+	(void) PMLOG_PRINT(context, kPmLogLevel_Warning, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PMLOG_INFO */
+/**
+@brief  Logs the specified formatted text, tagged as info level,
+		to the specified context.
+
+proto:	void PMLOG_INFO(PmLogContext context, const char* fmt, ...);
+**********************************************************************/
+#define	PMLOG_INFO(context, ...)	\
+	(void) PMLOG_PRINT(context, kPmLogLevel_Info, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PMLOG_DEBUG */
+/**
+@brief  Logs the specified formatted text, tagged as debug level,
+		to the specified context.
+
+proto:	void PMLOG_DEBUG(PmLogContext context, const char* fmt, ...);
+**********************************************************************/
+#define	PMLOG_DEBUG(context, ...)	\
+	(void) PMLOG_PRINT(context, kPmLogLevel_Debug, __VA_ARGS__)
+
+
+#endif // PMLOG_HPP
@@ -113,7 +113,8 @@ extern "C"
 
 
 // note: we use macros rather than inline function declarations to
-// avoid potential configuration and usage issues.
+// avoid potential configuration and usage issues.  The exception is
+// the lookup of the PMLOG_TRACE_COMPONENT context, which needs a cache.
 
 
 //#####################################################################
@@ -150,6 +151,9 @@ enum
 	kPmLogErr_InvalidContextName	= PMLOG_ERR(12),
 	kPmLogErr_ContextNotFound		= PMLOG_ERR(13),
 	kPmLogErr_BufferTooSmall		= PMLOG_ERR(14),
+	kPmLogErr_TooManySinks			= PMLOG_ERR(15),
+	kPmLogErr_TooManyRules			= PMLOG_ERR(16),
+	kPmLogErr_InUse					= PMLOG_ERR(17),
 	//------------------------------------------------
 	kPmLogErr_Unknown				= PMLOG_ERR(999)
 };
@@ -194,6 +198,24 @@ typedef int PmLogLevel;
 #define PMLOG_MAX_NUM_CONTEXTS		226
 
 
+// maximum number of level rules recorded by PmLogSetContextLevels and
+// the [Contexts] section of the configuration
+#define PMLOG_MAX_LEVEL_RULES		64
+
+
+// maximum length of a namespace name (see PmLogSetNamespace)
+#define PMLOG_MAX_NAMESPACE_LEN		31
+
+
+// most elevations of a thread's level in force at once (see
+// PmLogElevateThreadLevel)
+#define PMLOG_MAX_THREAD_ELEVATIONS	16
+
+
+// size of each thread's backtrace buffer (see PmLogBeginBacktrace)
+#define PMLOG_BACKTRACE_BUFF_SIZE	16384
+
+
 //#####################################################################
 
 
@@ -203,16 +225,22 @@ typedef int PmLogLevel;
 @brief  Type definition for the logging context as returned by
 		PmLogGetContext.  This is a read-only data view.  Clients
 		should treat this as an opaque structure, however it is
-		referenced by the macro/inline functions here.
+		referenced by the macro/inline functions here.  It holds only
+		what the inline level check reads; the rest of the context is
+		kept elsewhere.
 **********************************************************************/
 
 typedef struct
 {
 	int	enabledLevel;	/* levels <= enabledLevel are enabled */
 	int flags;
+	int	checkLevels;	/* see PmLogCheckLevelOf_, PmLogPassLevelOf_ */
 }
 PmLogContextInfo;
 
+// All fields may be changed at any time by other threads and
+// processes, so are only accessed with atomic loads and stores.
+
 typedef const PmLogContextInfo* PmLogContext; 
 
 
@@ -222,14 +250,26 @@ typedef const PmLogContextInfo* PmLogContext;
 @brief  For efficiency, every client component should get a context
 		using PmLogGetContext and use that for subsequent logging calls.
 		But, for simplicity of the client we'll also allow specifying
-		the global context via a special value.  But in that case,
-		the client-side level check can't be made inline, so every log 
-		call will incur the cost of the library call and parameter
-		evaluation.
+		the global context via a special value.  The inline level check
+		resolves it through PmLogGlobalContext_, so this costs one
+		extra pointer load compared to a cached context.
 **********************************************************************/
 #define kPmLogGlobalContext	((PmLogContext) NULL)
 
 
+/*********************************************************************/
+/* PmLogGlobalContext_ */
+/**
+@brief  The resolved global context, for use by the inline level check.
+		It is set once when the library is loaded.  Until then, or if
+		the library failed to initialize, it refers to a placeholder
+		with all levels enabled so that the call is passed on to the
+		library to report the error.
+		Clients should use kPmLogGlobalContext rather than this.
+**********************************************************************/
+extern PmLogContext PmLogGlobalContext_;
+
+
 /*********************************************************************/
 /* kPmLogGlobalContextName */
 /**
@@ -257,14 +297,129 @@ PmLogErr PmLogGetNumContexts(int* pNumContexts);
 /* PmLogGetIndContext */
 /**
 @brief  Returns the context by index where index = 0..numContexts - 1.
+		An index whose context was reclaimed, and not yet reused,
+		returns kPmLogErr_ContextNotFound.  As with PmLogGetContext,
+		the process is attached to the context, which is kept until
+		the process exits.  To list the contexts without keeping them,
+		use PmLogGetContextsSnapshot.
 
 @return Error code:
 			kPmLogErr_None
 			kPmLogErr_InvalidParameter
+			kPmLogErr_ContextNotFound
 **********************************************************************/
 PmLogErr PmLogGetIndContext(int contextIndex, PmLogContext* pContext);
 
 
+/*********************************************************************/
+/* PmLogContextSnapshot */
+/**
+@brief  One context as copied by PmLogGetContextsSnapshot.
+**********************************************************************/
+typedef struct
+{
+	char		name[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
+	PmLogLevel	level;
+	int			flags;
+	int			facility;		/* syslog facility, or 0 for the default */
+	int			numAttached;	/* processes that got the context */
+	uint64_t	numMessages;	/* messages logged at an enabled level */
+}
+PmLogContextSnapshot;
+
+
+/*********************************************************************/
+/* PmLogGetContextsSnapshot */
+/**
+@brief  Copies every context, starting with the global context, into
+		entries, which has room for maxEntries.  *numEntriesP is set to
+		the number of contexts, which may be more than maxEntries.
+
+		The copy is consistent: no context is added, and no level or
+		facility changed, part way through it.  *generationP (if not
+		NULL) is set to the generation it was taken at, which changes
+		whenever a context is added or its level or facility is set,
+		but not as messages are counted.  A caller polling for changes
+		can compare it with PmLogGetContextsGeneration first.
+
+		The copy is retried a bounded number of times while contexts
+		are being changed, then taken under the lock that changes
+		take.  A level set during that copy, which takes no lock, may
+		or may not be in it, but leaves the generation newer than
+		*generationP.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_BufferTooSmall (the first maxEntries are copied)
+**********************************************************************/
+PmLogErr PmLogGetContextsSnapshot(PmLogContextSnapshot* entries,
+	int maxEntries, int* numEntriesP, uint32_t* generationP);
+
+
+/*********************************************************************/
+/* PmLogGetContextsGeneration */
+/**
+@brief  Returns the current contexts generation, as reported by
+		PmLogGetContextsSnapshot, without copying anything.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetContextsGeneration(uint32_t* generationP);
+
+
+/*********************************************************************/
+/* PmLogReclaimContexts */
+/**
+@brief  Frees the slots of the contexts that no running process has
+		got, so that new contexts can use them.  PmLogGetContext does
+		this itself when the table is full.  Contexts pinned with
+		PmLogSetContextPinned are kept.  The level and facility given
+		to a context in the configuration are kept as a rule instead,
+		and apply again if it is got after being freed.
+		A context is never freed while a process that got a handle to
+		it runs, so a handle can't reach a context that reuses its
+		slot.  A process in another pid namespace can't be checked, so
+		a context it got is only freed once it has exited normally.
+
+		*numReclaimedP (if not NULL) is set to the number freed.
+
+@return Error code:
+			kPmLogErr_None
+**********************************************************************/
+PmLogErr PmLogReclaimContexts(int* numReclaimedP);
+
+
+/*********************************************************************/
+/* PmLogSetNamespace */
+/**
+@brief  Switches this process to the named namespace, or back to the
+		default one if name is NULL or "".  Each namespace has its own
+		shared contexts, levels, settings and lock, so that test and
+		benchmark instances neither contend with nor change the levels
+		of the production one.  A process starts in the namespace named
+		by the PMLOG_NAMESPACE environment variable, if set.
+
+		Names are up to PMLOG_MAX_NAMESPACE_LEN characters of A-Z, a-z,
+		0-9, '_' and '-'.  The configuration file is the same for all
+		namespaces, and is read when a namespace is first used.
+
+		This must be called before the process gets any context, and
+		while it has a single thread (other than the library's own log
+		file writer); otherwise it fails with kPmLogErr_InUse, and the
+		process stays in its namespace.  The thread count is read from
+		/proc/self/task, so the call also fails if that can't be read.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InUse
+**********************************************************************/
+PmLogErr PmLogSetNamespace(const char* name);
+
+
 /*********************************************************************/
 /* PmLogFindContext */
 /**
@@ -272,6 +427,9 @@ PmLogErr PmLogGetIndContext(int contextIndex, PmLogContext* pContext);
 		NULL if the context does not exist.
 
 		If contextName is NULL, an error is returned.
+
+		As with PmLogGetContext, the process is attached to the
+		context, which is kept until the process exits.
 		
 @return Error code:
 			kPmLogErr_None
@@ -319,6 +477,44 @@ PmLogErr PmLogGetContext(const char* contextName, PmLogContext* pContext);
 PmLogContext PmLogGetContextInline(const char* contextName);
 
 
+/*********************************************************************/
+/* PmLogGetContextCached */
+/**
+@brief  Returns/creates the logging context for the named context and
+		stores it into the specified per-call-site cache, so that
+		subsequent calls can skip the lookup.  Concurrent first uses
+		are harmless as they all store the same context.
+		This form of the API is not for general use.  It is needed
+		to support the trace macros with PMLOG_TRACE_COMPONENT.
+		If the context table is full, the global context is returned
+		and cached, so that the call site logs to it from then on
+		rather than retry the lookup on every call.  If the context
+		can't be resolved for any other reason, such as an invalid
+		name, the cache is left empty and kPmLogGlobalContext is
+		returned.
+**********************************************************************/
+PmLogContext PmLogGetContextCached(const char* contextName,
+	PmLogContext* cacheP);
+
+
+/*********************************************************************/
+/* PmLogLoadCachedContext_ */
+/**
+@brief  Reads a context cache as filled in by PmLogGetContextCached.
+		The load is ordered so that a cached context seen by one
+		thread is fully resolved.
+		
+proto:	PmLogContext PmLogLoadCachedContext_(const PmLogContext* cacheP);
+**********************************************************************/
+#ifdef __ATOMIC_ACQUIRE
+	#define PmLogLoadCachedContext_(cacheP)	\
+		__atomic_load_n(cacheP, __ATOMIC_ACQUIRE)
+#else
+	#define PmLogLoadCachedContext_(cacheP)	\
+		(*(PmLogContext volatile*) (cacheP))
+#endif
+
+
 /*********************************************************************/
 /* PmLogGetContextName */
 /**
@@ -359,6 +555,10 @@ PmLogErr PmLogGetContextLevel(PmLogContext context, PmLogLevel* levelP);
 		the Debug Prefs / Log Manager should be used to set the
 		dynamic configuration.
 
+		The level is stored without taking any lock.  It is not kept
+		if the context is freed by PmLogReclaimContexts; pin the
+		context, or use PmLogSetContextLevels, to keep it.
+
 @return Error code:
 			kPmLogErr_None
 			kPmLogErr_InvalidContext
@@ -367,20 +567,381 @@ PmLogErr PmLogGetContextLevel(PmLogContext context, PmLogLevel* levelP);
 PmLogErr PmLogSetContextLevel(PmLogContext context, PmLogLevel level);
 
 
+/*********************************************************************/
+/* PmLogSetContextLevels */
+/**
+@brief  Sets the logging level for every context whose name matches
+		the glob pattern, e.g. "svc.net.*" for all the descendants of
+		"svc.net", or "svc.net*" to include "svc.net" itself.  '*'
+		matches any run of characters including '.', '?' any one
+		character, and [...] one of a set.  The global context is not
+		matched.
+
+		All the matching contexts are set under the same lock that
+		context creation takes, and the pattern is recorded as a
+		rule: contexts created later that match it start at its
+		level, whatever they would inherit.  The newest matching rule
+		wins, and setting a pattern again replaces its rule.
+
+		Like PmLogSetContextLevel, this applies to all processes, and
+		should generally be left to the Log Manager.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidContextName
+			kPmLogErr_InvalidLevel
+			kPmLogErr_TooManyRules
+**********************************************************************/
+PmLogErr PmLogSetContextLevels(const char* pattern, PmLogLevel level);
+
+
+/*********************************************************************/
+/* PmLogSetProcessLevels */
+/**
+@brief  Overrides the logging level, in this process only, of every
+		context whose name matches the glob pattern (as for
+		PmLogSetContextLevels), including those got later.  Other
+		processes using the same contexts are not affected, so one
+		worker out of many can be debugged without flooding the logs.
+
+		The override replaces the shared level of the context, in
+		either direction, until PmLogClearProcessLevels is called.
+		Meanwhile the inline checks of the contexts it applies to are
+		made by a call to the library, in every process of the
+		namespace.  The
+		newest matching override wins, and setting a pattern again
+		replaces its override.  At startup the overrides are read from
+		the PMLOG_LEVELS environment variable, if set, as a comma-
+		separated list of pattern=level, e.g.
+			PMLOG_LEVELS=svc.net.*=debug,svc.db=warning
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidContextName
+			kPmLogErr_InvalidLevel
+			kPmLogErr_TooManyRules
+**********************************************************************/
+PmLogErr PmLogSetProcessLevels(const char* pattern, PmLogLevel level);
+
+
+/*********************************************************************/
+/* PmLogClearProcessLevels */
+/**
+@brief  Drops all this process's overrides set by PmLogSetProcessLevels
+		or PMLOG_LEVELS, so every context is back at its shared level.
+
+@return Error code:
+			kPmLogErr_None
+**********************************************************************/
+PmLogErr PmLogClearProcessLevels(void);
+
+
+/*********************************************************************/
+/* PmLogElevateThreadLevel */
+/**
+@brief  Enables the messages at or below the given level in every
+		context, on the calling thread only, e.g. to trace a single
+		request in full.  The level is only ever raised: elevating to
+		info while already elevated to debug keeps debug.  The level
+		before the call is stored at savedLevelP, to be passed to
+		PmLogRestoreThreadLevel at the end of the scope:
+
+			PmLogLevel saved;
+			PmLogElevateThreadLevel(kPmLogLevel_Debug, &saved);
+			HandleRequest(req);
+			PmLogRestoreThreadLevel(saved);
+
+		Elevations nest, up to PMLOG_MAX_THREAD_ELEVATIONS deep, and
+		each must be restored, innermost first.  If the call fails,
+		*savedLevelP is set to a level that PmLogRestoreThreadLevel
+		refuses, so the end of the scope can restore regardless.
+
+		Messages let through only by the elevated level are passed to
+		the sinks with kPmLogSinkMsgFlag_Elevated set, and are marked
+		in the binary log file.  While any thread is elevated, the
+		inline checks of the levels it takes are made by a call to the
+		library, in every process of the namespace.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidLevel
+			kPmLogErr_TooMuchData (nested too deep)
+**********************************************************************/
+PmLogErr PmLogElevateThreadLevel(PmLogLevel level, PmLogLevel* savedLevelP);
+
+
+/*********************************************************************/
+/* PmLogRestoreThreadLevel */
+/**
+@brief  Ends the calling thread's innermost elevation by
+		PmLogElevateThreadLevel, and restores the level it saved.
+		savedLevel must be the level that call saved; a restore with
+		no elevation in force, or of another one, is refused and
+		changes nothing.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidLevel
+**********************************************************************/
+PmLogErr PmLogRestoreThreadLevel(PmLogLevel savedLevel);
+
+
+/*********************************************************************/
+/* PmLogBeginBacktrace */
+/**
+@brief  Starts holding back the messages for the specified context at
+		levels up to captureLevel that the context level disables, on
+		the calling thread only, e.g. the debug and info messages while
+		handling one request.  They are kept in a buffer of
+		PMLOG_BACKTRACE_BUFF_SIZE bytes per thread, dropping the oldest
+		when it is full, and are not output unless an error (or more
+		severe) message is logged on the thread in any context.  Then
+		they are output first, with their original time stamps, and
+		holding back starts again.
+
+		PmLogEndBacktrace discards them at the end of the scope:
+
+			PmLogBeginBacktrace(context, kPmLogLevel_Debug);
+			HandleRequest(req);
+			PmLogEndBacktrace();
+
+		captureLevel must be warning or less severe; errors are never
+		held back, and always output the held messages first.  Other
+		contexts, and other threads, are not affected, although while
+		any thread holds messages back, the inline checks of the levels
+		it captures are made by a call to the library, in every process
+		of the namespace.
+
+		Calling this again on the same thread discards the messages held
+		so far, and continues with the new context and level.  Only
+		printed and key/value messages are held, not dumps.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_Unknown
+**********************************************************************/
+PmLogErr PmLogBeginBacktrace(PmLogContext context, PmLogLevel captureLevel);
+
+
+/*********************************************************************/
+/* PmLogEndBacktrace */
+/**
+@brief  Discards the messages held back on the calling thread since
+		PmLogBeginBacktrace, and stops holding them.
+
+@return Error code:
+			kPmLogErr_None
+**********************************************************************/
+PmLogErr PmLogEndBacktrace(void);
+
+
+/*********************************************************************/
+/* PmLogGetContextFacility */
+/**
+@brief  Gets the syslog facility for the specified context, or 0 if
+		its messages use the process default facility.
+		May be used for the global context.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetContextFacility(PmLogContext context, int* facilityP);
+
+
+/*********************************************************************/
+/* PmLogSetContextFacility */
+/**
+@brief  Sets the syslog facility (e.g. LOG_LOCAL3) that the messages
+		for the specified context are sent with, or 0 for the process
+		default.  Like the level, this is normally configured in
+		PmLogContexts.conf, and applies to all processes.
+		May be used for the global context.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogSetContextFacility(PmLogContext context, int facility);
+
+
+/*********************************************************************/
+/* PmLogSetContextPinned */
+/**
+@brief  Pins the specified context, so that PmLogReclaimContexts keeps
+		it, along with its level and facility, even once no running
+		process has got it; or unpins it.  Contexts are not pinned
+		when created.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+**********************************************************************/
+PmLogErr PmLogSetContextPinned(PmLogContext context, bool pinned);
+
+
 //#####################################################################
 
 
+/*********************************************************************/
+/* PMLOG_COMPILE_MIN_LEVEL */
+/**
+@brief  The least severe level that is compiled into the client.
+		Messages with a level numerically greater than this (i.e. less
+		severe) are eliminated at compile time by all of the PmLogPrint,
+		PmLogVPrint and PmLogDumpData wrappers, including the format
+		strings.  The arguments are still parsed and type-checked, but
+		never evaluated.
+
+		The client may define this in their makefile or .c file before
+		including the header, e.g.
+			-DPMLOG_COMPILE_MIN_LEVEL=kPmLogLevel_Notice
+		to strip info and debug output from a release build.
+		By default all levels are compiled.
+**********************************************************************/
+#ifndef PMLOG_COMPILE_MIN_LEVEL
+	#define PMLOG_COMPILE_MIN_LEVEL		kPmLogLevel_Debug
+#endif
+
+
+/*********************************************************************/
+/* PmLogIsCompiledIn */
+/**
+@brief  Returns true if and only if the specified message priority
+		is compiled in per PMLOG_COMPILE_MIN_LEVEL.  For a constant
+		level this is a compile-time constant.
+
+proto:	bool PmLogIsCompiledIn(PmLogLevel level);
+**********************************************************************/
+#define PmLogIsCompiledIn(level)	\
+	((level) <= (PMLOG_COMPILE_MIN_LEVEL))
+
+
+/*********************************************************************/
+/* PmLogResolveContext_ */
+/**
+@brief  Maps kPmLogGlobalContext to the real global context so that
+		its level can be checked inline like any other context.
+
+proto:	PmLogContext PmLogResolveContext_(PmLogContext context);
+**********************************************************************/
+#define PmLogResolveContext_(context)	\
+	(((context) == kPmLogGlobalContext) ? PmLogGlobalContext_ : (context))
+
+
+/*********************************************************************/
+/* PmLogLoadRelaxed_ */
+/**
+@brief  Reads an int that other threads and processes may write, as
+		a relaxed atomic load.  This is still a single plain load, but
+		the compiler can't tear, hoist or cache it.
+		Clients should not use this directly.
+
+proto:	int PmLogLoadRelaxed_(const int* p);
+**********************************************************************/
+#if defined(__GNUC__)
+#define PmLogLoadRelaxed_(p)	__atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+#define PmLogLoadRelaxed_(p)	(*(const volatile int*) (p))
+#endif
+
+
+/*********************************************************************/
+/* PmLogCheckLevelOf_ */
+/**
+@brief  Gets the check level from a context's checkLevels: levels above
+		it are disabled in every process, without a call to the
+		library.  It is the higher of the context's level and its pass
+		level.
+		Clients should not use this directly.
+
+proto:	int PmLogCheckLevelOf_(int checkLevels);
+**********************************************************************/
+#define PmLogCheckLevelOf_(checkLevels)	\
+	((int) (signed char) (checkLevels))
+
+
+/*********************************************************************/
+/* PmLogPassLevelOf_ */
+/**
+@brief  Gets the pass level from a context's checkLevels: levels at or
+		below it are checked by the library, with PmLogIsEnabled_, as
+		some process may take them whatever the context's level, for
+		the flight recorder, a thread's elevated level or backtrace, or
+		its level overrides.  It is kPmLogLevel_None unless one of these
+		is in use in the namespace.
+		Clients should not use this directly.
+
+proto:	int PmLogPassLevelOf_(int checkLevels);
+**********************************************************************/
+#define PmLogPassLevelOf_(checkLevels)	\
+	((int) (signed char) ((checkLevels) >> 8))
+
+
+/*********************************************************************/
+/* PmLogIsEnabled_ */
+/**
+@brief  Returns true if a message at the level is taken in the context,
+		for output, the flight recorder or the calling thread's
+		backtrace, in this process and on the calling thread.  Also
+		returns true for a bad context or level, so that the logging
+		call reports the error.
+		Clients should use PmLogIsEnabled rather than this.
+**********************************************************************/
+bool PmLogIsEnabled_(PmLogContext context, PmLogLevel level);
+
+
 /*********************************************************************/
 /* PmLogIsEnabled */
 /**
 @brief  Returns true if and only if the specified message priority
-		is enabled in the specified context.
+		is compiled in and either enabled in the specified context,
+		elevated on the calling thread or captured by the flight
+		recorder or the thread's backtrace.
+
+		A disabled level costs one relaxed load and compare for a
+		context handle, of the context's checkLevels.  An enabled one
+		costs one more compare, of the same word, unless some process
+		in the namespace may take it for one of those reasons, in which
+		case it is checked by a call to the library.
 		
 proto:	bool PmLogIsEnabled(PmLogContext context, PmLogLevel level);
 **********************************************************************/
 #define PmLogIsEnabled(context, level)	\
-	(((context) == kPmLogGlobalContext) ||	\
-	 ((level) <= (context)->enabledLevel))
+	(PmLogIsCompiledIn(level) &&	\
+	 ((level) <= PmLogCheckLevelOf_(PmLogLoadRelaxed_(	\
+		&PmLogResolveContext_(context)->checkLevels))) &&	\
+	 (((level) > PmLogPassLevelOf_(PmLogLoadRelaxed_(	\
+		&PmLogResolveContext_(context)->checkLevels))) ||	\
+	  PmLogIsEnabled_((context), (level))))
+
+
+/*********************************************************************/
+/* PmLogIsEnabledSignalSafe_ */
+/**
+@brief  The inline check of PmLogPrintSignalSafe: only the context's
+		check level in shared memory, without the call PmLogIsEnabled
+		makes for the levels that may be passed.  That call reads the
+		calling thread's state, in thread-local storage that may be
+		allocated on first use, which is not async-signal-safe.
+		PmLogPrintSignalSafe_ checks the passed levels itself.
+		Clients should not use this directly.
+
+proto:	bool PmLogIsEnabledSignalSafe_(PmLogContext context,
+			PmLogLevel level);
+**********************************************************************/
+#define PmLogIsEnabledSignalSafe_(context, level)	\
+	(PmLogIsCompiledIn(level) &&	\
+	 ((level) <= PmLogCheckLevelOf_(PmLogLoadRelaxed_(	\
+		&PmLogResolveContext_(context)->checkLevels))))
 
 
 //#####################################################################
@@ -579,18 +1140,185 @@ proto:	void PmLogVPrintDebug(PmLogContext context,
 //#####################################################################
 
 
+/*********************************************************************/
+/* PmLogPrintSignalSafe_ */
+/**
+@brief  Logs the specified formatted text to the specified context,
+		in a way that is safe to use from a signal handler or from the
+		child of a multi-threaded process after fork.  It takes no
+		locks, does not allocate and calls only async-signal-safe
+		routines, so its latency is bounded.
+
+		The message is written straight to the syslog daemon socket
+		(and to the flight recorder, if running), bypassing syslog().
+		The calling thread's elevated level and backtrace are not
+		looked at, as they are kept in thread-local storage.
+
+		Only a subset of the printf format is supported: the flags
+		'-' and '0', a decimal width, the length modifiers hh, h, l,
+		ll, z, j, t and the conversions d i u x X o p s c %.  Other
+		conversions are output literally.
+
+		For efficiency, this API should not be used directly, but
+		instead use the wrappers (PmLogPrintSignalSafe, ...) that
+		bypass the library call if the logging is not enabled.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_InvalidFormat
+**********************************************************************/
+PmLogErr PmLogPrintSignalSafe_(PmLogContext context, PmLogLevel level,
+	const char* fmt, ...)
+     __attribute__((format(printf, 3, 4)));
+
+
+/*********************************************************************/
+/* PmLogPrintSignalSafe */
+/**
+@brief  Logs the specified formatted text, tagged with the specified
+		level, to the specified context.  Async-signal-safe.
+
+proto:	PmLogErr PmLogPrintSignalSafe(PmLogContext context,
+			PmLogLevel level, const char* fmt, ...);
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_InvalidFormat
+			kPmLogErr_LevelDisabled
+**********************************************************************/
+#define	PmLogPrintSignalSafe(context, level, ...)	\
+	(PmLogIsEnabledSignalSafe_(context, level) \
+		? PmLogPrintSignalSafe_(context, level, __VA_ARGS__) \
+		: kPmLogErr_LevelDisabled)
+
+
+/*********************************************************************/
+/* PmLogPrintSignalSafeCritical */
+/**
+@brief  Logs the specified formatted text, tagged as critical level,
+		to the specified context.  Async-signal-safe.
+
+proto:	void PmLogPrintSignalSafeCritical(PmLogContext context,
+			const char* fmt, ...);
+**********************************************************************/
+#define	PmLogPrintSignalSafeCritical(context, ...)	\
+	(void) PmLogPrintSignalSafe(context, kPmLogLevel_Critical, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PmLogPrintSignalSafeError */
+/**
+@brief  Logs the specified formatted text, tagged as error level,
+		to the specified context.  Async-signal-safe.
+
+proto:	void PmLogPrintSignalSafeError(PmLogContext context,
+			const char* fmt, ...);
+**********************************************************************/
+#define	PmLogPrintSignalSafeError(context, ...)	\
+	(void) PmLogPrintSignalSafe(context, kPmLogLevel_Error, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PmLogPrintSignalSafeWarning */
+/**
+@brief  Logs the specified formatted text, tagged as warning level,
+		to the specified context.  Async-signal-safe.
+
+proto:	void PmLogPrintSignalSafeWarning(PmLogContext context,
+			const char* fmt, ...);
+**********************************************************************/
+#define	PmLogPrintSignalSafeWarning(context, ...)	\
+	(void) PmLogPrintSignalSafe(context, kPmLogLevel_Warning, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PmLogPrintSignalSafeInfo */
+/**
+@brief  Logs the specified formatted text, tagged as info level,
+		to the specified context.  Async-signal-safe.
+
+proto:	void PmLogPrintSignalSafeInfo(PmLogContext context,
+			const char* fmt, ...);
+**********************************************************************/
+#define	PmLogPrintSignalSafeInfo(context, ...)	\
+	(void) PmLogPrintSignalSafe(context, kPmLogLevel_Info, __VA_ARGS__)
+
+
+/*********************************************************************/
+/* PmLogPrintSignalSafeDebug */
+/**
+@brief  Logs the specified formatted text, tagged as debug level,
+		to the specified context.  Async-signal-safe.
+
+proto:	void PmLogPrintSignalSafeDebug(PmLogContext context,
+			const char* fmt, ...);
+**********************************************************************/
+#define	PmLogPrintSignalSafeDebug(context, ...)	\
+	(void) PmLogPrintSignalSafe(context, kPmLogLevel_Debug, __VA_ARGS__)
+
+
+//#####################################################################
+
+
 /*********************************************************************/
 /* PmLogDumpFormat */
 /**
-@brief  Placeholder struct.  Later we will allow passing in a struct
-		of parameters for explicitly controlling the data dump formatting,
-		e.g. allow specifying label offset, width of columns, etc.
-		For now just use the magic value kPmLogDumpFormatDefault which
-		will correspond to canonical hex + ASCII dump.
+@brief  Controls how PmLogDumpData renders the data.  Pass
+		kPmLogDumpFormatDefault for the canonical hex + ASCII dump,
+		16 bytes per line, or a PmLogDumpFormat:
+
+		kPmLogDumpStyle_HexAscii:	offset, hex bytes and ASCII, like
+									"hexdump -C".
+		kPmLogDumpStyle_Hex:		offset and hex digits only.
+		kPmLogDumpStyle_Base64:		base64 only, which may be joined
+									across lines and decoded.
+		kPmLogDumpStyle_Raw:		the bytes themselves, as a single
+									message with kPmLogSinkMsgFlag_Raw,
+									to the sinks that can take binary:
+									custom sinks and the binary log file,
+									whose records are length-prefixed.
+									The other sinks get it as base64.
+
+		bytesPerLine is 0 for the default (16, or 48 for base64) or up to
+		PMLOG_DUMP_MAX_BYTES_PER_LINE, and for base64 a multiple of 3.
+		offsetBase is added to the offsets shown, e.g. to label a slice
+		of a larger buffer.
+
+		Data longer than maxBytes is summarized: a line with its length
+		and XXH64 hash, then a dump of only its first and last bytes,
+		maxBytes in all.  maxBytes is 0 for the DumpMaxBytes setting
+		(16KB by default), or PMLOG_DUMP_UNLIMITED.
 **********************************************************************/
-struct PmLogDumpFormat;
+typedef enum
+{
+	kPmLogDumpStyle_HexAscii = 0,
+	kPmLogDumpStyle_Hex,
+	kPmLogDumpStyle_Base64,
+	kPmLogDumpStyle_Raw
+}
+PmLogDumpStyle;
+
+struct PmLogDumpFormat
+{
+	PmLogDumpStyle	style;
+	size_t			bytesPerLine;
+	size_t			offsetBase;
+	size_t			maxBytes;
+};
+
 typedef struct PmLogDumpFormat PmLogDumpFormat;
 
+#define PMLOG_DUMP_MAX_BYTES_PER_LINE	256
+
+// the most data a kPmLogDumpStyle_Raw dump shows
+#define PMLOG_DUMP_MAX_RAW_SIZE			(256 * 1024)
+
+#define PMLOG_DUMP_UNLIMITED			((size_t) -1)
+
 #define kPmLogDumpFormatDefault	((const PmLogDumpFormat*) NULL)
 
 
@@ -599,7 +1327,7 @@ typedef struct PmLogDumpFormat PmLogDumpFormat;
 /**
 @brief  Logs the specified binary data as text dump to the specified
 		context. Specify kPmLogDumpFormatDefault for the formatting
-		parameter.
+		parameter, or a PmLogDumpFormat.
 		
 		For efficiency, this API should not be used directly, but
 		instead use the wrappers (PmLogDumpData, ...) that
@@ -613,6 +1341,7 @@ typedef struct PmLogDumpFormat PmLogDumpFormat;
 			kPmLogErr_LevelDisabled
 			kPmLogErr_NoData
 			kPmLogErr_InvalidData
+			kPmLogErr_TooMuchData
 **********************************************************************/
 PmLogErr PmLogDumpData_(PmLogContext context, PmLogLevel level,
 	const void* data, size_t numBytes, const PmLogDumpFormat* format);
@@ -623,7 +1352,7 @@ PmLogErr PmLogDumpData_(PmLogContext context, PmLogLevel level,
 /**
 @brief  Logs the specified binary data as text dump to the specified
 		context.  Specify kPmLogDumpFormatDefault for the formatting
-		parameter.
+		parameter, or a PmLogDumpFormat.
 		
 proto:	PmLogErr PmLogDumpData(PmLogContext context, PmLogLevel level,
 			const void* data, size_t numBytes,
@@ -637,6 +1366,7 @@ proto:	PmLogErr PmLogDumpData(PmLogContext context, PmLogLevel level,
 			kPmLogErr_LevelDisabled
 			kPmLogErr_NoData
 			kPmLogErr_InvalidData
+			kPmLogErr_TooMuchData
 **********************************************************************/
 #define	PmLogDumpData(context, level, data, numBytes, format)	\
 	(PmLogIsEnabled(context, level) \
@@ -703,6 +1433,305 @@ proto:	void PmLogDumpDataDebug(PmLogContext context,
 //#####################################################################
 
 
+/*********************************************************************/
+/* PmLogKVType */
+/**
+@brief  Type definition for the value type of a structured logging
+		field as passed to PmLogKV.
+**********************************************************************/
+enum
+{
+	kPmLogKVType_Int64		= 1,	/* u.i64 */
+	kPmLogKVType_Double		= 2,	/* u.d */
+	kPmLogKVType_String		= 3,	/* u.s, NUL-terminated */
+	kPmLogKVType_Bytes		= 4		/* u.mem.p, u.mem.n */
+};
+
+typedef int PmLogKVType;
+
+
+/*********************************************************************/
+/* PmLogKVField */
+/**
+@brief  A typed key/value field for structured logging.
+		Use the PMLOG_KV_xxx initializer macros to fill these in.
+		Keys should be short identifiers, e.g. "bytes", "peer.addr".
+**********************************************************************/
+typedef struct
+{
+	const char*		key;
+	PmLogKVType		type;
+	union
+	{
+		int64_t		i64;
+		double		d;
+		const char*	s;
+		struct
+		{
+			const void*	p;
+			size_t		n;
+		}			mem;
+	}				u;
+}
+PmLogKVField;
+
+
+/*********************************************************************/
+/* PMLOG_KV_INT64, PMLOG_KV_DOUBLE, PMLOG_KV_STRING, PMLOG_KV_BYTES */
+/**
+@brief  Initializers for PmLogKVField, e.g.
+
+@code
+	PmLogKVField fields[] =
+	{
+		PMLOG_KV_STRING("peer", peerName),
+		PMLOG_KV_INT64("bytes", numBytes)
+	};
+
+	PmLogKVInfo(gMyContext, "xfer.done", fields, 2);
+@endcode
+**********************************************************************/
+#define PMLOG_KV_INT64(k, v)	\
+	{ (k), kPmLogKVType_Int64, { .i64 = (v) } }
+
+#define PMLOG_KV_DOUBLE(k, v)	\
+	{ (k), kPmLogKVType_Double, { .d = (v) } }
+
+#define PMLOG_KV_STRING(k, v)	\
+	{ (k), kPmLogKVType_String, { .s = (v) } }
+
+#define PMLOG_KV_BYTES(k, p, n)	\
+	{ (k), kPmLogKVType_Bytes, { .mem = { (p), (n) } } }
+
+
+/*********************************************************************/
+/* PmLogKV_ */
+/**
+@brief  Logs the specified message id and typed fields to the specified
+		context.  No format string is parsed; the fields are encoded
+		into a compact binary record, which is passed as it is to the
+		flight recorder, custom sinks and a binary log file, and only
+		rendered as text (logfmt or JSON per the KVFormat setting) by
+		the outputs that write text.  msgId may be NULL.
+
+		The record is limited to 1KB.  Fields that don't fit are
+		dropped, the record ends with an Int64 field "_truncated"
+		giving how many, and kPmLogErr_TooMuchData is returned.
+
+		For efficiency, this API should not be used directly, but
+		instead use the wrappers (PmLogKV, PmLogKVError, ...) that
+		bypass the library call if the logging is not enabled.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidData
+			kPmLogErr_TooMuchData
+**********************************************************************/
+PmLogErr PmLogKV_(PmLogContext context, PmLogLevel level,
+	const char* msgId, const PmLogKVField* fields, size_t numFields);
+
+
+/*********************************************************************/
+/* PmLogKVRender */
+/**
+@brief  Renders a structured record, as passed to a custom sink with
+		kPmLogSinkMsgFlag_KV, as NUL-terminated logfmt text, or JSON if
+		json is set.  Text that doesn't fit in buff is cut short.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidData
+**********************************************************************/
+PmLogErr PmLogKVRender(const char* rec, size_t recLen, bool json,
+	char* buff, size_t buffSize);
+
+
+/*********************************************************************/
+/* PmLogKV */
+/**
+@brief  Logs the specified message id and typed fields, tagged with the
+		specified level, to the specified context.
+
+proto:	PmLogErr PmLogKV(PmLogContext context, PmLogLevel level,
+			const char* msgId, const PmLogKVField* fields,
+			size_t numFields);
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidData
+			kPmLogErr_TooMuchData
+			kPmLogErr_LevelDisabled
+**********************************************************************/
+#define	PmLogKV(context, level, msgId, fields, numFields)	\
+	(PmLogIsEnabled(context, level) \
+		? PmLogKV_(context, level, msgId, fields, numFields) \
+		: kPmLogErr_LevelDisabled)
+
+
+/*********************************************************************/
+/* PmLogKVError */
+/**
+@brief  Logs the specified typed fields, tagged as error level,
+		to the specified context.
+
+proto:	void PmLogKVError(PmLogContext context, const char* msgId,
+			const PmLogKVField* fields, size_t numFields);
+**********************************************************************/
+#define	PmLogKVError(context, msgId, fields, numFields)	\
+	(void) PmLogKV(context, kPmLogLevel_Error, msgId, fields, numFields)
+
+
+/*********************************************************************/
+/* PmLogKVWarning */
+/**
+@brief  Logs the specified typed fields, tagged as warning level,
+		to the specified context.
+
+proto:	void PmLogKVWarning(PmLogContext context, const char* msgId,
+			const PmLogKVField* fields, size_t numFields);
+**********************************************************************/
+#define	PmLogKVWarning(context, msgId, fields, numFields)	\
+	(void) PmLogKV(context, kPmLogLevel_Warning, msgId, fields, numFields)
+
+
+/*********************************************************************/
+/* PmLogKVInfo */
+/**
+@brief  Logs the specified typed fields, tagged as info level,
+		to the specified context.
+
+proto:	void PmLogKVInfo(PmLogContext context, const char* msgId,
+			const PmLogKVField* fields, size_t numFields);
+**********************************************************************/
+#define	PmLogKVInfo(context, msgId, fields, numFields)	\
+	(void) PmLogKV(context, kPmLogLevel_Info, msgId, fields, numFields)
+
+
+/*********************************************************************/
+/* PmLogKVDebug */
+/**
+@brief  Logs the specified typed fields, tagged as debug level,
+		to the specified context.
+
+proto:	void PmLogKVDebug(PmLogContext context, const char* msgId,
+			const PmLogKVField* fields, size_t numFields);
+**********************************************************************/
+#define	PmLogKVDebug(context, msgId, fields, numFields)	\
+	(void) PmLogKV(context, kPmLogLevel_Debug, msgId, fields, numFields)
+
+
+//#####################################################################
+
+
+// Sinks
+
+
+/*********************************************************************/
+/* PMLOG_LEVEL_MASK */
+/**
+@brief  A level mask selects the levels a sink receives: bit n is set
+		to receive messages at level n.  PMLOG_LEVEL_MASK_UPTO(level)
+		selects the given level and all more severe ones.
+**********************************************************************/
+#define PMLOG_LEVEL_MASK(level)			(1u << (level))
+#define PMLOG_LEVEL_MASK_UPTO(level)	((2u << (level)) - 1u)
+#define PMLOG_LEVEL_MASK_ALL			PMLOG_LEVEL_MASK_UPTO(kPmLogLevel_Debug)
+
+
+/*********************************************************************/
+/* PmLogSinkMsg */
+/**
+@brief  A message as passed to a custom sink.  msg is not terminated
+		and doesn't include a trailing newline.  component is NULL for
+		the global context.  timeNs is the CLOCK_REALTIME time in
+		nanoseconds when the message was logged.  flags has
+		kPmLogSinkMsgFlag_Raw set if msg is binary data from a
+		kPmLogDumpStyle_Raw dump, rather than text,
+		kPmLogSinkMsgFlag_KV if msg is an encoded structured record
+		from PmLogKV_, which PmLogKVRender turns into text, and
+		kPmLogSinkMsgFlag_Elevated if the message is only enabled by
+		the thread's elevated level (see PmLogElevateThreadLevel).
+**********************************************************************/
+typedef struct
+{
+	PmLogContext	context;
+	const char*		component;
+	PmLogLevel		level;
+	const char*		msg;
+	size_t			msgLen;
+	uint64_t		timeNs;
+	int				flags;
+}
+PmLogSinkMsg;
+
+#define kPmLogSinkMsgFlag_Raw		0x1
+#define kPmLogSinkMsgFlag_Elevated	0x2
+#define kPmLogSinkMsgFlag_KV		0x4
+
+
+/*********************************************************************/
+/* PmLogSinkFunc */
+/**
+@brief  Custom sink callback.  It is called on the logging thread, for
+		messages at enabled levels that are in the sink's level mask,
+		and may be called concurrently from several threads.  It must
+		not log itself.
+**********************************************************************/
+typedef void (*PmLogSinkFunc)(void* userData, const PmLogSinkMsg* msgP);
+
+
+/*********************************************************************/
+/* PmLogRegisterSink */
+/**
+@brief  Adds a sink that receives this process's messages at the
+		levels in levelMask, in addition to the configured outputs.
+		Returns an id for PmLogSetSinkLevels and PmLogUnregisterSink.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_TooManySinks
+**********************************************************************/
+PmLogErr PmLogRegisterSink(uint32_t levelMask, PmLogSinkFunc sinkFunc,
+	void* userData, int* sinkIdP);
+
+
+/*********************************************************************/
+/* PmLogSetSinkLevels */
+/**
+@brief  Changes the level mask of a registered sink.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogSetSinkLevels(int sinkId, uint32_t levelMask);
+
+
+/*********************************************************************/
+/* PmLogUnregisterSink */
+/**
+@brief  Removes a registered sink.  On return the callback is no
+		longer running on any thread, so its userData may be freed.
+		Must not be called from the sink's own callback.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogUnregisterSink(int sinkId);
+
+
+//#####################################################################
+
+
 // Trace support
 
 
@@ -718,24 +1747,51 @@ proto:	void PmLogDumpDataDebug(PmLogContext context,
 
 	#ifndef PMLOG_TRACE_CONTEXT
 		#ifdef PMLOG_TRACE_COMPONENT
-			#define PMLOG_TRACE_CONTEXT	\
-				PmLogGetContextInline(PMLOG_TRACE_COMPONENT)
+			/*********************************************************/
+			/* PmLogTraceContext_ */
+			/**
+			@brief  Returns the PMLOG_TRACE_COMPONENT context, looked up
+					on first use, then kept in a cache per source file,
+					so PMLOG_TRACE_COMPONENT must be defined before this
+					header is included.
+					Clients should not use this directly.
+			**********************************************************/
+			static inline PmLogContext PmLogTraceContext_(void)
+			{
+				static PmLogContext	cache = NULL;
+				PmLogContext		context;
+
+				context = PmLogLoadCachedContext_(&cache);
+				if (context == NULL)
+				{
+					context = PmLogGetContextCached(PMLOG_TRACE_COMPONENT,
+						&cache);
+				}
+
+				return context;
+			}
+
+			#define PMLOG_TRACE_CONTEXT		PmLogTraceContext_()
 		#else
 			#define PMLOG_TRACE_CONTEXT		kPmLogGlobalContext
 		#endif
 	#endif
-	
+
+	// the traces are expressions; PmLogIsEnabled tests the constant
+	// PmLogIsCompiledIn first, so a compiled out trace doesn't even
+	// look up its context
 	#define	PMLOG_TRACE(...)	\
-		(void) PmLogPrint(PMLOG_TRACE_CONTEXT, kPmLogLevel_Debug, __VA_ARGS__)
+		((void) PmLogPrint(PMLOG_TRACE_CONTEXT, kPmLogLevel_Debug,	\
+			__VA_ARGS__))
 
 	#define	PMLOG_TRACE_DATA(p, n)	\
-		(void) PmLogDumpData(PMLOG_TRACE_CONTEXT, kPmLogLevel_Debug, p, n, \
-			kPmLogDumpFormatDefault)
+		((void) PmLogDumpData(PMLOG_TRACE_CONTEXT, kPmLogLevel_Debug,	\
+			p, n, kPmLogDumpFormatDefault))
 
 #else
 
-	#define	PMLOG_TRACE(...)
-	#define	PMLOG_TRACE_DATA(p, n)
+	#define	PMLOG_TRACE(...)		((void) 0)
+	#define	PMLOG_TRACE_DATA(p, n)	((void) 0)
 
 #endif
 
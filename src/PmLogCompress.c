@@ -0,0 +1,321 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Small, fast LZ77 codec producing the LZ4 block format, used for
+*		  compressed log file blocks.  It favours speed over ratio: one
+*		  hash probe per position and no lazy matching.  This file is
+*		  also built into the pmlogcat tool.
+*
+*		  A sequence is a token byte (literal count << 4 | match length
+*		  - 4), extra literal count bytes if it was 15, the literals, a
+*		  2-byte little-endian match offset, then extra match length
+*		  bytes if it was 15.  The last sequence is literals only.
+*
+* @file PmLogCompress.c
+* <hr>
+**/
+
+#include "PmLogLibPrv.h"
+
+#include <string.h>
+
+
+#define kLzMinMatch			4
+#define kLzLastLiterals		5		/* the last 5 bytes are always literals */
+#define kLzMatchStartLimit	12		/* no match starts in the last 12 bytes */
+#define kLzMaxOffset		65535
+#define kLzHashBits			12
+
+
+/*********************************************************************/
+/* PrvLzRead32 */
+/**
+@brief  Unaligned 32-bit load.
+**********************************************************************/
+static inline uint32_t PrvLzRead32(const uint8_t* p)
+{
+	uint32_t	v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+
+/*********************************************************************/
+/* PrvLzHash */
+/**
+@brief  Hashes 4 bytes into a PMLOG_COMPRESS_HASH_SIZE table index.
+**********************************************************************/
+static inline uint32_t PrvLzHash(uint32_t v)
+{
+	return (v * 2654435761u) >> (32 - kLzHashBits);
+}
+
+
+/*********************************************************************/
+/* PrvLzPutLength */
+/**
+@brief  Appends the extra length bytes for a count that overflowed
+		its 4-bit token field.
+**********************************************************************/
+static uint8_t* PrvLzPutLength(uint8_t* op, size_t n)
+{
+	while (n >= 255)
+	{
+		*op++ = 255;
+		n -= 255;
+	}
+
+	*op++ = (uint8_t) n;
+	return op;
+}
+
+
+/*********************************************************************/
+/* PrvLzPutSequence */
+/**
+@brief  Appends one sequence.  matchLen is 0 for the final literals.
+**********************************************************************/
+static uint8_t* PrvLzPutSequence(uint8_t* op, const uint8_t* literals,
+	size_t litLen, size_t offset, size_t matchLen)
+{
+	uint8_t*	tokenP;
+
+	tokenP = op++;
+	*tokenP = (uint8_t) (((litLen >= 15) ? 15 : litLen) << 4);
+	if (litLen >= 15)
+	{
+		op = PrvLzPutLength(op, litLen - 15);
+	}
+
+	memcpy(op, literals, litLen);
+	op += litLen;
+
+	if (matchLen == 0)
+	{
+		return op;
+	}
+
+	*op++ = (uint8_t) (offset & 0xFF);
+	*op++ = (uint8_t) (offset >> 8);
+
+	matchLen -= kLzMinMatch;
+	*tokenP |= (uint8_t) ((matchLen >= 15) ? 15 : matchLen);
+	if (matchLen >= 15)
+	{
+		op = PrvLzPutLength(op, matchLen - 15);
+	}
+
+	return op;
+}
+
+
+/*********************************************************************/
+/* PmLogPrvCompress */
+/**
+@brief  Compresses srcLen bytes into dst in LZ4 block format, using
+		hashTable (PMLOG_COMPRESS_HASH_SIZE entries) as scratch space.
+		dstSize must be at least PMLOG_COMPRESS_BOUND(srcLen).
+		Returns the compressed size, or 0 if dstSize is too small.
+**********************************************************************/
+size_t PmLogPrvCompress(const void* src, size_t srcLen, void* dst,
+	size_t dstSize, uint32_t* hashTable)
+{
+	const uint8_t*	base;
+	const uint8_t*	ip;
+	const uint8_t*	anchor;
+	const uint8_t*	end;
+	const uint8_t*	ref;
+	const uint8_t*	mp;
+	const uint8_t*	rp;
+	uint8_t*		op;
+	uint32_t		seq;
+	uint32_t		h;
+
+	if (dstSize < PMLOG_COMPRESS_BOUND(srcLen))
+	{
+		return 0;
+	}
+
+	base = (const uint8_t*) src;
+	ip = base;
+	anchor = base;
+	end = base + srcLen;
+	op = (uint8_t*) dst;
+
+	memset(hashTable, 0, PMLOG_COMPRESS_HASH_SIZE * sizeof(*hashTable));
+
+	if (srcLen > kLzMatchStartLimit)
+	{
+		while (ip < end - kLzMatchStartLimit)
+		{
+			seq = PrvLzRead32(ip);
+			h = PrvLzHash(seq);
+			ref = base + hashTable[ h ];
+			hashTable[ h ] = (uint32_t) (ip - base);
+
+			if ((ref >= ip) || (ip - ref > kLzMaxOffset) ||
+				(PrvLzRead32(ref) != seq))
+			{
+				ip++;
+				continue;
+			}
+
+			mp = ip + kLzMinMatch;
+			rp = ref + kLzMinMatch;
+			while ((mp < end - kLzLastLiterals) && (*mp == *rp))
+			{
+				mp++;
+				rp++;
+			}
+
+			op = PrvLzPutSequence(op, anchor, (size_t) (ip - anchor),
+				(size_t) (ip - ref), (size_t) (mp - ip));
+
+			ip = mp;
+			anchor = ip;
+		}
+	}
+
+	op = PrvLzPutSequence(op, anchor, (size_t) (end - anchor), 0, 0);
+
+	return (size_t) (op - (uint8_t*) dst);
+}
+
+
+/*********************************************************************/
+/* PrvLzGetLength */
+/**
+@brief  Reads the extra length bytes following a count of 15.
+		Returns false if the input runs out.
+**********************************************************************/
+static bool PrvLzGetLength(const uint8_t** ipP, const uint8_t* ipEnd,
+	size_t* nP)
+{
+	const uint8_t*	ip;
+	uint8_t			b;
+
+	ip = *ipP;
+	do
+	{
+		if (ip >= ipEnd)
+		{
+			return false;
+		}
+
+		b = *ip++;
+		*nP += b;
+	}
+	while (b == 255);
+
+	*ipP = ip;
+	return true;
+}
+
+
+/*********************************************************************/
+/* PmLogPrvDecompress */
+/**
+@brief  Expands LZ4 block format data into dst.  Returns false if the
+		data is malformed or would expand to more than dstSize bytes,
+		otherwise true with the expanded size in *dstLenP.
+**********************************************************************/
+bool PmLogPrvDecompress(const void* src, size_t srcLen, void* dst,
+	size_t dstSize, size_t* dstLenP)
+{
+	const uint8_t*	ip;
+	const uint8_t*	ipEnd;
+	uint8_t*		op;
+	uint8_t*		opStart;
+	uint8_t*		opEnd;
+	const uint8_t*	match;
+	uint8_t			token;
+	size_t			litLen;
+	size_t			matchLen;
+	size_t			offset;
+
+	ip = (const uint8_t*) src;
+	ipEnd = ip + srcLen;
+	opStart = (uint8_t*) dst;
+	op = opStart;
+	opEnd = opStart + dstSize;
+
+	while (ip < ipEnd)
+	{
+		token = *ip++;
+
+		litLen = token >> 4;
+		if ((litLen == 15) && !PrvLzGetLength(&ip, ipEnd, &litLen))
+		{
+			return false;
+		}
+
+		if ((litLen > (size_t) (ipEnd - ip)) ||
+			(litLen > (size_t) (opEnd - op)))
+		{
+			return false;
+		}
+
+		memcpy(op, ip, litLen);
+		op += litLen;
+		ip += litLen;
+
+		// the last sequence has no match
+		if (ip == ipEnd)
+		{
+			break;
+		}
+
+		if (ipEnd - ip < 2)
+		{
+			return false;
+		}
+
+		offset = (size_t) ip[ 0 ] | ((size_t) ip[ 1 ] << 8);
+		ip += 2;
+
+		if ((offset == 0) || (offset > (size_t) (op - opStart)))
+		{
+			return false;
+		}
+
+		matchLen = token & 15;
+		if ((matchLen == 15) && !PrvLzGetLength(&ip, ipEnd, &matchLen))
+		{
+			return false;
+		}
+		matchLen += kLzMinMatch;
+
+		if (matchLen > (size_t) (opEnd - op))
+		{
+			return false;
+		}
+
+		// byte by byte, as the match may overlap what it produces
+		match = op - offset;
+		while (matchLen-- > 0)
+		{
+			*op++ = *match++;
+		}
+	}
+
+	*dstLenP = (size_t) (op - opStart);
+	return true;
+}
@@ -0,0 +1,795 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Direct file output, for systems that run without a syslog
+*		  daemon.  Every process appends whole records to the shared log
+*		  file with a single O_APPEND writev, which the kernel applies
+*		  atomically, so writers in different processes don't interleave.
+*		  Rotation is coordinated through the PmLogFileConf in the shared
+*		  globals and never makes a writer wait.
+*
+*		  In block mode (compressed and/or binary), records are instead
+*		  copied into a staging block, which a writer thread compresses
+*		  and appends once it fills or its oldest record has waited
+*		  flushMs.
+*
+* @file PmLogFileSink.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLibInt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// a rotation claim older than this is assumed to have been abandoned
+// by a process that died while rotating
+#define kStaleClaimSeconds		10
+
+
+// this process's descriptor for the current log file
+static int			gFileFd			= -1;
+
+// the PmLogFileConf generation that gFileFd was opened for
+static uint32_t		gFileGeneration	= 0;
+
+// set while one thread of this process (re)opens the file
+static int			gFileOpening	= 0;
+
+
+// most pieces a record is queued in
+#define kBlockMaxIov			8
+
+// one buffer of records waiting to be written.  format and codec are
+// set by the first record.
+typedef struct
+{
+	char*		buf;
+	size_t		len;
+	uint32_t	numRecords;
+	int			format;
+	int			codec;
+	uint64_t	firstTimeNs;
+	uint64_t	lastTimeNs;
+	uint64_t	contextBits[ PMLOG_BLOCK_CONTEXT_BITS / 64 ];
+}
+PrvFileBlock;
+
+// gBlockLock guards everything below.  Producers fill gBlockFill while
+// the writer thread compresses gBlockSpare; they swap when the writer
+// takes a block.
+static pthread_mutex_t	gBlockLock			= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	gBlockCond			= PTHREAD_COND_INITIALIZER;
+static PrvFileBlock		gBlockFill;
+static PrvFileBlock		gBlockSpare;
+static size_t			gBlockCapacity		= 0;
+static PmLogFileConf*	gBlockConfP			= NULL;
+static pthread_t		gBlockThread;
+static bool				gBlockThreadRunning	= false;
+static bool				gBlockStop			= false;
+
+
+/*********************************************************************/
+/* PrvFileOpen */
+/**
+@brief  Opens the log file for appending, and accounts for its current
+		size and age if this is the first open since it was started.
+**********************************************************************/
+static int PrvFileOpen(PmLogFileConf* confP, int64_t now)
+{
+	int			fd;
+	int			err;
+	struct stat	st;
+	uint64_t	noBytes;
+	int64_t		noTime;
+
+	fd = open(confP->path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		err = errno;
+		ErrPrint("log file open error on %s: %s\n", confP->path,
+			strerror(err));
+		return -1;
+	}
+
+	if ((fstat(fd, &st) == 0) && (st.st_size > 0))
+	{
+		noBytes = 0;
+		(void) __atomic_compare_exchange_n(&confP->bytes, &noBytes,
+			(uint64_t) st.st_size, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+	}
+
+	noTime = 0;
+	(void) __atomic_compare_exchange_n(&confP->openTime, &noTime, now,
+		false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+
+	return fd;
+}
+
+
+/*********************************************************************/
+/* PrvFileGetFd */
+/**
+@brief  Returns the descriptor to write to, reopening the log file if
+		it was rotated.  The reopened file replaces the old one with
+		dup2, so other threads can keep using the descriptor.  If another
+		thread is busy opening the file for the first time, a private
+		descriptor is returned in *tmpFdP, to be closed by the caller.
+**********************************************************************/
+static int PrvFileGetFd(PmLogFileConf* confP, int64_t now, int* tmpFdP)
+{
+	uint32_t	generation;
+	int			fd;
+	int			newFd;
+
+	*tmpFdP = -1;
+
+	generation = __atomic_load_n(&confP->generation, __ATOMIC_ACQUIRE);
+	fd = __atomic_load_n(&gFileFd, __ATOMIC_ACQUIRE);
+
+	if ((fd >= 0) &&
+		(generation == __atomic_load_n(&gFileGeneration, __ATOMIC_RELAXED)))
+	{
+		return fd;
+	}
+
+	if (__atomic_exchange_n(&gFileOpening, 1, __ATOMIC_ACQUIRE) != 0)
+	{
+		// keep appending to the old file until the other thread is done
+		if (fd < 0)
+		{
+			*tmpFdP = PrvFileOpen(confP, now);
+			fd = *tmpFdP;
+		}
+		return fd;
+	}
+
+	newFd = PrvFileOpen(confP, now);
+	if (newFd >= 0)
+	{
+		if (fd >= 0)
+		{
+			(void) dup2(newFd, fd);
+			(void) close(newFd);
+		}
+		else
+		{
+			fd = newFd;
+			__atomic_store_n(&gFileFd, fd, __ATOMIC_RELEASE);
+		}
+
+		__atomic_store_n(&gFileGeneration, generation, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&gFileOpening, 0, __ATOMIC_RELEASE);
+
+	return fd;
+}
+
+
+/*********************************************************************/
+/* PrvFileNeedsRotation */
+/**
+@brief  Returns true if the log file is over its size or age limit.
+**********************************************************************/
+static bool PrvFileNeedsRotation(PmLogFileConf* confP, int64_t now)
+{
+	int64_t	openTime;
+
+	if ((confP->maxSize > 0) &&
+		(__atomic_load_n(&confP->bytes, __ATOMIC_RELAXED) >=
+			(uint64_t) confP->maxSize))
+	{
+		return true;
+	}
+
+	if (confP->rotateSeconds > 0)
+	{
+		openTime = __atomic_load_n(&confP->openTime, __ATOMIC_RELAXED);
+		if ((openTime != 0) && (now - openTime >= confP->rotateSeconds))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*********************************************************************/
+/* PrvFileRotate */
+/**
+@brief  Rotates the log file: path.N-1 => path.N, ..., path => path.1.
+		Only the process that claims the rotation does the renames;
+		anyone else who sees the limit exceeded meanwhile just carries on.
+**********************************************************************/
+static void PrvFileRotate(PmLogFileConf* confP, int64_t now)
+{
+	char		fromPath[ sizeof(confP->path) + 16 ];
+	char		toPath[ sizeof(confP->path) + 16 ];
+	int64_t		claim;
+	int			i;
+
+	claim = __atomic_load_n(&confP->rotateClaim, __ATOMIC_ACQUIRE);
+	if ((claim != 0) && (now - claim < kStaleClaimSeconds))
+	{
+		return;
+	}
+
+	if (!__atomic_compare_exchange_n(&confP->rotateClaim, &claim, now,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	{
+		return;
+	}
+
+	// another process may have rotated just before we claimed it
+	if (!PrvFileNeedsRotation(confP, now))
+	{
+		__atomic_store_n(&confP->rotateClaim, 0, __ATOMIC_RELEASE);
+		return;
+	}
+
+	DbgPrint("rotating %s\n", confP->path);
+
+	for (i = confP->keepFiles - 1; i >= 1; i--)
+	{
+		(void) snprintf(fromPath, sizeof(fromPath), "%s.%d", confP->path, i);
+		(void) snprintf(toPath, sizeof(toPath), "%s.%d", confP->path, i + 1);
+		(void) rename(fromPath, toPath);
+	}
+
+	if (confP->keepFiles > 0)
+	{
+		(void) snprintf(toPath, sizeof(toPath), "%s.1", confP->path);
+		(void) rename(confP->path, toPath);
+	}
+	else
+	{
+		(void) unlink(confP->path);
+	}
+
+	__atomic_store_n(&confP->bytes, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&confP->openTime, now, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&confP->generation, 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&confP->rotateClaim, 0, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkWrite */
+/**
+@brief  Appends the given pieces as one record to the shared log file,
+		opening it on first use, and rotates it when the size or age
+		limit is reached.  now is the current CLOCK_REALTIME seconds.
+**********************************************************************/
+void PrvFileSinkWrite(PmLogFileConf* confP, const struct iovec* iov,
+	int iovCount, int64_t now)
+{
+	int		fd;
+	int		tmpFd;
+	ssize_t	n;
+
+	if (confP->path[ 0 ] == 0)
+	{
+		return;
+	}
+
+	fd = PrvFileGetFd(confP, now, &tmpFd);
+	if (fd < 0)
+	{
+		return;
+	}
+
+	n = writev(fd, iov, iovCount);
+	if (n > 0)
+	{
+		(void) __atomic_add_fetch(&confP->bytes, (uint64_t) n,
+			__ATOMIC_RELAXED);
+	}
+
+	if (tmpFd >= 0)
+	{
+		(void) close(tmpFd);
+	}
+
+	if (PrvFileNeedsRotation(confP, now))
+	{
+		PrvFileRotate(confP, now);
+	}
+}
+
+
+/*********************************************************************/
+/* PrvFileBlockFlushThreshold */
+/**
+@brief  Returns how full the staging block may get before the writer
+		thread takes it.  Called with gBlockLock held.
+**********************************************************************/
+static size_t PrvFileBlockFlushThreshold(void)
+{
+	size_t	blockSize;
+
+	blockSize = (size_t) gBlockConfP->blockSize;
+
+	// the buffers were sized for the block size at the time
+	if ((blockSize == 0) || (blockSize > gBlockCapacity / 2))
+	{
+		blockSize = gBlockCapacity / 2;
+	}
+
+	return blockSize;
+}
+
+
+/*********************************************************************/
+/* PrvFileBlockWrite */
+/**
+@brief  Compresses a staging block and appends it to the log file as
+		one PmLogBlockHeader + data record.  The block is stored as is
+		if it is not to be compressed, or does not compress.
+**********************************************************************/
+static void PrvFileBlockWrite(PrvFileBlock* blockP, void* dataBuf,
+	size_t dataBufSize, uint32_t* hashTable)
+{
+	PmLogBlockHeader	header;
+	struct iovec		iov[ 2 ];
+	size_t				dataLen;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = PMLOG_BLOCK_MAGIC;
+	header.headerSize = sizeof(header);
+	header.version = PMLOG_BLOCK_VERSION;
+	header.rawLen = (uint32_t) blockP->len;
+	header.numRecords = blockP->numRecords;
+	header.format = (uint16_t) blockP->format;
+	header.firstTimeNs = blockP->firstTimeNs;
+	header.lastTimeNs = blockP->lastTimeNs;
+	memcpy(header.contextBits, blockP->contextBits,
+		sizeof(header.contextBits));
+
+	dataLen = 0;
+	if (blockP->codec == kPmLogBlockCodec_LZ4)
+	{
+		dataLen = PmLogPrvCompress(blockP->buf, blockP->len, dataBuf,
+			dataBufSize, hashTable);
+	}
+
+	if ((dataLen > 0) && (dataLen < blockP->len))
+	{
+		header.codec = kPmLogBlockCodec_LZ4;
+		iov[ 1 ].iov_base = dataBuf;
+	}
+	else
+	{
+		header.codec = kPmLogBlockCodec_None;
+		dataLen = blockP->len;
+		iov[ 1 ].iov_base = blockP->buf;
+	}
+
+	header.dataLen = (uint32_t) dataLen;
+
+	iov[ 0 ].iov_base = &header;
+	iov[ 0 ].iov_len = sizeof(header);
+	iov[ 1 ].iov_len = dataLen;
+
+	PrvFileSinkWrite(gBlockConfP, iov, 2,
+		(int64_t) (blockP->lastTimeNs / 1000000000));
+}
+
+
+/*********************************************************************/
+/* PrvFileBlockThread */
+/**
+@brief  Writer thread for block mode.  Waits for the staging block
+		to fill or to age past flushMs, takes it, and compresses and
+		writes it without holding gBlockLock.
+**********************************************************************/
+static void* PrvFileBlockThread(void* arg)
+{
+	static uint32_t	hashTable[ PMLOG_COMPRESS_HASH_SIZE ];
+
+	size_t			dataBufSize;
+	void*			dataBuf;
+	PrvFileBlock	block;
+	uint64_t		deadlineNs;
+	struct timespec	deadline;
+
+	(void) arg;
+
+	dataBufSize = PMLOG_COMPRESS_BOUND(gBlockCapacity);
+	dataBuf = malloc(dataBufSize);
+
+	(void) pthread_mutex_lock(&gBlockLock);
+
+	for (;;)
+	{
+		while (!gBlockStop &&
+			(gBlockFill.len < PrvFileBlockFlushThreshold()))
+		{
+			if (gBlockFill.numRecords == 0)
+			{
+				(void) pthread_cond_wait(&gBlockCond, &gBlockLock);
+				continue;
+			}
+
+			deadlineNs = gBlockFill.firstTimeNs +
+				(uint64_t) gBlockConfP->flushMs * 1000000;
+			deadline.tv_sec = (time_t) (deadlineNs / 1000000000);
+			deadline.tv_nsec = (long) (deadlineNs % 1000000000);
+
+			if (pthread_cond_timedwait(&gBlockCond, &gBlockLock,
+					&deadline) == ETIMEDOUT)
+			{
+				break;
+			}
+		}
+
+		if (gBlockFill.numRecords == 0)
+		{
+			if (gBlockStop)
+			{
+				break;
+			}
+			continue;
+		}
+
+		block = gBlockFill;
+		gBlockFill = gBlockSpare;
+		gBlockFill.len = 0;
+		gBlockFill.numRecords = 0;
+		memset(gBlockFill.contextBits, 0, sizeof(gBlockFill.contextBits));
+
+		(void) pthread_mutex_unlock(&gBlockLock);
+
+		if (dataBuf != NULL)
+		{
+			PrvFileBlockWrite(&block, dataBuf, dataBufSize, hashTable);
+		}
+
+		(void) pthread_mutex_lock(&gBlockLock);
+
+		gBlockSpare = block;
+	}
+
+	(void) pthread_mutex_unlock(&gBlockLock);
+
+	free(dataBuf);
+
+	return NULL;
+}
+
+
+/*********************************************************************/
+/* PrvFileBlockStart */
+/**
+@brief  Allocates the staging blocks and starts the writer thread.
+		Called with gBlockLock held.  The thread blocks all signals,
+		so that they are handled by the application's threads.
+**********************************************************************/
+static bool PrvFileBlockStart(PmLogFileConf* confP)
+{
+	size_t		capacity;
+	sigset_t	allSignals;
+	sigset_t	oldSignals;
+	int			err;
+
+	capacity = 2 * (size_t) confP->blockSize;
+	if ((capacity < 8192) || (capacity > PMLOG_BLOCK_MAX_RAW_SIZE))
+	{
+		capacity = PMLOG_BLOCK_MAX_RAW_SIZE;
+	}
+
+	gBlockFill.buf = malloc(capacity);
+	gBlockSpare.buf = malloc(capacity);
+	if ((gBlockFill.buf == NULL) || (gBlockSpare.buf == NULL))
+	{
+		goto Error;
+	}
+
+	gBlockCapacity = capacity;
+	gBlockConfP = confP;
+
+	(void) sigfillset(&allSignals);
+	(void) pthread_sigmask(SIG_SETMASK, &allSignals, &oldSignals);
+	err = pthread_create(&gBlockThread, NULL, PrvFileBlockThread, NULL);
+	(void) pthread_sigmask(SIG_SETMASK, &oldSignals, NULL);
+
+	if (err != 0)
+	{
+		ErrPrint("log file writer thread error: %s\n", strerror(err));
+		goto Error;
+	}
+
+	gBlockThreadRunning = true;
+	return true;
+
+Error:
+	free(gBlockFill.buf);
+	free(gBlockSpare.buf);
+	gBlockFill.buf = NULL;
+	gBlockSpare.buf = NULL;
+	gBlockCapacity = 0;
+	return false;
+}
+
+
+/*********************************************************************/
+/* PrvFileBlockWriteRecord */
+/**
+@brief  Appends one record as an uncompressed block of its own, for
+		when it can't be staged.
+**********************************************************************/
+static void PrvFileBlockWriteRecord(PmLogFileConf* confP, int format,
+	const struct iovec* iov, int iovCount, size_t recordLen, uint64_t timeNs,
+	uint32_t contextId)
+{
+	PmLogBlockHeader	header;
+	struct iovec		blockIov[ 1 + kBlockMaxIov ];
+
+	memset(&header, 0, sizeof(header));
+	header.magic = PMLOG_BLOCK_MAGIC;
+	header.headerSize = sizeof(header);
+	header.version = PMLOG_BLOCK_VERSION;
+	header.codec = kPmLogBlockCodec_None;
+	header.rawLen = (uint32_t) recordLen;
+	header.dataLen = (uint32_t) recordLen;
+	header.numRecords = 1;
+	header.format = (uint16_t) format;
+	header.firstTimeNs = timeNs;
+	header.lastTimeNs = timeNs;
+	header.contextBits[ (contextId % PMLOG_BLOCK_CONTEXT_BITS) / 64 ] =
+		1ull << (contextId % 64);
+
+	blockIov[ 0 ].iov_base = &header;
+	blockIov[ 0 ].iov_len = sizeof(header);
+	memcpy(&blockIov[ 1 ], iov, (size_t) iovCount * sizeof(*iov));
+
+	PrvFileSinkWrite(confP, blockIov, 1 + iovCount,
+		(int64_t) (timeNs / 1000000000));
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkQueue */
+/**
+@brief  Block mode counterpart of PrvFileSinkWrite: copies the record
+		into the staging block for the writer thread, starting the
+		thread on first use.  Never compresses; if the writer is still
+		a whole block behind after a yield, or the block has a different
+		format or codec, the record is written uncompressed as a block
+		of its own.
+		timeNs is the CLOCK_REALTIME of the record.
+**********************************************************************/
+void PrvFileSinkQueue(PmLogFileConf* confP, int format, int codec,
+	const struct iovec* iov, int iovCount, uint64_t timeNs,
+	uint32_t contextId)
+{
+	size_t	recordLen;
+	size_t	room;
+	bool	retried;
+	int		i;
+
+	if ((confP->path[ 0 ] == 0) || (iovCount > kBlockMaxIov))
+	{
+		return;
+	}
+
+	recordLen = 0;
+	for (i = 0; i < iovCount; i++)
+	{
+		recordLen += iov[ i ].iov_len;
+	}
+
+	retried = false;
+
+Retry:
+	(void) pthread_mutex_lock(&gBlockLock);
+
+	if (!gBlockThreadRunning && (gBlockStop || !PrvFileBlockStart(confP)))
+	{
+		goto Overflow;
+	}
+
+	if (gBlockFill.numRecords == 0)
+	{
+		gBlockFill.format = format;
+		gBlockFill.codec = codec;
+	}
+
+	if ((format != gBlockFill.format) || (codec != gBlockFill.codec))
+	{
+		goto Overflow;
+	}
+
+	room = gBlockCapacity - gBlockFill.len;
+	if ((recordLen > room) && !retried)
+	{
+		// give the writer thread a chance to take the block
+		(void) pthread_cond_signal(&gBlockCond);
+		(void) pthread_mutex_unlock(&gBlockLock);
+		(void) sched_yield();
+		retried = true;
+		goto Retry;
+	}
+
+	if (recordLen > room)
+	{
+		goto Overflow;
+	}
+
+	for (i = 0; i < iovCount; i++)
+	{
+		memcpy(gBlockFill.buf + gBlockFill.len, iov[ i ].iov_base,
+			iov[ i ].iov_len);
+		gBlockFill.len += iov[ i ].iov_len;
+	}
+
+	if (gBlockFill.numRecords == 0)
+	{
+		gBlockFill.firstTimeNs = timeNs;
+		(void) pthread_cond_signal(&gBlockCond);
+	}
+	gBlockFill.numRecords++;
+	gBlockFill.lastTimeNs = timeNs;
+	gBlockFill.contextBits[ (contextId % PMLOG_BLOCK_CONTEXT_BITS) / 64 ] |=
+		1ull << (contextId % 64);
+
+	if (gBlockFill.len >= PrvFileBlockFlushThreshold())
+	{
+		(void) pthread_cond_signal(&gBlockCond);
+	}
+
+	(void) pthread_mutex_unlock(&gBlockLock);
+	return;
+
+Overflow:
+	(void) pthread_mutex_unlock(&gBlockLock);
+
+	PrvFileBlockWriteRecord(confP, format, iov, iovCount, recordLen, timeNs,
+		contextId);
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkHasThread */
+/**
+@brief  Returns true if the block mode writer thread is running.
+**********************************************************************/
+bool PrvFileSinkHasThread(void)
+{
+	bool	running;
+
+	(void) pthread_mutex_lock(&gBlockLock);
+	running = gBlockThreadRunning;
+	(void) pthread_mutex_unlock(&gBlockLock);
+
+	return running;
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkReset */
+/**
+@brief  Lets the log file be written again after PrvFileSinkClose,
+		with whatever settings the next write passes.
+**********************************************************************/
+void PrvFileSinkReset(void)
+{
+	(void) pthread_mutex_lock(&gBlockLock);
+	gBlockStop = false;
+	gBlockConfP = NULL;
+	(void) pthread_mutex_unlock(&gBlockLock);
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkForkPrepare */
+/**
+@brief  Holds off the staging of records until the fork is done, so
+		that the child doesn't inherit a half-copied record.
+**********************************************************************/
+void PrvFileSinkForkPrepare(void)
+{
+	(void) pthread_mutex_lock(&gBlockLock);
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkForkParent */
+/**
+@brief  Lets the parent carry on staging after fork().
+**********************************************************************/
+void PrvFileSinkForkParent(void)
+{
+	(void) pthread_mutex_unlock(&gBlockLock);
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkForkChild */
+/**
+@brief  Resets the block mode state in the child, which has no writer
+		thread.  The records staged so far are the parent's to write, so
+		the child drops its copies of the blocks (a writer may be using
+		one in the parent, so they are not freed), and starts its own
+		writer thread and blocks on its first record.  The log file
+		descriptor is shared with the parent, and appends just as well.
+**********************************************************************/
+void PrvFileSinkForkChild(void)
+{
+	memset(&gBlockFill, 0, sizeof(gBlockFill));
+	memset(&gBlockSpare, 0, sizeof(gBlockSpare));
+	gBlockCapacity = 0;
+	gBlockThreadRunning = false;
+
+	// a thread of the parent may have been reopening the file
+	__atomic_store_n(&gFileOpening, 0, __ATOMIC_RELAXED);
+
+	// the writer thread may have been waiting on the condition, and
+	// the lock was taken by the parent's thread
+	(void) pthread_cond_init(&gBlockCond, NULL);
+	(void) pthread_mutex_init(&gBlockLock, NULL);
+}
+
+
+/*********************************************************************/
+/* PrvFileSinkClose */
+/**
+@brief  Writes out any staged records, stops the writer thread, and
+		closes this process's file descriptor for the log file.
+**********************************************************************/
+void PrvFileSinkClose(void)
+{
+	int		fd;
+	bool	running;
+
+	(void) pthread_mutex_lock(&gBlockLock);
+	gBlockStop = true;
+	running = gBlockThreadRunning;
+	gBlockThreadRunning = false;
+	(void) pthread_cond_signal(&gBlockCond);
+	(void) pthread_mutex_unlock(&gBlockLock);
+
+	if (running)
+	{
+		(void) pthread_join(gBlockThread, NULL);
+		free(gBlockFill.buf);
+		free(gBlockSpare.buf);
+		gBlockFill.buf = NULL;
+		gBlockSpare.buf = NULL;
+	}
+
+	fd = __atomic_exchange_n(&gFileFd, -1, __ATOMIC_ACQ_REL);
+	if (fd >= 0)
+	{
+		(void) close(fd);
+	}
+}
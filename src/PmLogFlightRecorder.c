@@ -0,0 +1,236 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  The flight recorder keeps the most recent messages of a process
+*		  in a file-backed ring, including those at levels that are not
+*		  enabled for output, so that they can be examined with pmlogfr
+*		  after a crash.
+*
+* @file PmLogFlightRecorder.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLibInt.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// take advantage of glibc
+extern const char*	__progname;
+
+
+// the mapped ring, or NULL if the recorder is not running
+static PmLogRingHeader*	gRingP			= NULL;
+static PmLogRingSlot*	gRingSlotsP		= NULL;
+static uint32_t			gRingNumSlots	= 0;
+static size_t			gRingMapSize	= 0;
+static pid_t			gRingPid		= 0;
+static char				gRingPath[ PATH_MAX ];
+
+
+/*********************************************************************/
+/* PrvRecorderOpen */
+/**
+@brief  Creates and maps the flight recorder ring file for this process
+		per the given settings.  Returns true if the recorder is running.
+**********************************************************************/
+bool PrvRecorderOpen(const PmLogRecorderConf* confP)
+{
+	const uint32_t kMinSlots = 16;
+
+	uint32_t			numSlots;
+	size_t				mapSize;
+	int					n;
+	int					fd;
+	int					err;
+	void*				p;
+	PmLogRingHeader*	ringP;
+
+	if ((confP->recordLevel < kPmLogLevel_Emergency) || (gRingP != NULL))
+	{
+		return (gRingP != NULL);
+	}
+
+	numSlots = (confP->recordSize > 0)
+		? (uint32_t) confP->recordSize / PMLOG_RING_SLOT_SIZE
+		: 0;
+	if (numSlots < kMinSlots)
+	{
+		numSlots = kMinSlots;
+	}
+
+	mapSize = PMLOG_RING_HEADER_SIZE + (size_t) numSlots * PMLOG_RING_SLOT_SIZE;
+
+	gRingPid = getpid();
+
+	n = snprintf(gRingPath, sizeof(gRingPath), "%s/%s.%d" PMLOG_RING_FILE_SUFFIX,
+		(confP->recordDir[ 0 ] != 0) ? confP->recordDir : "/tmp",
+		__progname, (int) gRingPid);
+	if ((n < 0) || ((size_t) n >= sizeof(gRingPath)))
+	{
+		ErrPrint("flight recorder path too long\n");
+		return false;
+	}
+
+	fd = open(gRingPath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		err = errno;
+		ErrPrint("flight recorder open error on %s: %s\n", gRingPath,
+			strerror(err));
+		return false;
+	}
+
+	if (ftruncate(fd, (off_t) mapSize) != 0)
+	{
+		err = errno;
+		ErrPrint("flight recorder ftruncate error: %s\n", strerror(err));
+		(void) close(fd);
+		(void) unlink(gRingPath);
+		return false;
+	}
+
+	p = mmap(NULL, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	err = errno;
+	(void) close(fd);
+
+	if (p == MAP_FAILED)
+	{
+		ErrPrint("flight recorder mmap error: %s\n", strerror(err));
+		(void) unlink(gRingPath);
+		return false;
+	}
+
+	// the file was truncated so all slots start out zeroed, i.e. empty
+	ringP = (PmLogRingHeader*) p;
+	ringP->version = PMLOG_RING_VERSION;
+	ringP->headerSize = PMLOG_RING_HEADER_SIZE;
+	ringP->slotSize = PMLOG_RING_SLOT_SIZE;
+	ringP->numSlots = numSlots;
+	ringP->pid = (int32_t) gRingPid;
+	ringP->head = 0;
+	ringP->startTimeNs = PrvTimeNowNs(false);
+	strncpy(ringP->progName, __progname, sizeof(ringP->progName) - 1);
+
+	// the magic marks the header as complete
+	__atomic_store_n(&ringP->magic, PMLOG_RING_MAGIC, __ATOMIC_RELEASE);
+
+	gRingSlotsP = (PmLogRingSlot*) ((uint8_t*) p + PMLOG_RING_HEADER_SIZE);
+	gRingNumSlots = numSlots;
+	gRingMapSize = mapSize;
+	gRingP = ringP;
+
+	DbgPrint("flight recorder %s: %u slots\n", gRingPath, numSlots);
+
+	return true;
+}
+
+
+/*********************************************************************/
+/* PrvRecorderClose */
+/**
+@brief  Unmaps the flight recorder ring.  The ring file is removed,
+		as it is only of interest if the process did not exit cleanly.
+**********************************************************************/
+void PrvRecorderClose(void)
+{
+	PmLogRingHeader*	ringP;
+
+	ringP = gRingP;
+	if (ringP == NULL)
+	{
+		return;
+	}
+
+	gRingP = NULL;
+
+	// a forked child shares the mapping, but the file belongs to
+	// the process that created it
+	if (getpid() == gRingPid)
+	{
+		(void) unlink(gRingPath);
+	}
+
+	(void) munmap(ringP, gRingMapSize);
+
+	gRingSlotsP = NULL;
+	gRingNumSlots = 0;
+	gRingMapSize = 0;
+}
+
+
+/*********************************************************************/
+/* PrvRecorderWrite */
+/**
+@brief  Captures the message into the flight recorder ring.  This is
+		lock-free and async-signal-safe.  Text that does not fit in a
+		slot is truncated.  flags are the kPmLogRingSlotFlag_xxx flags.
+**********************************************************************/
+void PrvRecorderWrite(uint64_t timeNs, const char* component,
+	PmLogLevel level, const char* s, size_t sLen, int flags)
+{
+	PmLogRingHeader*	ringP;
+	PmLogRingSlot*		slotP;
+	uint64_t			index;
+	size_t				componentLen;
+
+	ringP = gRingP;
+	if (ringP == NULL)
+	{
+		return;
+	}
+
+	index = __atomic_fetch_add(&ringP->head, 1, __ATOMIC_RELAXED);
+	slotP = &gRingSlotsP[ index % gRingNumSlots ];
+
+	// mark the slot as incomplete until all of it is written
+	__atomic_store_n(&slotP->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	componentLen = strlen(component);
+	if (componentLen > PMLOG_MAX_CONTEXT_NAME_LEN)
+	{
+		componentLen = PMLOG_MAX_CONTEXT_NAME_LEN;
+	}
+
+	if (sLen > sizeof(slotP->data) - componentLen)
+	{
+		sLen = sizeof(slotP->data) - componentLen;
+	}
+
+	slotP->timeNs = timeNs;
+	slotP->tid = (int32_t) gettid();
+	slotP->level = (int16_t) level;
+	slotP->componentLen = (uint8_t) componentLen;
+	slotP->flags = (uint8_t) flags;
+	slotP->textLen = (uint16_t) sLen;
+	memcpy(slotP->data, component, componentLen);
+	memcpy(slotP->data + componentLen, s, sLen);
+
+	__atomic_store_n(&slotP->seq, index + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,189 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  64-bit XXH64 hash, used to fingerprint data that is too large
+*		  to dump in full.  The output matches the reference XXH64, so
+*		  a dumped digest can be checked with xxhsum.
+*
+* @file PmLogHash.c
+* <hr>
+**/
+
+#include "PmLogLibInt.h"
+
+#include <string.h>
+
+
+#define kXXPrime1	0x9E3779B185EBCA87ULL
+#define kXXPrime2	0xC2B2AE3D27D4EB4FULL
+#define kXXPrime3	0x165667B19E3779F9ULL
+#define kXXPrime4	0x85EBCA77C2B2AE63ULL
+#define kXXPrime5	0x27D4EB2F165667C5ULL
+
+
+/*********************************************************************/
+/* PrvXXRead64 */
+/**
+@brief  Unaligned little-endian 64-bit load.
+**********************************************************************/
+static inline uint64_t PrvXXRead64(const uint8_t* p)
+{
+	uint64_t	v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+	return v;
+}
+
+
+/*********************************************************************/
+/* PrvXXRead32 */
+/**
+@brief  Unaligned little-endian 32-bit load.
+**********************************************************************/
+static inline uint32_t PrvXXRead32(const uint8_t* p)
+{
+	uint32_t	v;
+
+	memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32(v);
+#endif
+	return v;
+}
+
+
+/*********************************************************************/
+/* PrvXXRotl */
+/**
+@brief  64-bit rotate left.
+**********************************************************************/
+static inline uint64_t PrvXXRotl(uint64_t v, int n)
+{
+	return (v << n) | (v >> (64 - n));
+}
+
+
+/*********************************************************************/
+/* PrvXXRound */
+/**
+@brief  Mixes 8 bytes of input into an accumulator.
+**********************************************************************/
+static inline uint64_t PrvXXRound(uint64_t acc, uint64_t input)
+{
+	acc += input * kXXPrime2;
+	acc = PrvXXRotl(acc, 31);
+	return acc * kXXPrime1;
+}
+
+
+/*********************************************************************/
+/* PrvXXMerge */
+/**
+@brief  Folds one of the four stripe accumulators into the hash.
+**********************************************************************/
+static inline uint64_t PrvXXMerge(uint64_t h, uint64_t acc)
+{
+	h ^= PrvXXRound(0, acc);
+	return h * kXXPrime1 + kXXPrime4;
+}
+
+
+/*********************************************************************/
+/* PrvHash64 */
+/**
+@brief  Returns the XXH64 hash of len bytes at data, with seed 0.
+**********************************************************************/
+uint64_t PrvHash64(const void* data, size_t len)
+{
+	const uint8_t*	p;
+	const uint8_t*	end;
+	uint64_t		v1;
+	uint64_t		v2;
+	uint64_t		v3;
+	uint64_t		v4;
+	uint64_t		h;
+
+	p = (const uint8_t*) data;
+	end = p + len;
+
+	if (len >= 32)
+	{
+		v1 = kXXPrime1 + kXXPrime2;
+		v2 = kXXPrime2;
+		v3 = 0;
+		v4 = -kXXPrime1;
+
+		do
+		{
+			v1 = PrvXXRound(v1, PrvXXRead64(p));
+			v2 = PrvXXRound(v2, PrvXXRead64(p + 8));
+			v3 = PrvXXRound(v3, PrvXXRead64(p + 16));
+			v4 = PrvXXRound(v4, PrvXXRead64(p + 24));
+			p += 32;
+		}
+		while (end - p >= 32);
+
+		h = PrvXXRotl(v1, 1) + PrvXXRotl(v2, 7) + PrvXXRotl(v3, 12) +
+			PrvXXRotl(v4, 18);
+		h = PrvXXMerge(h, v1);
+		h = PrvXXMerge(h, v2);
+		h = PrvXXMerge(h, v3);
+		h = PrvXXMerge(h, v4);
+	}
+	else
+	{
+		h = kXXPrime5;
+	}
+
+	h += (uint64_t) len;
+
+	while (end - p >= 8)
+	{
+		h ^= PrvXXRound(0, PrvXXRead64(p));
+		h = PrvXXRotl(h, 27) * kXXPrime1 + kXXPrime4;
+		p += 8;
+	}
+
+	if (end - p >= 4)
+	{
+		h ^= (uint64_t) PrvXXRead32(p) * kXXPrime1;
+		h = PrvXXRotl(h, 23) * kXXPrime2 + kXXPrime3;
+		p += 4;
+	}
+
+	while (p < end)
+	{
+		h ^= (uint64_t) *p * kXXPrime5;
+		h = PrvXXRotl(h, 11) * kXXPrime1;
+		p++;
+	}
+
+	// final avalanche
+	h ^= h >> 33;
+	h *= kXXPrime2;
+	h ^= h >> 29;
+	h *= kXXPrime3;
+	h ^= h >> 32;
+
+	return h;
+}
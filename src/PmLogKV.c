@@ -0,0 +1,357 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Renders the encoded structured records produced by PmLogKV_
+*		  as logfmt or JSON text.  The records travel encoded as far as
+*		  the outputs, and are only rendered by those that write text.
+*		  This file is also built into the pmlogfr and pmlogcat tools.
+*
+* @file PmLogKV.c
+* <hr>
+**/
+
+#include "PmLogLib.h"
+#include "PmLogLibPrv.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+/*********************************************************************/
+/* PrvKVTextBuff */
+/**
+@brief  Bounded text output buffer, always kept NUL-terminated.
+**********************************************************************/
+typedef struct
+{
+	char*		data;
+	size_t		size;
+	size_t		len;
+}
+PrvKVTextBuff;
+
+
+/***********************************************************************
+ * kKVHexChars
+ ***********************************************************************/
+static const char kKVHexChars[16] =
+{
+	'0', '1', '2', '3', '4', '5', '6', '7',
+	'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+
+/*********************************************************************/
+/* PrvKVGetVarint */
+/**
+@brief  Read an unsigned LEB128 varint.  Returns false if the input
+		is truncated or malformed.
+**********************************************************************/
+static bool PrvKVGetVarint(const uint8_t** pP, const uint8_t* endP,
+	uint64_t* vP)
+{
+	const uint8_t*	p;
+	uint64_t		v;
+	unsigned		shift;
+
+	v = 0;
+	for (p = *pP, shift = 0; (p < endP) && (shift < 64); p++, shift += 7)
+	{
+		v |= ((uint64_t) (*p & 0x7F)) << shift;
+		if ((*p & 0x80) == 0)
+		{
+			*pP = p + 1;
+			*vP = v;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/*********************************************************************/
+/* PrvKVGetBytes */
+/**
+@brief  Read a length-prefixed byte string.  Returns false if the
+		input is truncated or malformed.
+**********************************************************************/
+static bool PrvKVGetBytes(const uint8_t** pP, const uint8_t* endP,
+	const uint8_t** bytesPP, size_t* nP)
+{
+	uint64_t	n;
+
+	if (!PrvKVGetVarint(pP, endP, &n) || (n > (uint64_t) (endP - *pP)))
+	{
+		return false;
+	}
+
+	*bytesPP = *pP;
+	*nP = (size_t) n;
+	*pP += n;
+	return true;
+}
+
+
+/*********************************************************************/
+/* PrvKVText */
+/**
+@brief  Append text to the buffer.  Text past the end is silently
+		truncated.
+**********************************************************************/
+static void PrvKVText(PrvKVTextBuff* textP, const char* s, size_t n)
+{
+	size_t	avail;
+
+	// reserve one byte for the terminator
+	avail = textP->size - 1 - textP->len;
+	if (n > avail)
+	{
+		n = avail;
+	}
+
+	memcpy(textP->data + textP->len, s, n);
+	textP->len += n;
+	textP->data[ textP->len ] = 0;
+}
+
+
+/*********************************************************************/
+/* PrvKVTextStr */
+/**
+@brief  Append a string, quoted and escaped as needed for logfmt or
+		JSON.
+**********************************************************************/
+static void PrvKVTextStr(PrvKVTextBuff* textP, const uint8_t* s, size_t n,
+	bool json)
+{
+	bool	quote;
+	size_t	i;
+	uint8_t	c;
+	char	esc[ 8 ];
+
+	// JSON strings are always quoted, logfmt only when required
+	quote = json || (n == 0);
+	for (i = 0; !quote && (i < n); i++)
+	{
+		c = s[ i ];
+		quote = (c <= ' ') || (c == '=') || (c == '"') || (c == '\\') ||
+			(c >= 0x7F);
+	}
+
+	if (!quote)
+	{
+		PrvKVText(textP, (const char*) s, n);
+		return;
+	}
+
+	PrvKVText(textP, "\"", 1);
+
+	for (i = 0; i < n; i++)
+	{
+		c = s[ i ];
+		if ((c == '"') || (c == '\\'))
+		{
+			esc[ 0 ] = '\\';
+			esc[ 1 ] = (char) c;
+			PrvKVText(textP, esc, 2);
+		}
+		else if (c == '\n')
+		{
+			PrvKVText(textP, "\\n", 2);
+		}
+		else if (c == '\t')
+		{
+			PrvKVText(textP, "\\t", 2);
+		}
+		else if ((c < ' ') || (c == 0x7F))
+		{
+			(void) snprintf(esc, sizeof(esc), json ? "\\u%04X" : "\\x%02X",
+				(unsigned) c);
+			PrvKVText(textP, esc, strlen(esc));
+		}
+		else
+		{
+			PrvKVText(textP, (const char*) &s[ i ], 1);
+		}
+	}
+
+	PrvKVText(textP, "\"", 1);
+}
+
+
+/*********************************************************************/
+/* PmLogPrvKVRender */
+/**
+@brief  Renders an encoded structured record as logfmt, e.g.
+			msg=xfer.done peer="a b" bytes=1024
+		or as JSON, e.g.
+			{"msg":"xfer.done","peer":"a b","bytes":1024}
+		Keys and string values are quoted and escaped the same way.
+		The text is always NUL-terminated, and cut short if it doesn't
+		fit.  Returns false if the record is malformed or truncated, in
+		which case the text holds the fields before the bad one.
+**********************************************************************/
+bool PmLogPrvKVRender(const void* rec, size_t recLen, bool json,
+	char* buff, size_t buffSize)
+{
+	const uint8_t*	p;
+	const uint8_t*	endP;
+	const uint8_t*	bytesP;
+	PrvKVTextBuff	text;
+	size_t			n;
+	uint64_t		bits;
+	uint8_t			type;
+	int64_t			i64;
+	double			d;
+	char			numStr[ 32 ];
+	size_t			i;
+	bool			first;
+
+	if (buffSize == 0)
+	{
+		return false;
+	}
+
+	text.data = buff;
+	text.size = buffSize;
+	text.len = 0;
+	buff[ 0 ] = 0;
+
+	p = (const uint8_t*) rec;
+	endP = p + recLen;
+
+	first = true;
+	if (json)
+	{
+		PrvKVText(&text, "{", 1);
+	}
+
+	// message id
+	if (!PrvKVGetBytes(&p, endP, &bytesP, &n))
+	{
+		return false;
+	}
+
+	if (n > 0)
+	{
+		PrvKVText(&text, json ? "\"msg\":" : "msg=", json ? 6 : 4);
+		PrvKVTextStr(&text, bytesP, n, json);
+		first = false;
+	}
+
+	while (p < endP)
+	{
+		type = *p++;
+
+		// key
+		if (!PrvKVGetBytes(&p, endP, &bytesP, &n))
+		{
+			return false;
+		}
+
+		if (!first)
+		{
+			PrvKVText(&text, json ? "," : " ", 1);
+		}
+		first = false;
+
+		PrvKVTextStr(&text, bytesP, n, json);
+		PrvKVText(&text, json ? ":" : "=", 1);
+
+		// value
+		switch (type)
+		{
+			case kPmLogKVType_Int64:
+				if (!PrvKVGetVarint(&p, endP, &bits))
+				{
+					return false;
+				}
+				i64 = (int64_t) ((bits >> 1) ^ (~(bits & 1) + 1));
+				(void) snprintf(numStr, sizeof(numStr), "%lld",
+					(long long) i64);
+				PrvKVText(&text, numStr, strlen(numStr));
+				break;
+
+			case kPmLogKVType_Double:
+				if (endP - p < 8)
+				{
+					return false;
+				}
+				for (bits = 0, i = 0; i < 8; i++)
+				{
+					bits |= ((uint64_t) p[ i ]) << (8 * i);
+				}
+				p += 8;
+				memcpy(&d, &bits, sizeof(d));
+				(void) snprintf(numStr, sizeof(numStr), "%.17g", d);
+				if (json && !((d == d) && (d - d == 0)))
+				{
+					// JSON has no representation for nan and inf
+					PrvKVTextStr(&text, (const uint8_t*) numStr,
+						strlen(numStr), true);
+				}
+				else
+				{
+					PrvKVText(&text, numStr, strlen(numStr));
+				}
+				break;
+
+			case kPmLogKVType_String:
+				if (!PrvKVGetBytes(&p, endP, &bytesP, &n))
+				{
+					return false;
+				}
+				PrvKVTextStr(&text, bytesP, n, json);
+				break;
+
+			case kPmLogKVType_Bytes:
+				if (!PrvKVGetBytes(&p, endP, &bytesP, &n))
+				{
+					return false;
+				}
+				if (json)
+				{
+					PrvKVText(&text, "\"", 1);
+				}
+				for (i = 0; i < n; i++)
+				{
+					numStr[ 0 ] = kKVHexChars[ bytesP[ i ] >> 4 ];
+					numStr[ 1 ] = kKVHexChars[ bytesP[ i ] & 0x0F ];
+					PrvKVText(&text, numStr, 2);
+				}
+				if (json)
+				{
+					PrvKVText(&text, "\"", 1);
+				}
+				break;
+
+			default:
+				return false;
+		}
+	}
+
+	if (json)
+	{
+		PrvKVText(&text, "}", 1);
+	}
+
+	return true;
+}
@@ -22,19 +22,28 @@
 
 #include "PmLogLib.h"
 #include "PmLogLibPrv.h"
+#include "PmLogLibInt.h"
 
 #include <assert.h>
 #include <ctype.h>
+#include <dirent.h>
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <sched.h>
 #include <semaphore.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/syscall.h>
 #include <sys/syslog.h>
 #include <sys/shm.h>
+#include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 
@@ -54,59 +63,6 @@ pid_t gettid(void)
 //#######################################################################
 
 
-/***********************************************************************
- * COMPONENT_PREFIX
- ***********************************************************************/
-#define COMPONENT_PREFIX	"PmLogLib: "
-
-
-// don't check in with this on!
-//#define DEBUG_ENABLED
-
-
-#ifdef DEBUG_ENABLED
-
-	/***********************************************************************
-	 * DbgPrint
-	 ***********************************************************************/
-	#define DbgPrint(...) \
-		{														\
-			fprintf(stdout, COMPONENT_PREFIX __VA_ARGS__);		\
-			syslog(LOG_DEBUG, COMPONENT_PREFIX __VA_ARGS__);	\
-		}
-
-
-	/***********************************************************************
-	 * ErrPrint
-	 ***********************************************************************/
-	#define ErrPrint(...) \
-		{														\
-			fprintf(stderr, COMPONENT_PREFIX __VA_ARGS__);		\
-			syslog(LOG_ERR, COMPONENT_PREFIX __VA_ARGS__);		\
-		}
-
-#else
-
-	/***********************************************************************
-	 * DbgPrint
-	 ***********************************************************************/
-	#define DbgPrint(...)
-
-
-	/***********************************************************************
-	 * ErrPrint
-	 ***********************************************************************/
-	#define ErrPrint(...) \
-		{														\
-			syslog(LOG_ERR, COMPONENT_PREFIX __VA_ARGS__);		\
-		}
-
-#endif // DEBUG_ENABLED
-
-
-//#######################################################################
-
-
 /***********************************************************************
  * DEBUG_LOGGING
  *
@@ -363,6 +319,37 @@ static bool ParseBool(const char* valStr, bool* bP,
 }
 
 
+/***********************************************************************
+ * ParseInt
+ ***********************************************************************/
+static bool ParseInt(const char* valStr, int minVal, int maxVal, int* nP,
+	char* errMsg, size_t errMsgBuffSize)
+{
+	char*	endStr;
+	long	n;
+
+	errMsg[ 0 ] = 0;
+
+	errno = 0;
+	n = strtol(valStr, &endStr, 0);
+	if ((errno != 0) || (endStr == valStr) || (*endStr != 0))
+	{
+		mystrcpy(errMsg, errMsgBuffSize, "integer value expected");
+		return false;
+	}
+
+	if ((n < minVal) || (n > maxVal))
+	{
+		mysprintf(errMsg, errMsgBuffSize, "value must be %d..%d",
+			minVal, maxVal);
+		return false;
+	}
+
+	*nP = (int) n;
+	return true;
+}
+
+
 /***********************************************************************
  * ParseKeyValue
  *
@@ -669,11 +656,93 @@ static bool PrvParseConfigLevel(const char* s, int* levelP)
 }
 
 
+/***********************************************************************
+ * PrvParseLevelMask
+ *
+ * Parses a comma-separated list of levels and level ranges into a
+ * sink level mask, e.g.
+ * "emerg..err"     => emerg, alert, crit and err
+ * "warning,info"   => just those two
+ * "all" or "none"
+ * Return true if parsed OK, else false.
+ ***********************************************************************/
+static bool PrvParseLevelMask(const char* s, uint32_t* maskP)
+{
+	char		buff[ 256 ];
+	char*		savePtr;
+	char*		itemStr;
+	char*		rangeStr;
+	int			lo;
+	int			hi;
+	int			level;
+	uint32_t	mask;
+
+	if (strlen(s) >= sizeof(buff))
+	{
+		return false;
+	}
+
+	mystrcpy(buff, sizeof(buff), s);
+
+	mask = 0;
+
+	for (itemStr = strtok_r(buff, ",", &savePtr); itemStr != NULL;
+		itemStr = strtok_r(NULL, ",", &savePtr))
+	{
+		if (strcmp(itemStr, "all") == 0)
+		{
+			mask |= PMLOG_LEVEL_MASK_ALL;
+			continue;
+		}
+
+		if (strcmp(itemStr, "none") == 0)
+		{
+			continue;
+		}
+
+		rangeStr = strstr(itemStr, "..");
+		if (rangeStr != NULL)
+		{
+			*rangeStr = 0;
+			rangeStr += 2;
+		}
+		else
+		{
+			rangeStr = itemStr;
+		}
+
+		if (!PrvParseConfigLevel(itemStr, &lo) ||
+			!PrvParseConfigLevel(rangeStr, &hi) ||
+			(lo < kPmLogLevel_Emergency) || (hi < lo))
+		{
+			return false;
+		}
+
+		for (level = lo; level <= hi; level++)
+		{
+			mask |= PMLOG_LEVEL_MASK(level);
+		}
+	}
+
+	*maskP = mask;
+	return true;
+}
+
+
+static PmLogErr PrvValidateLevelPattern(const char* pattern);
+static PmLogErr PrvSetLevelRule(const char* pattern, PmLogLevel level,
+	int facility);
+
+
 /*********************************************************************/
 /* PrvInitContext */
 /**
 @brief  Read the configuration file for pre-defined contexts and
-		context levels.
+		context levels.  The value is the level, optionally followed
+		by a comma and the syslog facility, e.g. "info,local3".  A
+		glob pattern as the name sets the level of all the matching
+		contexts.  Both are kept as a rule, as by PmLogSetContextLevels,
+		applied to the context whenever it is created.
 **********************************************************************/
 static bool PrvInitContext(const char* contextName, const char* levelStr,
 	char* errMsg, size_t errMsgBuffSize)
@@ -681,20 +750,76 @@ static bool PrvInitContext(const char* contextName, const char* levelStr,
 	PmLogErr		logErr;
 	PmLogContext	context;
 	int				level;
+	const int*		facilityP;
+	char			levelBuff[ 32 ];
+	char*			facilityStr;
 
 	errMsg[ 0 ] = 0;
 
 	DbgPrint("defining %s => %s\n", contextName, levelStr);
 
+	mystrcpy(levelBuff, sizeof(levelBuff), levelStr);
+
+	facilityP = NULL;
+	facilityStr = strchr(levelBuff, ',');
+	if (facilityStr != NULL)
+	{
+		*facilityStr++ = 0;
+
+		facilityP = PmLogStringToFacility(facilityStr);
+		if (facilityP == NULL)
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "Failed to parse facility");
+			return false;
+		}
+	}
+
 	level = kPmLogLevel_Debug;
-	if (!PrvParseConfigLevel(levelStr, &level))
+	if (!PrvParseConfigLevel(levelBuff, &level))
 	{
 		mystrcpy(errMsg, errMsgBuffSize, "Failed to parse level");
 		return false;
 	}
 
-	context = NULL;
-	logErr = PmLogGetContext(contextName, &context);
+	// the global context is never reclaimed, so is simply set
+	if (strcmp(contextName, kPmLogGlobalContextName) == 0)
+	{
+		logErr = PmLogSetContextLevel(kPmLogGlobalContext, level);
+		if ((logErr == kPmLogErr_None) && (facilityP != NULL))
+		{
+			logErr = PmLogSetContextFacility(kPmLogGlobalContext,
+				*facilityP);
+		}
+
+		if (logErr != kPmLogErr_None)
+		{
+			mysprintf(errMsg, errMsgBuffSize, "Error setting context: %s",
+				PmLogGetErrDbgString(logErr));
+			return false;
+		}
+
+		return true;
+	}
+
+	// a name with glob characters sets the level of a set of contexts;
+	// a plain name is created now, so that it is listed from the start
+	if (strpbrk(contextName, "*?[") != NULL)
+	{
+		if (facilityP != NULL)
+		{
+			mystrcpy(errMsg, errMsgBuffSize,
+				"Facility can't be set by pattern");
+			return false;
+		}
+
+		logErr = PrvValidateLevelPattern(contextName);
+	}
+	else
+	{
+		context = NULL;
+		logErr = PmLogGetContext(contextName, &context);
+	}
+
 	if (logErr != kPmLogErr_None)
 	{
 		mysprintf(errMsg, errMsgBuffSize, "Error getting context: %s",
@@ -702,10 +827,14 @@ static bool PrvInitContext(const char* contextName, const char* levelStr,
 		return false;
 	}
 
-	logErr = PmLogSetContextLevel(context, level);
+	// either way the settings are kept as a rule, rather than pinning
+	// the context, so that they apply again if it is reclaimed and then
+	// got afresh
+	logErr = PrvSetLevelRule(contextName, level,
+		(facilityP != NULL) ? *facilityP : 0);
 	if (logErr != kPmLogErr_None)
 	{
-		mysprintf(errMsg, errMsgBuffSize, "Error setting context level: %s",
+		mysprintf(errMsg, errMsgBuffSize, "Error setting context levels: %s",
 			PmLogGetErrDbgString(logErr));
 		return false;
 	}
@@ -833,18 +962,37 @@ static bool PrvInitContexts(void)
 /*********************************************************************/
 /* PrvSetFlag */
 /**
-@brief  Set or clear the flag bit as indicated.
+@brief  Set or clear the flag bit as indicated.  The flags are shared
+		with every logging thread, so each bit is changed atomically.
 **********************************************************************/
 static void PrvSetFlag(int* flagsP, int flagValue, bool set)
 {
 	if (set)
 	{
-		*flagsP = *flagsP | flagValue;
+		(void) __atomic_fetch_or(flagsP, flagValue, __ATOMIC_RELAXED);
 	}
 	else
 	{
-		*flagsP = *flagsP & (~flagValue);
+		(void) __atomic_fetch_and(flagsP, ~flagValue, __ATOMIC_RELAXED);
+	}
+}
+
+
+/*********************************************************************/
+/* PrvReadConfigLevelMask */
+/**
+@brief  Read a sink level mask setting.
+**********************************************************************/
+static bool PrvReadConfigLevelMask(PmLogGlobals* gGlobalsP, int sink,
+	const char* valStr, char* errMsg, size_t errMsgBuffSize)
+{
+	if (!PrvParseLevelMask(valStr, &gGlobalsP->sinkLevels[ sink ]))
+	{
+		mystrcpy(errMsg, errMsgBuffSize, "Failed to parse levels");
+		return false;
 	}
+
+	return true;
 }
 
 
@@ -897,6 +1045,224 @@ static bool PrvReadConfigKey(PmLogGlobals* gGlobalsP,
 		return true;
 	}
 	//------------------------------------------------------
+	if (strcmp(keyStr, "KVFormat") == 0)
+	{
+		if (strcmp(valStr, "logfmt") == 0)
+		{
+			PrvSetFlag(flagsP, kPmLogGlobalsFlag_KVFormatJson, false);
+			return true;
+		}
+
+		if (strcmp(valStr, "json") == 0)
+		{
+			PrvSetFlag(flagsP, kPmLogGlobalsFlag_KVFormatJson, true);
+			return true;
+		}
+
+		mystrcpy(errMsg, errMsgBuffSize, "'logfmt' or 'json' expected");
+		return false;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "FlightRecorderLevel") == 0)
+	{
+		if (!PrvParseConfigLevel(valStr,
+				&gGlobalsP->recorderConf.recordLevel))
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "Failed to parse level");
+			return false;
+		}
+
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "FlightRecorderSize") == 0)
+	{
+		return ParseInt(valStr, 4096, 64 * 1024 * 1024,
+			&gGlobalsP->recorderConf.recordSize, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "FlightRecorderDir") == 0)
+	{
+		if ((valStr[ 0 ] != '/') ||
+			(strlen(valStr) >= sizeof(gGlobalsP->recorderConf.recordDir)))
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "absolute path expected");
+			return false;
+		}
+
+		mystrcpy(gGlobalsP->recorderConf.recordDir,
+			sizeof(gGlobalsP->recorderConf.recordDir), valStr);
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogToSyslog") == 0)
+	{
+		bool bLogSyslog = false;
+		if (!ParseBool(valStr, &bLogSyslog, errMsg, errMsgBuffSize))
+		{
+			return false;
+		}
+
+		PrvSetFlag(flagsP, kPmLogGlobalsFlag_LogToSyslog, bLogSyslog);
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "SyslogLevels") == 0)
+	{
+		return PrvReadConfigLevelMask(gGlobalsP, kPmLogSink_Syslog, valStr,
+			errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "StdErrLevels") == 0)
+	{
+		return PrvReadConfigLevelMask(gGlobalsP, kPmLogSink_StdErr, valStr,
+			errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "StdOutLevels") == 0)
+	{
+		return PrvReadConfigLevelMask(gGlobalsP, kPmLogSink_StdOut, valStr,
+			errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogSocket") == 0)
+	{
+		if ((valStr[ 0 ] != '/') ||
+			(strlen(valStr) >= sizeof(gGlobalsP->socketPath)))
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "absolute path expected");
+			return false;
+		}
+
+		mystrcpy(gGlobalsP->socketPath, sizeof(gGlobalsP->socketPath),
+			valStr);
+		PrvSetFlag(flagsP, kPmLogGlobalsFlag_LogToSocket, true);
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogSocketLevels") == 0)
+	{
+		return PrvReadConfigLevelMask(gGlobalsP, kPmLogSink_Socket, valStr,
+			errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileLevels") == 0)
+	{
+		return PrvReadConfigLevelMask(gGlobalsP, kPmLogSink_File, valStr,
+			errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFile") == 0)
+	{
+		if ((valStr[ 0 ] != '/') ||
+			(strlen(valStr) >= sizeof(gGlobalsP->fileConf.path)))
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "absolute path expected");
+			return false;
+		}
+
+		mystrcpy(gGlobalsP->fileConf.path, sizeof(gGlobalsP->fileConf.path),
+			valStr);
+		PrvSetFlag(flagsP, kPmLogGlobalsFlag_LogToFile, true);
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileMaxSize") == 0)
+	{
+		return ParseInt(valStr, 0, 1024 * 1024 * 1024,
+			&gGlobalsP->fileConf.maxSize, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileRotateSeconds") == 0)
+	{
+		return ParseInt(valStr, 0, 365 * 24 * 60 * 60,
+			&gGlobalsP->fileConf.rotateSeconds, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileKeep") == 0)
+	{
+		return ParseInt(valStr, 0, 99,
+			&gGlobalsP->fileConf.keepFiles, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileCompress") == 0)
+	{
+		bool bCompress = false;
+		if (!ParseBool(valStr, &bCompress, errMsg, errMsgBuffSize))
+		{
+			return false;
+		}
+
+		PrvSetFlag(flagsP, kPmLogGlobalsFlag_FileCompress, bCompress);
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "TimeSource") == 0)
+	{
+		if (strcmp(valStr, "clock") == 0)
+		{
+			PrvSetFlag(flagsP, kPmLogGlobalsFlag_TimeTsc, false);
+		}
+		else if (strcmp(valStr, "tsc") == 0)
+		{
+			PrvSetFlag(flagsP, kPmLogGlobalsFlag_TimeTsc, true);
+		}
+		else
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "clock or tsc expected");
+			return false;
+		}
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "SyslogTimestamps") == 0)
+	{
+		bool bTimestamps = false;
+		if (!ParseBool(valStr, &bTimestamps, errMsg, errMsgBuffSize))
+		{
+			return false;
+		}
+
+		PrvSetFlag(flagsP, kPmLogGlobalsFlag_SyslogTimestamps, bTimestamps);
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileFormat") == 0)
+	{
+		if (strcmp(valStr, "text") == 0)
+		{
+			PrvSetFlag(flagsP, kPmLogGlobalsFlag_FileBinary, false);
+		}
+		else if (strcmp(valStr, "binary") == 0)
+		{
+			PrvSetFlag(flagsP, kPmLogGlobalsFlag_FileBinary, true);
+		}
+		else
+		{
+			mystrcpy(errMsg, errMsgBuffSize, "text or binary expected");
+			return false;
+		}
+		return true;
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileBlockSize") == 0)
+	{
+		return ParseInt(valStr, 4096, PMLOG_BLOCK_MAX_RAW_SIZE / 2,
+			&gGlobalsP->fileConf.blockSize, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "LogFileFlushMs") == 0)
+	{
+		return ParseInt(valStr, 10, 60000,
+			&gGlobalsP->fileConf.flushMs, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
+	if (strcmp(keyStr, "DumpMaxBytes") == 0)
+	{
+		return ParseInt(valStr, 0, 1024 * 1024 * 1024,
+			&gGlobalsP->dumpMaxBytes, errMsg, errMsgBuffSize);
+	}
+	//------------------------------------------------------
 
 	mysprintf(errMsg, errMsgBuffSize, "key '%s' not recognized", keyStr);
 	return false;
@@ -923,10 +1289,39 @@ static bool PrvReadGlobalConfig(PmLogGlobals* gGlobalsP)
 	char	key[ 256 ];
 	char	val[ 256 ];
 	char	errMsg[ 256 ];
+	char	oldLogFile[ sizeof(gGlobalsP->fileConf.path) ];
+	bool	result;
 
 	DbgPrint("reading global config PmLogContexts.conf\n");
 
-	gGlobalsP->flags = 0;
+	__atomic_store_n(&gGlobalsP->flags, kPmLogGlobalsFlag_LogToSyslog,
+		__ATOMIC_RELAXED);
+
+	gGlobalsP->sinkLevels[ kPmLogSink_Syslog ] = PMLOG_LEVEL_MASK_ALL;
+	gGlobalsP->sinkLevels[ kPmLogSink_Socket ] = PMLOG_LEVEL_MASK_ALL;
+	gGlobalsP->sinkLevels[ kPmLogSink_File ] = PMLOG_LEVEL_MASK_ALL;
+	gGlobalsP->sinkLevels[ kPmLogSink_StdErr ] =
+		PMLOG_LEVEL_MASK_UPTO(kPmLogLevel_Error);
+	gGlobalsP->sinkLevels[ kPmLogSink_StdOut ] = PMLOG_LEVEL_MASK_ALL &
+		~PMLOG_LEVEL_MASK_UPTO(kPmLogLevel_Error);
+	gGlobalsP->socketPath[ 0 ] = 0;
+	gGlobalsP->dumpMaxBytes = 16 * 1024;
+
+	gGlobalsP->recorderConf.recordLevel = kPmLogLevel_None;
+	gGlobalsP->recorderConf.recordSize = 64 * 1024;
+	mystrcpy(gGlobalsP->recorderConf.recordDir,
+		sizeof(gGlobalsP->recorderConf.recordDir), "/tmp");
+
+	// the rest of fileConf is shared writer state, kept across reloads
+	mystrcpy(oldLogFile, sizeof(oldLogFile), gGlobalsP->fileConf.path);
+	gGlobalsP->fileConf.path[ 0 ] = 0;
+	gGlobalsP->fileConf.maxSize = 8 * 1024 * 1024;
+	gGlobalsP->fileConf.rotateSeconds = 0;
+	gGlobalsP->fileConf.keepFiles = 4;
+	gGlobalsP->fileConf.blockSize = 64 * 1024;
+	gGlobalsP->fileConf.flushMs = 1000;
+
+	result = false;
 
 	f = fopen(kConfigFile, "r");
 	if (f == NULL)
@@ -934,7 +1329,7 @@ static bool PrvReadGlobalConfig(PmLogGlobals* gGlobalsP)
 		err = errno;
 		ErrPrint("Config error on %s: Failed open: %s\n", kConfigFile,
 			strerror(err));
-		return false;
+		goto Exit;
 	}
 
 	inConfigSection = false;
@@ -1011,9 +1406,27 @@ static bool PrvReadGlobalConfig(PmLogGlobals* gGlobalsP)
 
 	(void) fclose(f);
 
-	//---------------------------------------------------
+	result = true;
 
-	return true;
+Exit:
+	gGlobalsP->sinkLevels[ kPmLogSink_Ring ] =
+		(gGlobalsP->recorderConf.recordLevel >= kPmLogLevel_Emergency)
+			? PMLOG_LEVEL_MASK_UPTO(gGlobalsP->recorderConf.recordLevel)
+			: 0;
+
+	// have each process rebuild its sink dispatch
+	__atomic_add_fetch(&gGlobalsP->configGeneration, 1, __ATOMIC_RELEASE);
+
+	// writers holding the old file open need to switch to the new one
+	if (strcmp(oldLogFile, gGlobalsP->fileConf.path) != 0)
+	{
+		__atomic_store_n(&gGlobalsP->fileConf.bytes, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&gGlobalsP->fileConf.openTime, 0, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&gGlobalsP->fileConf.generation, 1,
+			__ATOMIC_RELEASE);
+	}
+
+	return result;
 }
 
 
@@ -1026,8 +1439,273 @@ static int				gShmId			= -1;
 static uint8_t*			gShmData		= NULL;
 
 // typed pointers to shared memory segment
-static PmLogGlobals*	gGlobalsP		= NULL;
-static PmLogContext_*	gGlobalContextP	= NULL;
+static PmLogGlobals*		gGlobalsP		= NULL;
+static PmLogContextInfo*	gGlobalContextP	= NULL;		/* contextInfo[ 0 ] */
+
+// how this process is attached to each context, for detaching at exit
+enum
+{
+	kAttach_None = 0,
+	kAttach_Owner,		/* recorded in the context's owners */
+	kAttach_Counted		/* only counted in numAttached */
+};
+
+static uint8_t				gAttached[ 1 + PMLOG_MAX_NUM_CONTEXTS ];
+static pid_t				gAttachedPid	= 0;	/* the pid gAttached is for */
+
+// this process as recorded in the owners of the contexts it attaches to
+static PmLogContextOwner	gSelfOwner;
+
+// the generation of each slot when this process last handed out a
+// handle to it; a handle is refused once the slot is reclaimed
+static uint32_t				gGotGeneration[ 1 + PMLOG_MAX_NUM_CONTEXTS ];
+
+// set once a handle has been handed out to the client, after which the
+// namespace can't be switched
+static int					gHandedOut		= 0;
+
+// most owners probed at once for whether they are alive (see
+// PrvProbeOwners)
+#define kMaxProbedOwners	64
+
+/*********************************************************************/
+/* PrvProbedOwners */
+/**
+@brief  Owners of contexts and pass entries, probed without the lock
+		for whether they are alive.
+**********************************************************************/
+typedef struct
+{
+	int					numOwners;
+	PmLogContextOwner	owners[ kMaxProbedOwners ];
+	bool				alive[ kMaxProbedOwners ];
+}
+PrvProbedOwners;
+
+static void PrvAttachContext(PmLogContextInfo* contextP);
+static void PrvDetachContexts(void);
+static void PrvRefreshProcessLevels(void);
+static void PrvUpdateThreadLevel(void);
+static void PrvSetRecordLevel(int level);
+static void PrvPublishPassLevels(void);
+static bool PrvReleasePassEntry(void);
+static void PrvRefreshCheckLevels(void);
+static bool PrvRaisePassFloor(int level);
+static int PrvContextPassLevel(int index);
+static void PrvForkPassEntry(void);
+
+// the pid of the process about to fork, for the child's handler
+static pid_t				gForkParentPid	= 0;
+
+// the namespace attached to, "" for the default one
+static char					gNamespace[ PMLOG_MAX_NAMESPACE_LEN + 1 ];
+
+// environment variable naming the namespace to attach to at startup
+static const char* const	kPmLogNamespaceEnvVar	= "PMLOG_NAMESPACE";
+
+
+/*********************************************************************/
+/* PrvIsValidNamespace */
+/**
+@brief  Returns true if the string is a valid namespace name: up to
+		PMLOG_MAX_NAMESPACE_LEN of A-Z, a-z, 0-9, '_' and '-', or ""
+		for the default namespace.
+**********************************************************************/
+static bool PrvIsValidNamespace(const char* ns)
+{
+	size_t	n;
+	size_t	i;
+
+	n = strlen(ns);
+	if (n > PMLOG_MAX_NAMESPACE_LEN)
+	{
+		return false;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		if (!isalnum((unsigned char) ns[ i ]) && (ns[ i ] != '_') &&
+			(ns[ i ] != '-'))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// passed to PrvStoreCheckLevels to keep the context's pass level
+#define kKeepPassLevel		INT8_MIN
+
+
+/*********************************************************************/
+/* PrvPackCheckLevels */
+/**
+@brief  Returns the checkLevels of a context with the given level and
+		pass level (see PmLogCheckLevelOf_ and PmLogPassLevelOf_).
+**********************************************************************/
+static int PrvPackCheckLevels(int level, int passLevel)
+{
+	int		checkLevel;
+
+	checkLevel = (level > passLevel) ? level : passLevel;
+
+	return (checkLevel & 0xFF) | ((passLevel & 0xFF) << 8);
+}
+
+
+/*********************************************************************/
+/* PrvStoreCheckLevels */
+/**
+@brief  Brings the context's checkLevels up to date with its level,
+		and sets its pass level, unless kKeepPassLevel.  The level is
+		set without the lock, so the word is only replaced if unchanged
+		since the level was read: whoever replaces it last has read the
+		newest level.  Lock-free.
+**********************************************************************/
+static void PrvStoreCheckLevels(PmLogContextInfo* contextP, int passLevel)
+{
+	int		oldLevels;
+	int		newLevels;
+	int		level;
+
+	oldLevels = __atomic_load_n(&contextP->checkLevels, __ATOMIC_ACQUIRE);
+	do
+	{
+		level = __atomic_load_n(&contextP->enabledLevel, __ATOMIC_ACQUIRE);
+		newLevels = PrvPackCheckLevels(level,
+			(passLevel == kKeepPassLevel)
+				? PmLogPassLevelOf_(oldLevels)
+				: passLevel);
+		if (newLevels == oldLevels)
+		{
+			return;
+		}
+	}
+	while (!__atomic_compare_exchange_n(&contextP->checkLevels, &oldLevels,
+		newLevels, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+}
+
+
+/*********************************************************************/
+/* PrvStoreContextLevel */
+/**
+@brief  Sets the context's level, and the check level that the inline
+		check reads.  Lock-free.
+**********************************************************************/
+static void PrvStoreContextLevel(PmLogContextInfo* contextP, int level)
+{
+	__atomic_store_n(&contextP->enabledLevel, level, __ATOMIC_RELEASE);
+	PrvStoreCheckLevels(contextP, kKeepPassLevel);
+}
+
+
+/*********************************************************************/
+/* kNoGlobalContextInfo */
+/**
+@brief  Placeholder for PmLogGlobalContext_ while the shared memory
+		is not attached.  All levels are enabled so that logging calls
+		reach the library and report the error.
+**********************************************************************/
+static const PmLogContextInfo kNoGlobalContextInfo =
+{
+	kPmLogLevel_Debug,	/* enabledLevel */
+	0,					/* flags */
+	(kPmLogLevel_Debug << 8) | kPmLogLevel_Debug	/* checkLevels */
+};
+
+
+// exported for the inline level check on kPmLogGlobalContext
+PmLogContext			PmLogGlobalContext_	= &kNoGlobalContextInfo;
+
+// the flight recorder level, set if the recorder runs
+int						PmLogRecordLevel_	= kPmLogLevel_None;
+
+// the highest thread level of any thread, in step with
+// gThreadLevelCounts, and passed on to PmLogIsEnabled_ in every context
+// (see PrvPublishPassLevels)
+static int				gThreadPassLevel	= kPmLogLevel_None;
+
+// this process's entry in the pass entries, or -1, and the pid it is
+// for, as a forked child has none
+static int				gPassEntry			= -1;
+static pid_t			gPassEntryPid		= 0;
+
+// set while there are overrides
+static int				gProcessLevelsActive	= 0;
+
+// the number of threads whose thread level is each level, and the lock
+// that keeps them and gThreadPassLevel in step
+static int				gThreadLevelCounts[ kPmLogLevel_Debug + 1 ];
+static pthread_mutex_t	gPassLock		= PTHREAD_MUTEX_INITIALIZER;
+
+// removes a thread's level from gThreadLevelCounts when it exits
+static pthread_key_t	gThreadLevelKey;
+static pthread_once_t	gThreadLevelKeyOnce	= PTHREAD_ONCE_INIT;
+
+// the higher of the thread's elevated and backtrace capture levels, as
+// counted in gThreadLevelCounts
+static __thread int		gThreadLevel	= kPmLogLevel_None;
+
+// the thread's level set by PmLogElevateThreadLevel
+static __thread int		gElevatedLevel	= kPmLogLevel_None;
+
+// the level saved by each PmLogElevateThreadLevel not yet restored,
+// innermost last
+static __thread int		gElevateSaved[ PMLOG_MAX_THREAD_ELEVATIONS ];
+static __thread int		gElevateDepth	= 0;
+
+
+/*********************************************************************/
+/* PrvBacktraceRec */
+/**
+@brief  A message held back for a thread's backtrace, followed by
+		msgLen bytes of message, padded to 8 bytes.  msgFlags are its
+		kPmLogSinkMsgFlag_xxx flags.
+**********************************************************************/
+typedef struct
+{
+	uint64_t			timeNs;
+	PmLogContextInfo*	contextP;
+	int16_t				level;
+	uint16_t			msgFlags;
+	uint32_t			msgLen;
+}
+PrvBacktraceRec;
+
+
+/*********************************************************************/
+/* PrvBacktrace */
+/**
+@brief  A thread's backtrace buffer (PmLogBeginBacktrace).  Allocated on
+		first use, and freed when the thread exits.
+**********************************************************************/
+typedef struct
+{
+	PmLogContextInfo*	contextP;		/* NULL if not capturing */
+	int					captureLevel;
+	size_t				len;			/* bytes of records in data */
+	uint64_t			data[ PMLOG_BACKTRACE_BUFF_SIZE / 8 ];
+}
+PrvBacktrace;
+
+static __thread PrvBacktrace*	gBacktraceP	= NULL;
+
+static pthread_key_t		gBacktraceKey;
+static pthread_once_t		gBacktraceKeyOnce	= PTHREAD_ONCE_INIT;
+
+// this process's level overrides (PmLogSetProcessLevels), newest last
+static PmLogLevelRule		gProcessRules[ PMLOG_MAX_LEVEL_RULES ];
+static int					gNumProcessRules	= 0;
+
+// the override for each context slot, or kNoProcessLevel
+#define kNoProcessLevel		INT8_MIN
+
+static int8_t				gProcessLevels[ 1 + PMLOG_MAX_NUM_CONTEXTS ];
+
+// environment variable giving the overrides to set at startup
+static const char* const	kPmLogLevelsEnvVar	= "PMLOG_LEVELS";
 
 
 /*********************************************************************/
@@ -1043,17 +1721,29 @@ static const char kHexChars[16] =
 
 
 /*********************************************************************/
-/* init_function */
+/* kBase64Chars */
 /**
-@brief  Library constructor executes automatically in the loading
-	process before any other library API is called.
+@brief  Lookup for base64 output (RFC 4648).
 **********************************************************************/
-static void __attribute ((constructor)) init_function(void)
+static const char kBase64Chars[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+
+/*********************************************************************/
+/* PrvAttachNamespace */
+/**
+@brief  Opens the semaphore and shared memory segment of the given
+		namespace, or the default one if ns is NULL or "", initializing
+		the segment if it is new, then starts this process's flight
+		recorder and sink dispatch per its settings.
+**********************************************************************/
+static void PrvAttachNamespace(const char* ns)
 {
 	const char* kPmLogLibSoFilePath = "/usr/lib/libPmLogLib.so";
 
 	int			err;
 	sem_t*		sem;
+	char		semName[ 16 + PMLOG_MAX_NAMESPACE_LEN ];
 	key_t		key;
 	int			shmid;
 	char*		data;
@@ -1062,14 +1752,32 @@ static void __attribute ((constructor)) init_function(void)
 	Dl_info		dlInfo;
 	int			result;
 	const char*	libFilePath;
+	char		keyFilePath[ 32 + PMLOG_MAX_NAMESPACE_LEN ];
+	int			handedOut;
+
+	if (ns == NULL)
+	{
+		ns = "";
+	}
 
-	// get/create the PmLogLib semaphore
+	mystrcpy(gNamespace, sizeof(gNamespace), ns);
+
+	// get/create the PmLogLib semaphore, PmLogLib.<ns> for a namespace
 
 	// note: named semaphores are created in a virtual file system,
 	// under /dev/shm, with names of the form sem.<name>
 	DbgPrint("Opening sem\n");
 
-	sem = sem_open("PmLogLib", O_CREAT, 0666, 1);
+	if (ns[ 0 ] != 0)
+	{
+		mysprintf(semName, sizeof(semName), "PmLogLib.%s", ns);
+	}
+	else
+	{
+		mystrcpy(semName, sizeof(semName), "PmLogLib");
+	}
+
+	sem = sem_open(semName, O_CREAT, 0666, 1);
 	if (sem == SEM_FAILED)
 	{
 		err = errno;
@@ -1085,7 +1793,7 @@ static void __attribute ((constructor)) init_function(void)
 	libFilePath = NULL;
 
 	memset(&dlInfo, 0, sizeof(dlInfo));
-	result = dladdr(init_function, &dlInfo);
+	result = dladdr(PrvAttachNamespace, &dlInfo);
 	if (result)
 	{
 		libFilePath = dlInfo.dli_fname;
@@ -1107,7 +1815,17 @@ static void __attribute ((constructor)) init_function(void)
 
 	DbgPrint("getting shm key\n");
 
-	key = ftok(libFilePath, 'A');
+	// a namespace has its own segment, keyed off its own semaphore's
+	// file, which only this library creates.  ftok only keeps some bits
+	// of the inode, so the namespace is also checked on attaching
+	if (ns[ 0 ] != 0)
+	{
+		mysprintf(keyFilePath, sizeof(keyFilePath), "/dev/shm/sem.%s",
+			semName);
+		libFilePath = keyFilePath;
+	}
+
+	key = ftok(libFilePath, PMLOG_SHM_PROJ_ID);
 	if (key == -1)
 	{
 		err = errno;
@@ -1132,8 +1850,16 @@ static void __attribute ((constructor)) init_function(void)
 	shmid = shmget(key, shmSize, 0666 | IPC_CREAT);
 	if (shmid == -1)
 	{
+		// the key is per layout version, so this is a segment of
+		// another size left by some other program, or another build
 		err = errno;
+		if (err == EINVAL)
+		{
+			ErrPrint("shared mem key 0x%x is in use with another size\n",
+				(unsigned) key);
+		}
 		ErrPrint("shmget error: %s\n", strerror(err));
+		PmLogPrvUnlock();
 		return;
 	}
 
@@ -1144,6 +1870,7 @@ static void __attribute ((constructor)) init_function(void)
 	{
 		err = errno;
 		ErrPrint("shmat error: %s\n", strerror(err));
+		PmLogPrvUnlock();
 		return;
 	}
 
@@ -1151,7 +1878,7 @@ static void __attribute ((constructor)) init_function(void)
 
 	// same as gShmData, but typecast for use
 	gGlobalsP = (PmLogGlobals*) gShmData;
-	gGlobalContextP = &gGlobalsP->globalContext;
+	gGlobalContextP = &gGlobalsP->contextInfo[ 0 ];
 
 	needInit = false;
 
@@ -1162,31 +1889,45 @@ static void __attribute ((constructor)) init_function(void)
 		DbgPrint("initializing shared mem\n");
 
 		gGlobalsP->signature = PMLOG_SIGNATURE;
+		gGlobalsP->layoutSize = sizeof(PmLogGlobals);
 
-		gGlobalsP->maxUserContexts = sizeof(gGlobalsP->userContexts) /
-			sizeof(PmLogContext_);
+		gGlobalsP->maxUserContexts = PMLOG_MAX_NUM_CONTEXTS;
+		mystrcpy(gGlobalsP->nsName, sizeof(gGlobalsP->nsName), ns);
 
 		gGlobalsP->numUserContexts = 0;
 
-		gGlobalsP->flags = 0;
+		__atomic_store_n(&gGlobalsP->flags, 0, __ATOMIC_RELAXED);
 
-		gGlobalsP->consoleConf.stdErrMinLevel = kPmLogLevel_Emergency;
-		gGlobalsP->consoleConf.stdErrMaxLevel = kPmLogLevel_Error;
-		gGlobalsP->consoleConf.stdOutMinLevel = kPmLogLevel_Warning;
-		gGlobalsP->consoleConf.stdOutMaxLevel = kPmLogLevel_Debug;
+		mystrcpy(gGlobalsP->contextMeta[ 0 ].component,
+			sizeof(gGlobalsP->contextMeta[ 0 ].component),
+			kPmLogGlobalContextName);
 
-		mystrcpy(gGlobalContextP->component,
-			sizeof(gGlobalContextP->component), kPmLogGlobalContextName);
+		__atomic_store_n(&gGlobalContextP->enabledLevel, kPmLogLevel_Debug,
+			__ATOMIC_RELAXED);
+		__atomic_store_n(&gGlobalContextP->flags, 0, __ATOMIC_RELAXED);
+		gGlobalsP->contextMeta[ 0 ].facility = 0;
 
-		gGlobalContextP->info.enabledLevel = kPmLogLevel_Debug;
-		gGlobalContextP->info.flags = 0;
+		// no process passes any level on to the library yet
+		gGlobalsP->passFloor = kPmLogLevel_None;
+		PrvStoreCheckLevels(gGlobalContextP, kPmLogLevel_None);
 
 		needInit = true;
 	}
 	//---------------------------------------------------------------
-	else if (gGlobalsP->signature == PMLOG_SIGNATURE)
+	else if ((gGlobalsP->signature == PMLOG_SIGNATURE) &&
+		(gGlobalsP->layoutSize == sizeof(PmLogGlobals)))
 	{
 		DbgPrint("accessing shared mem\n");
+
+		// another namespace whose key is the same
+		if (strncmp(gGlobalsP->nsName, ns, sizeof(gGlobalsP->nsName)) != 0)
+		{
+			ErrPrint("shared mem of namespace '%s' is '%.*s'\n", ns,
+				(int) sizeof(gGlobalsP->nsName), gGlobalsP->nsName);
+
+			gGlobalsP = NULL;
+			gGlobalContextP = NULL;
+		}
 	}
 	//---------------------------------------------------------------
 	else
@@ -1198,6 +1939,11 @@ static void __attribute ((constructor)) init_function(void)
 	}
 	//---------------------------------------------------------------
 
+	if (gGlobalContextP != NULL)
+	{
+		PmLogGlobalContext_ = gGlobalContextP;
+	}
+
 	if (needInit)
 	{
 		(void) PrvReadGlobalConfig(gGlobalsP);
@@ -1206,10 +1952,229 @@ static void __attribute ((constructor)) init_function(void)
 	// release the globals lock
 	PmLogPrvUnlock();
 
-	// initialize contexts if this is the first time
+	// initialize contexts if this is the first time.  The handles got
+	// for that are never seen by the client
 	if (needInit)
 	{
+		handedOut = __atomic_load_n(&gHandedOut, __ATOMIC_RELAXED);
 		(void) PrvInitContexts();
+		__atomic_store_n(&gHandedOut, handedOut, __ATOMIC_RELAXED);
+	}
+
+	// start this process's flight recorder, if configured
+	if ((gGlobalsP != NULL) && PrvRecorderOpen(&gGlobalsP->recorderConf))
+	{
+		PrvSetRecordLevel(gGlobalsP->recorderConf.recordLevel);
+	}
+
+	// build the sink dispatch up front, as the signal-safe path can't
+	if (gGlobalsP != NULL)
+	{
+		PrvSinkRebuild(gGlobalsP);
+	}
+
+	// apply this process's overrides to the namespace's contexts, and
+	// have the levels its recorder takes passed on in every process
+	if (gGlobalsP != NULL)
+	{
+		PmLogPrvLock();
+		if (PrvRaisePassFloor(PmLogLoadRelaxed_(&PmLogRecordLevel_)))
+		{
+			PrvRefreshCheckLevels();
+		}
+		PrvRefreshProcessLevels();
+		PmLogPrvUnlock();
+	}
+}
+
+
+/*********************************************************************/
+/* PrvSetProcessLevelsFromEnv */
+/**
+@brief  Sets the level overrides given in PMLOG_LEVELS, as a comma-
+		separated list of pattern=level.  Bad entries are reported and
+		skipped.
+**********************************************************************/
+static void PrvSetProcessLevelsFromEnv(const char* s)
+{
+	const char*	endP;
+	size_t		n;
+	char		item[ 2 * (PMLOG_MAX_CONTEXT_NAME_LEN + 1) ];
+	char		pattern[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
+	char		levelStr[ 32 ];
+	int			level;
+
+	for (;;)
+	{
+		endP = strchr(s, ',');
+		n = (endP != NULL) ? (size_t) (endP - s) : strlen(s);
+
+		if ((n > 0) && (n < sizeof(item)))
+		{
+			memcpy(item, s, n);
+			item[ n ] = 0;
+
+			if (!ParseKeyValue(item, pattern, sizeof(pattern),
+					levelStr, sizeof(levelStr)) ||
+				!PrvParseConfigLevel(levelStr, &level) ||
+				(PmLogSetProcessLevels(pattern, level) != kPmLogErr_None))
+			{
+				ErrPrint("invalid %s entry: %s\n", kPmLogLevelsEnvVar, item);
+			}
+		}
+		else if (n > 0)
+		{
+			ErrPrint("invalid %s entry: %.*s\n", kPmLogLevelsEnvVar,
+				(int) n, s);
+		}
+
+		if (endP == NULL)
+		{
+			break;
+		}
+
+		s = endP + 1;
+	}
+}
+
+
+/*********************************************************************/
+/* PrvForkPrepare */
+/**
+@brief  fork() prepare handler: waits for the library's own locks to
+		be free, and holds them across the fork, so that the child does
+		not inherit them locked.  Only this process's locks are taken:
+		the shared memory semaphore is left alone, so that a fork
+		doesn't hold up the other processes, and the child attaches to
+		its contexts without it.
+**********************************************************************/
+static void PrvForkPrepare(void)
+{
+	(void) pthread_mutex_lock(&gPassLock);
+	PrvSinkForkPrepare();
+	PrvFileSinkForkPrepare();
+
+	gForkParentPid = getpid();
+}
+
+
+/*********************************************************************/
+/* PrvForkParent */
+/**
+@brief  fork() parent handler: releases the locks.
+**********************************************************************/
+static void PrvForkParent(void)
+{
+	PrvFileSinkForkParent();
+	PrvSinkForkParent();
+	(void) pthread_mutex_unlock(&gPassLock);
+}
+
+
+/*********************************************************************/
+/* PrvForkChild */
+/**
+@brief  fork() child handler: releases the locks, and resets what
+		belonged to the parent's other threads or to its pid, so that
+		the child can log straight away: the log file writer thread,
+		the flight recorder ring, the contexts attached to, and the
+		calling thread's elevated level and backtrace.  The parent is
+		still attached to its contexts, so the child attaches to them
+		without the semaphore, which another process may be holding.
+**********************************************************************/
+static void PrvForkChild(void)
+{
+	uint8_t		attached[ sizeof(gAttached) ];
+	size_t		index;
+
+	PrvFileSinkForkChild();
+	PrvSinkForkChild();
+	PrvTimeForkChild();
+
+	// the other threads' levels were counted in the parent
+	(void) pthread_mutex_init(&gPassLock, NULL);
+	memset(gThreadLevelCounts, 0, sizeof(gThreadLevelCounts));
+	gThreadLevel = kPmLogLevel_None;
+
+	// the ring file is named for the parent's pid, and left to it
+	if (PmLogLoadRelaxed_(&PmLogRecordLevel_) != kPmLogLevel_None)
+	{
+		PrvRecorderClose();
+		if ((gGlobalsP == NULL) ||
+			!PrvRecorderOpen(&gGlobalsP->recorderConf))
+		{
+			PrvSetRecordLevel(kPmLogLevel_None);
+		}
+	}
+
+	// the request this thread was handling is the parent's
+	gElevatedLevel = kPmLogLevel_None;
+	gElevateDepth = 0;
+	if (gBacktraceP != NULL)
+	{
+		gBacktraceP->contextP = NULL;
+		gBacktraceP->len = 0;
+	}
+	gThreadPassLevel = kPmLogLevel_None;
+
+	// the parent's pass entry covers the child's overrides only while
+	// the parent runs
+	if (gGlobalsP != NULL)
+	{
+		PrvForkPassEntry();
+	}
+
+	// keep the contexts the parent got for as long as the child runs
+	if (gAttachedPid != gForkParentPid)
+	{
+		return;
+	}
+
+	memcpy(attached, gAttached, sizeof(attached));
+	memset(gAttached, 0, sizeof(gAttached));
+	gAttachedPid = getpid();
+
+	if (gGlobalsP != NULL)
+	{
+		for (index = 1; index < sizeof(attached); index++)
+		{
+			if (attached[ index ] != kAttach_None)
+			{
+				PrvAttachContext(&gGlobalsP->contextInfo[ index ]);
+			}
+		}
+	}
+}
+
+
+/*********************************************************************/
+/* init_function */
+/**
+@brief  Library constructor executes automatically in the loading
+	process before any other library API is called.  Attaches to the
+	namespace named by PMLOG_NAMESPACE, if set, and sets the level
+	overrides in PMLOG_LEVELS.  Also installs the fork() handlers.
+**********************************************************************/
+static void __attribute ((constructor)) init_function(void)
+{
+	const char*	ns;
+	const char*	levels;
+
+	(void) pthread_atfork(PrvForkPrepare, PrvForkParent, PrvForkChild);
+
+	ns = getenv(kPmLogNamespaceEnvVar);
+	if ((ns != NULL) && !PrvIsValidNamespace(ns))
+	{
+		ErrPrint("invalid %s: %s\n", kPmLogNamespaceEnvVar, ns);
+		ns = NULL;
+	}
+
+	PrvAttachNamespace(ns);
+
+	levels = getenv(kPmLogLevelsEnvVar);
+	if (levels != NULL)
+	{
+		PrvSetProcessLevelsFromEnv(levels);
 	}
 }
 
@@ -1227,6 +2192,24 @@ static void __attribute ((destructor)) fini_function(void)
 
 	//------------------------------------------------------------
 
+	PmLogGlobalContext_ = &kNoGlobalContextInfo;
+
+	PrvSetRecordLevel(kPmLogLevel_None);
+	PrvRecorderClose();
+	PrvFileSinkClose();
+
+	// let the contexts this process got be reclaimed
+	if ((gGlobalsP != NULL) && (gSem != SEM_FAILED))
+	{
+		PmLogPrvLock();
+		PrvDetachContexts();
+		if (PrvReleasePassEntry())
+		{
+			PrvRefreshCheckLevels();
+		}
+		PmLogPrvUnlock();
+	}
+
 	gGlobalsP = NULL;
 	gGlobalContextP = NULL;
 
@@ -1271,6 +2254,125 @@ static void __attribute ((destructor)) fini_function(void)
 }
 
 
+/*********************************************************************/
+/* PrvCountThreads */
+/**
+@brief  Returns the number of threads in this process, or -1 if it
+		can't be read.
+**********************************************************************/
+static int PrvCountThreads(void)
+{
+	DIR*			dir;
+	struct dirent*	entryP;
+	int				n;
+
+	dir = opendir("/proc/self/task");
+	if (dir == NULL)
+	{
+		return -1;
+	}
+
+	n = 0;
+	while ((entryP = readdir(dir)) != NULL)
+	{
+		if (entryP->d_name[ 0 ] != '.')
+		{
+			n++;
+		}
+	}
+
+	(void) closedir(dir);
+
+	return n;
+}
+
+
+/*********************************************************************/
+/* PmLogSetNamespace */
+/**
+@brief  Detaches this process from its namespace and attaches it to
+		the given one.  The globals are switched without any lock, so
+		this is refused once the client holds a context handle, which
+		would still point into the old segment, or once any other
+		thread may be using them.  The old segment and semaphore are
+		left open, so that the global context's inline level check
+		never reads unmapped memory.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InUse
+**********************************************************************/
+PmLogErr PmLogSetNamespace(const char* name)
+{
+	int		numThreads;
+
+	if (name == NULL)
+	{
+		name = "";
+	}
+
+	if (!PrvIsValidNamespace(name))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	if ((gGlobalsP != NULL) && (strcmp(name, gNamespace) == 0))
+	{
+		return kPmLogErr_None;
+	}
+
+	if (__atomic_load_n(&gHandedOut, __ATOMIC_RELAXED))
+	{
+		return kPmLogErr_InUse;
+	}
+
+	// the log file writer is the library's own, and stopped below
+	numThreads = PrvCountThreads();
+	if (PrvFileSinkHasThread())
+	{
+		numThreads--;
+	}
+
+	if (numThreads != 1)
+	{
+		return kPmLogErr_InUse;
+	}
+
+	DbgPrint("switching to namespace '%s'\n", name);
+
+	// let the contexts this process got in the old namespace be reclaimed
+	if ((gGlobalsP != NULL) && (gSem != SEM_FAILED))
+	{
+		PmLogPrvLock();
+		PrvDetachContexts();
+		if (PrvReleasePassEntry())
+		{
+			PrvRefreshCheckLevels();
+		}
+		PmLogPrvUnlock();
+	}
+
+	PmLogGlobalContext_ = &kNoGlobalContextInfo;
+
+	PrvSetRecordLevel(kPmLogLevel_None);
+	PrvRecorderClose();
+	PrvFileSinkClose();
+	PrvFileSinkReset();
+
+	gGlobalsP = NULL;
+	gGlobalContextP = NULL;
+	gShmData = NULL;
+	gShmId = -1;
+	gSem = SEM_FAILED;
+	memset(gGotGeneration, 0, sizeof(gGotGeneration));
+
+	PrvAttachNamespace(name);
+
+	return (gGlobalsP != NULL) ? kPmLogErr_None : kPmLogErr_Unknown;
+}
+
+
 /*********************************************************************/
 /* PmLogPrvGlobals */
 /**
@@ -1328,26 +2430,77 @@ void PmLogPrvUnlock(void)
 /*********************************************************************/
 /* PrvResolveContext */
 /**
-@brief  Resolve a public PmLogContext pointer to the corresponding
-		PmLogContext_ pointer.
-		Also, resolve a NULL pointer to the real pointer of the
-		global context.
+@brief  Resolve a public PmLogContext pointer, which points at the
+		context's entry in the shared contextInfo array, to a writable
+		pointer.  Also, resolve a NULL pointer to the real pointer of
+		the global context.  Returns NULL if the handle is not for a
+		context, or for one whose slot has been reclaimed since this
+		process got it.
 **********************************************************************/
-static inline PmLogContext_* PrvResolveContext(PmLogContext context)
+static inline PmLogContextInfo* PrvResolveContext(PmLogContext context)
 {
-	return (context == NULL) ? gGlobalContextP : (PmLogContext_*) context;
+	uintptr_t	offset;
+	size_t		index;
+
+	if (context == NULL)
+	{
+		return gGlobalContextP;
+	}
+
+	if (gGlobalsP == NULL)
+	{
+		return NULL;
+	}
+
+	offset = (uintptr_t) context - (uintptr_t) gGlobalsP->contextInfo;
+	if ((offset >= sizeof(gGlobalsP->contextInfo)) ||
+		(offset % sizeof(PmLogContextInfo) != 0))
+	{
+		return NULL;
+	}
+
+	index = offset / sizeof(PmLogContextInfo);
+	if (__atomic_load_n(&gGlobalsP->contextMeta[ index ].generation,
+		__ATOMIC_RELAXED) !=
+		__atomic_load_n(&gGotGeneration[ index ], __ATOMIC_RELAXED))
+	{
+		return NULL;
+	}
+
+	return &gGlobalsP->contextInfo[ index ];
 }
 
 
 /*********************************************************************/
 /* PrvExportContext */
 /**
-@brief  Convert a private PmLogContext_ pointer to the corresponding
+@brief  Convert a resolved context pointer to the corresponding
 		public PmLogContext pointer.
 **********************************************************************/
-static inline PmLogContext PrvExportContext(const PmLogContext_* contextP)
+static inline PmLogContext PrvExportContext(const PmLogContextInfo* contextP)
+{
+	return (PmLogContext) contextP;
+}
+
+
+/*********************************************************************/
+/* PrvHandOutContext */
+/**
+@brief  Convert a context pointer to the handle returned to the
+		client, and record the slot's generation, which the handle is
+		checked against from then on.
+**********************************************************************/
+static PmLogContext PrvHandOutContext(const PmLogContextInfo* contextP)
 {
-	return (contextP == NULL) ? NULL : &contextP->info;
+	size_t	index;
+
+	index = contextP - gGlobalsP->contextInfo;
+	__atomic_store_n(&gGotGeneration[ index ],
+		__atomic_load_n(&gGlobalsP->contextMeta[ index ].generation,
+			__ATOMIC_RELAXED), __ATOMIC_RELAXED);
+	__atomic_store_n(&gHandedOut, 1, __ATOMIC_RELAXED);
+
+	return PrvExportContext(contextP);
 }
 
 
@@ -1357,7 +2510,7 @@ static inline PmLogContext PrvExportContext(const PmLogContext_* contextP)
 @brief  Returns true if the specified context pointer is for the
 		global context.
 **********************************************************************/
-static inline bool PrvIsGlobalContext(const PmLogContext_* contextP)
+static inline bool PrvIsGlobalContext(const PmLogContextInfo* contextP)
 {
 	// context should already have been resolved
 	assert(contextP != NULL);
@@ -1365,6 +2518,30 @@ static inline bool PrvIsGlobalContext(const PmLogContext_* contextP)
 }
 
 
+/*********************************************************************/
+/* PrvContextMeta */
+/**
+@brief  Returns the cold data (name, facility) of a resolved context,
+		which is kept apart from its level word.
+**********************************************************************/
+static inline PmLogContextMeta* PrvContextMeta(
+	const PmLogContextInfo* contextP)
+{
+	return &gGlobalsP->contextMeta[ contextP - gGlobalsP->contextInfo ];
+}
+
+
+/*********************************************************************/
+/* PrvContextName */
+/**
+@brief  Returns the name of a resolved context.
+**********************************************************************/
+static inline char* PrvContextName(const PmLogContextInfo* contextP)
+{
+	return PrvContextMeta(contextP)->component;
+}
+
+
 /*********************************************************************/
 /* PrvIsValidLevel */
 /**
@@ -1379,414 +2556,2959 @@ static inline bool PrvIsValidLevel(PmLogLevel level)
 
 
 /*********************************************************************/
-/* PrvValidateContextName */
+/* PrvContextsChangeBegin */
 /**
-@brief  Returns true if and only if the given string is a valid
-		context name, i.e. meets the requirements for length
-		and valid characters.
+@brief  Opens a change to the contexts (adding one, or setting a
+		facility or level rule) for PmLogGetContextsSnapshot: makes the
+		seqlock odd until PrvContextsChangeEnd.  The context globals
+		must be locked.  The seqlock is only ever moved on by atomic
+		adds, so that PrvContextsChanged needs no lock.
 **********************************************************************/
-static PmLogErr PrvValidateContextName(const char* contextName)
+static inline void PrvContextsChangeBegin(void)
 {
-	size_t	n;
-	size_t	i;
-	char	c;
+	__atomic_fetch_add(&gGlobalsP->contextsSeq, 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
 
-	// the global context name is a special case
-	if (strcmp(contextName, kPmLogGlobalContextName) == 0)
+
+/*********************************************************************/
+/* PrvContextsChangeEnd */
+/**
+@brief  Closes a change opened by PrvContextsChangeBegin, which also
+		moves the contexts generation on.
+**********************************************************************/
+static inline void PrvContextsChangeEnd(void)
+{
+	__atomic_fetch_add(&gGlobalsP->contextsSeq, 1, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvContextsChanged */
+/**
+@brief  Records a change already made with a single atomic store, such
+		as a context level, without the lock: moves the seqlock on by
+		a whole change, keeping it odd if a locked change is in
+		progress, so that a snapshot taken meanwhile is retried.
+**********************************************************************/
+static inline void PrvContextsChanged(void)
+{
+	__atomic_fetch_add(&gGlobalsP->contextsSeq, 2, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvUpdateThreadPassLevelLocked */
+/**
+@brief  Recomputes gThreadPassLevel, the highest thread level of any
+		thread.  Returns true if it changed, in which case the pass
+		levels need publishing.  gPassLock must be held.
+**********************************************************************/
+static bool PrvUpdateThreadPassLevelLocked(void)
+{
+	int		passLevel;
+	int		level;
+
+	passLevel = kPmLogLevel_None;
+	for (level = kPmLogLevel_Debug; level > passLevel; level--)
 	{
-		return kPmLogErr_None;
+		if (gThreadLevelCounts[ level ] > 0)
+		{
+			passLevel = level;
+			break;
+		}
 	}
 
-	n = strlen(contextName);
-	if ((n < 1) || (n > PMLOG_MAX_CONTEXT_NAME_LEN))
+	if (passLevel == gThreadPassLevel)
 	{
-		return kPmLogErr_InvalidContextName;
+		return false;
 	}
 
-	for (i = 0; i < n; i++)
-	{
-		c = contextName[ i ];
+	__atomic_store_n(&gThreadPassLevel, passLevel, __ATOMIC_RELAXED);
+	return true;
+}
 
-		if ((c >= 'A') && (c <= 'Z'))
-			continue;
 
-		if ((c >= 'a') && (c <= 'z'))
-			continue;
+/*********************************************************************/
+/* PrvSetRecordLevel */
+/**
+@brief  Sets the flight recorder level, kPmLogLevel_None if the
+		recorder is not running.
+**********************************************************************/
+static void PrvSetRecordLevel(int level)
+{
+	__atomic_store_n(&PmLogRecordLevel_, level, __ATOMIC_RELAXED);
+}
 
-		if ((c >= '0') && (c <= '9'))
-			continue;
 
-		if ((c == '.') ||
-			(c == '-') ||
-			(c == '_'))
-			continue;
+/*********************************************************************/
+/* PrvProcessLevel */
+/**
+@brief  Returns the level of the context in this process: its override
+		if it has one, else its shared level.  Lock-free and
+		async-signal-safe.
+**********************************************************************/
+static inline int PrvProcessLevel(const PmLogContextInfo* contextP)
+{
+	uintptr_t	offset;
+	int			level;
 
-		return kPmLogErr_InvalidContextName;
+	if (PmLogLoadRelaxed_(&gProcessLevelsActive) && (gGlobalsP != NULL))
+	{
+		offset = (uintptr_t) contextP - (uintptr_t) gGlobalsP->contextInfo;
+		if (offset < sizeof(gGlobalsP->contextInfo))
+		{
+			level = __atomic_load_n(
+				&gProcessLevels[ offset / sizeof(PmLogContextInfo) ],
+				__ATOMIC_RELAXED);
+			if (level != kNoProcessLevel)
+			{
+				return level;
+			}
+		}
 	}
 
-	return kPmLogErr_None;
+	return PmLogLoadRelaxed_(&contextP->enabledLevel);
 }
 
 
 /*********************************************************************/
-/* PmLogGetNumContexts */
+/* PrvIsProcessLevelEnabled */
 /**
-@brief  Returns the number of defined contexts, including the global
-		context.
+@brief  Returns true if the level is enabled in the context for this
+		process, whatever the calling thread's level.  Lock-free, and
+		async-signal-safe as it reads no thread-local storage, which
+		may be allocated on a thread's first use of it.
+**********************************************************************/
+static inline bool PrvIsProcessLevelEnabled(const PmLogContextInfo* contextP,
+	PmLogLevel level)
+{
+	return (level <= PrvProcessLevel(contextP));
+}
 
-@return Error code:
-			kPmLogErr_None
-			kPmLogErr_InvalidParameter
+
+/*********************************************************************/
+/* PrvIsLevelEnabled */
+/**
+@brief  Returns true if the level is enabled in the context for this
+		process, or elevated on the calling thread, rather than let
+		through only for the flight recorder.  Lock-free.
 **********************************************************************/
-PmLogErr PmLogGetNumContexts(int* pNumContexts)
+static inline bool PrvIsLevelEnabled(const PmLogContextInfo* contextP,
+	PmLogLevel level)
 {
-	if (pNumContexts == NULL)
+	return PrvIsProcessLevelEnabled(contextP, level) ||
+		(level <= gElevatedLevel);
+}
+
+
+/*********************************************************************/
+/* PrvIsCaptured */
+/**
+@brief  Returns true if the message is to be held back for the calling
+		thread's backtrace: for the context being captured, and at a
+		level that is captured, but not enabled, in it.  The thread's
+		other contexts are not affected.
+**********************************************************************/
+static inline bool PrvIsCaptured(const PmLogContextInfo* contextP,
+	PmLogLevel level)
+{
+	return (gBacktraceP != NULL) && (gBacktraceP->contextP == contextP) &&
+		(level <= gBacktraceP->captureLevel) &&
+		!PrvIsLevelEnabled(contextP, level);
+}
+
+
+/*********************************************************************/
+/* PrvIsLevelPassed */
+/**
+@brief  Returns true if a message at the level is to be taken at all:
+		enabled in the context, captured by the flight recorder, or
+		held back for the calling thread's backtrace.
+**********************************************************************/
+static inline bool PrvIsLevelPassed(const PmLogContextInfo* contextP,
+	PmLogLevel level)
+{
+	return PrvIsLevelEnabled(contextP, level) ||
+		(level <= PmLogLoadRelaxed_(&PmLogRecordLevel_)) ||
+		PrvIsCaptured(contextP, level);
+}
+
+
+/*********************************************************************/
+/* PrvCountMessage */
+/**
+@brief  Counts a message for the context's statistics, if it is logged
+		at an enabled level, not just captured by the flight recorder.
+		Lock-free and async-signal-safe.
+**********************************************************************/
+static inline void PrvCountMessage(const PmLogContextInfo* contextP,
+	bool enabled)
+{
+	if (enabled)
 	{
-		return kPmLogErr_InvalidParameter;
+		(void) __atomic_fetch_add(&PrvContextMeta(contextP)->numMessages, 1,
+			__ATOMIC_RELAXED);
 	}
+}
 
-	*pNumContexts = 0;
 
-	if (gGlobalsP == NULL)
+/*********************************************************************/
+/* PrvRefreshProcessLevel */
+/**
+@brief  Sets the override of the context slot with the given index to
+		the level of the newest override that matches its name, or to
+		none.  The context globals must be locked.
+**********************************************************************/
+static void PrvRefreshProcessLevel(int index)
+{
+	const char*	contextName;
+	int			level;
+	int			i;
+
+	contextName = gGlobalsP->contextMeta[ index ].component;
+	level = kNoProcessLevel;
+
+	if ((index != 0) && (contextName[ 0 ] != 0))
 	{
-		return kPmLogErr_Unknown;
+		for (i = gNumProcessRules - 1; i >= 0; i--)
+		{
+			if (fnmatch(gProcessRules[ i ].pattern, contextName, 0) == 0)
+			{
+				level = gProcessRules[ i ].level;
+				break;
+			}
+		}
 	}
 
-	*pNumContexts = 1 + gGlobalsP->numUserContexts;
-	return kPmLogErr_None;
+	__atomic_store_n(&gProcessLevels[ index ], (int8_t) level,
+		__ATOMIC_RELAXED);
 }
 
 
 /*********************************************************************/
-/* PmLogGetIndContext */
+/* PrvRefreshProcessLevels */
 /**
-@brief  Returns the context by index where index = 0..numContexts - 1.
-
-@return Error code:
-			kPmLogErr_None
-			kPmLogErr_InvalidParameter
+@brief  Brings the override of every context slot up to date with the
+		overrides, turns them on or off, and publishes the contexts
+		whose inline checks are to be passed on to the library.
+		The context globals must be locked.
 **********************************************************************/
-PmLogErr PmLogGetIndContext(int contextIndex, PmLogContext* pContext)
+static void PrvRefreshProcessLevels(void)
 {
-	PmLogContext_*	theContextP;
+	int		index;
 
-	if (pContext != NULL)
+	for (index = 0; index <= PMLOG_MAX_NUM_CONTEXTS; index++)
 	{
-		*pContext = NULL;
+		PrvRefreshProcessLevel(index);
 	}
 
-	if ((contextIndex < 0) || (contextIndex > gGlobalsP->numUserContexts))
+	__atomic_store_n(&gProcessLevelsActive, (gNumProcessRules > 0),
+		__ATOMIC_RELEASE);
+	PrvPublishPassLevels();
+}
+
+
+/*********************************************************************/
+/* PrvReadStartTime */
+/**
+@brief  Returns the start time of the process, in clock ticks after
+		boot, as read from /proc/<pid>/stat, or 0 if it can't be read.
+		pid 0 reads this process's own.
+**********************************************************************/
+static uint64_t PrvReadStartTime(pid_t pid)
+{
+	char		path[ 32 ];
+	char		buff[ 512 ];
+	int			fd;
+	ssize_t		n;
+	const char*	p;
+	int			field;
+
+	if (pid == 0)
 	{
-		return kPmLogErr_InvalidContextIndex;
+		mystrcpy(path, sizeof(path), "/proc/self/stat");
+	}
+	else
+	{
+		mysprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
 	}
 
-	if (pContext == NULL)
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
 	{
-		return kPmLogErr_InvalidParameter;
+		return 0;
 	}
 
-	if (contextIndex == 0)
+	n = read(fd, buff, sizeof(buff) - 1);
+	close(fd);
+	if (n <= 0)
 	{
-		theContextP = &gGlobalsP->globalContext;
+		return 0;
 	}
-	else
+	buff[ n ] = 0;
+
+	// the command name in field 2 may hold anything, so count the
+	// fields from its closing parenthesis: the start time is field 22
+	p = strrchr(buff, ')');
+	for (field = 2; (p != NULL) && (field < 22); field++)
 	{
-		theContextP = &gGlobalsP->userContexts[ contextIndex - 1 ];
+		p = strchr(p + 1, ' ');
 	}
 
-	*pContext = PrvExportContext(theContextP);
-	return kPmLogErr_None;
+	return (p != NULL) ? strtoull(p + 1, NULL, 10) : 0;
 }
 
 
 /*********************************************************************/
-/* PmLogFindContext */
+/* PrvGetSelfOwner */
 /**
-@brief  Returns the logging context for the named context, or
-		NULL if the context does not exist.
+@brief  Returns this process as recorded in the owners of a context,
+		worked out again after a fork.  The context globals must be
+		locked.
+**********************************************************************/
+static const PmLogContextOwner* PrvGetSelfOwner(void)
+{
+	pid_t		pid;
+	char		link[ 32 ];
+	ssize_t		n;
+	struct stat	st;
 
-@return Error code:
-			kPmLogErr_None
-			kPmLogErr_InvalidParameter
-			kPmLogErr_InvalidContext
-			kPmLogErr_InvalidContextName
+	pid = getpid();
+	if (gSelfOwner.pid == pid)
+	{
+		return &gSelfOwner;
+	}
+
+	memset(&gSelfOwner, 0, sizeof(gSelfOwner));
+	gSelfOwner.pid = pid;
+	gSelfOwner.startTime = PrvReadStartTime(0);
+
+	// /proc may be mounted for another pid namespace, in which this
+	// process has another pid, or none; then the namespace is unknown
+	n = readlink("/proc/self", link, sizeof(link) - 1);
+	if (n > 0)
+	{
+		link[ n ] = 0;
+		if ((atoi(link) == pid) && (stat("/proc/self/ns/pid", &st) == 0))
+		{
+			gSelfOwner.pidNs = (uint64_t) st.st_ino;
+		}
+	}
+
+	return &gSelfOwner;
+}
+
+
+/*********************************************************************/
+/* PrvIsSameOwner */
+/**
+@brief  Returns true if the two owners are the same process.
 **********************************************************************/
-PmLogErr PmLogFindContext(const char* contextName, PmLogContext* pContext)
+static bool PrvIsSameOwner(const PmLogContextOwner* aP,
+	const PmLogContextOwner* bP)
 {
-	PmLogErr		logErr;
-	int				i;
-	PmLogContext_*	theContextP;
-	PmLogContext_*	contextP;
+	return
+		(aP->pid == bP->pid) &&
+		(aP->pidNs == bP->pidNs) &&
+		(aP->startTime == bP->startTime);
+}
 
-	if (pContext == NULL)
+
+/*********************************************************************/
+/* PrvClearOwner */
+/**
+@brief  Clears a recorded owner.  The pid is cleared last, as a process
+		attaching without the lock takes a free owner by its pid.
+**********************************************************************/
+static void PrvClearOwner(PmLogContextOwner* ownerP)
+{
+	__atomic_store_n(&ownerP->pidNs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ownerP->startTime, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&ownerP->pid, 0, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvDropAttached */
+/**
+@brief  Takes one process off the context's count of attached ones.
+		Only those holding the lock drop the count, so it can't go
+		below 0 between the check and the decrement.
+**********************************************************************/
+static void PrvDropAttached(PmLogContextMeta* metaP)
+{
+	if (__atomic_load_n(&metaP->numAttached, __ATOMIC_RELAXED) > 0)
 	{
-		return kPmLogErr_InvalidParameter;
+		(void) __atomic_fetch_sub(&metaP->numAttached, 1, __ATOMIC_RELAXED);
 	}
+}
 
-	*pContext = NULL;
 
-	if (gGlobalsP == NULL)
+/*********************************************************************/
+/* PrvAttachContext */
+/**
+@brief  Records that this process uses the context, if it hasn't
+		already, so that its slot is kept while the process runs.
+		The context globals should be locked, except in a forked
+		child, which attaches to contexts its parent is still attached
+		to, so can't be reclaimed meanwhile: the owner is taken and the
+		count raised atomically, so that a process holding the lock at
+		the same time loses neither.
+**********************************************************************/
+static void PrvAttachContext(PmLogContextInfo* contextP)
+{
+	size_t						index;
+	int							i;
+	pid_t						pid;
+	int32_t						freePid;
+	PmLogContextMeta*			metaP;
+	PmLogContextOwner*			ownerP;
+	const PmLogContextOwner*	selfP;
+
+	index = contextP - gGlobalsP->contextInfo;
+	if (index == 0)
 	{
-		return kPmLogErr_Unknown;
+		// the global context is never reclaimed
+		return;
 	}
 
-	if (contextName == NULL)
+	// a forked child starts unattached
+	pid = getpid();
+	if (gAttachedPid != pid)
 	{
-		return kPmLogErr_InvalidParameter;
+		memset(gAttached, 0, sizeof(gAttached));
+		gAttachedPid = pid;
 	}
 
-	logErr = PrvValidateContextName(contextName);
-	if (logErr != kPmLogErr_None)
+	if (gAttached[ index ] != kAttach_None)
 	{
-		return logErr;
+		return;
 	}
 
-	// lock the globals
-	PmLogPrvLock();
-
-	theContextP = NULL;
+	metaP = &gGlobalsP->contextMeta[ index ];
+	gAttached[ index ] = kAttach_Counted;
+	selfP = PrvGetSelfOwner();
 
-	// look for a match on the context name
-	for (i = -1; i < gGlobalsP->numUserContexts; i++)
+	for (i = 0; i < PMLOG_CONTEXT_MAX_OWNERS; i++)
 	{
-		if (i == -1)
-		{
-			contextP = &gGlobalsP->globalContext;
-		}
-		else
+		ownerP = &metaP->owners[ i ];
+		freePid = 0;
+		if (__atomic_compare_exchange_n(&ownerP->pid, &freePid, selfP->pid,
+			false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
 		{
-			contextP = &gGlobalsP->userContexts[ i ];
-		}
-
-		if (strcmp(contextName, contextP->component) == 0)
-		{
-			theContextP = contextP;
+			__atomic_store_n(&ownerP->pidNs, selfP->pidNs, __ATOMIC_RELAXED);
+			__atomic_store_n(&ownerP->startTime, selfP->startTime,
+				__ATOMIC_RELAXED);
+			gAttached[ index ] = kAttach_Owner;
 			break;
 		}
 	}
 
-	// release the globals lock
-	PmLogPrvUnlock();
-
-	if (theContextP != NULL)
-	{
-		*pContext = PrvExportContext(theContextP);
-		return kPmLogErr_None;
-	}
-
-	return kPmLogErr_ContextNotFound;
+	(void) __atomic_fetch_add(&metaP->numAttached, 1, __ATOMIC_RELAXED);
 }
 
 
 /*********************************************************************/
-/* PrvGetContextDefaults */
+/* PrvDetachContexts */
 /**
-@brief  Look up the default settings for the context.  If the
-		component is part of a hierarchy, search up the ancestor
-		chain and use the settings of the first ancestor found.
-		Otherwise, use the settings from the global context.
+@brief  Detaches this process from all the contexts it got, as it
+		exits.  The context globals must be locked.
 **********************************************************************/
-static const PmLogContextInfo* PrvGetContextDefaults(const char* contextName)
+static void PrvDetachContexts(void)
 {
-	// Note: this function is called only by PmLogGetContext when
-	// the context globals are locked.
-
-	int						i;
-	const PmLogContext_*	contextP;
-	char					parent[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
-	char*					s;
+	size_t				index;
+	int					i;
+	PmLogContextMeta*	metaP;
 
-	// copy the context name to a scratch buffer
-	mystrcpy(parent, sizeof(parent), contextName);
+	if (gAttachedPid != getpid())
+	{
+		return;
+	}
 
-	for (;;)
+	for (index = 1; index < sizeof(gAttached); index++)
 	{
-		// if there is no 'parent' path, we're done
-		s = strrchr(parent, '.');
-		if (s == NULL)
+		if (gAttached[ index ] == kAttach_None)
 		{
-			break;
+			continue;
 		}
 
-		// else trim off the child name to get the parent
-		*s = 0;
+		metaP = &gGlobalsP->contextMeta[ index ];
 
-		// if a registered context matches the parent path,
-		// use its level as the default for the child
-		for (i = 0; i < gGlobalsP->numUserContexts; i++)
+		if (gAttached[ index ] == kAttach_Owner)
 		{
-			contextP = &gGlobalsP->userContexts[ i ];
-			if (strcmp(parent, contextP->component) == 0)
+			for (i = 0; i < PMLOG_CONTEXT_MAX_OWNERS; i++)
 			{
-				return &contextP->info;
+				if (PrvIsSameOwner(&metaP->owners[ i ], PrvGetSelfOwner()))
+				{
+					PrvClearOwner(&metaP->owners[ i ]);
+					break;
+				}
 			}
 		}
-	}
 
-	// otherwise use the global level as the default
-	return &gGlobalContextP->info;
+		PrvDropAttached(metaP);
+		gAttached[ index ] = kAttach_None;
+	}
 }
 
 
 /*********************************************************************/
-/* PmLogGetContext */
+/* PrvIsOwnerAlive */
 /**
-@brief  Returns/creates the logging context for the named context.
+@brief  Returns true unless the owner is known to have exited, or its
+		pid to have been reused.  An owner in another pid namespace,
+		or an unknown one, can't be checked, so is taken to be alive.
+		This makes system calls, so is called without the lock, on a
+		copy of the owner (see PrvProbeOwners).
+**********************************************************************/
+static bool PrvIsOwnerAlive(const PmLogContextOwner* ownerP)
+{
+	const PmLogContextOwner*	selfP;
+	uint64_t					startTime;
 
-		If contextName is NULL, returns the global context.
+	selfP = PrvGetSelfOwner();
+	if ((ownerP->pidNs == 0) || (ownerP->pidNs != selfP->pidNs))
+	{
+		return true;
+	}
 
-		Context names must be 1..31 characters long, and each
-		character must be one of A-Z, a-z, 0-9, '_', '-', '.'.
+	if ((kill(ownerP->pid, 0) != 0) && (errno == ESRCH))
+	{
+		return false;
+	}
 
-		Component hierarchies can be indicated using '.' as the path
-		separator.
-		E.g. "FOO.BAR" would indicate the "BAR" subcomponent
-		of the "FOO" component.
+	// the pid is in use, but maybe by a later process
+	if (ownerP->startTime == 0)
+	{
+		return true;
+	}
 
-@return Error code:
-			kPmLogErr_None
-			kPmLogErr_InvalidParameter
-			kPmLogErr_InvalidContext
-			kPmLogErr_InvalidContextName
+	startTime = PrvReadStartTime(ownerP->pid);
+	return (startTime == 0) || (startTime == ownerP->startTime);
+}
+
+
+/*********************************************************************/
+/* PrvProbeOwner */
+/**
+@brief  Adds the owner to the probed ones, with whether it is alive,
+		unless it is free, this process, or already probed.  Once the
+		list is full, the owners left out are taken to be alive.
+		Lock-free: the owner is copied field by field, and a copy torn
+		by a concurrent change matches no recorded owner later.
 **********************************************************************/
-PmLogErr PmLogGetContext(const char* contextName, PmLogContext* pContext)
+static void PrvProbeOwner(PrvProbedOwners* probedP,
+	const PmLogContextOwner* ownerP)
 {
-	PmLogErr				logErr;
-	int						i;
-	PmLogContext_*			theContextP;
-	PmLogContext_*			contextP;
-	const PmLogContextInfo*	defaultsP;
+	PmLogContextOwner	owner;
+	int					i;
 
-	if (pContext == NULL)
+	memset(&owner, 0, sizeof(owner));
+	owner.pid = __atomic_load_n(&ownerP->pid, __ATOMIC_ACQUIRE);
+	owner.pidNs = __atomic_load_n(&ownerP->pidNs, __ATOMIC_RELAXED);
+	owner.startTime = __atomic_load_n(&ownerP->startTime, __ATOMIC_RELAXED);
+
+	if ((owner.pid == 0) || PrvIsSameOwner(&owner, PrvGetSelfOwner()))
 	{
-		return kPmLogErr_InvalidParameter;
+		return;
 	}
 
-	*pContext = NULL;
-
-	if (gGlobalsP == NULL)
+	for (i = 0; i < probedP->numOwners; i++)
 	{
-		return kPmLogErr_Unknown;
+		if (PrvIsSameOwner(&probedP->owners[ i ], &owner))
+		{
+			return;
+		}
 	}
 
-	if (contextName == NULL)
+	if (probedP->numOwners >= kMaxProbedOwners)
 	{
-		*pContext = PrvExportContext(gGlobalContextP);
-		return kPmLogErr_None;
+		return;
 	}
 
-	logErr = PrvValidateContextName(contextName);
-	if (logErr != kPmLogErr_None)
+	probedP->owners[ probedP->numOwners ] = owner;
+	probedP->alive[ probedP->numOwners ] = PrvIsOwnerAlive(&owner);
+	probedP->numOwners++;
+}
+
+
+/*********************************************************************/
+/* PrvProbeOwners */
+/**
+@brief  Probes whether the owners of the pass entries are alive, and
+		those of the reclaimable contexts too if withContexts, so that
+		the system calls are made without the lock.  Whoever then takes
+		the lock drops only the owners found dead that are still
+		recorded as they were probed (see PrvIsOwnerDead).
+**********************************************************************/
+static void PrvProbeOwners(PrvProbedOwners* probedP, bool withContexts)
+{
+	int					index;
+	int					numContexts;
+	int					i;
+	PmLogContextMeta*	metaP;
+
+	probedP->numOwners = 0;
+
+	for (i = 0; i < PMLOG_MAX_PASS_PROCESSES; i++)
 	{
-		return logErr;
+		PrvProbeOwner(probedP, &gGlobalsP->passEntries[ i ].owner);
 	}
 
-	// lock the globals
-	PmLogPrvLock();
-
-	theContextP = NULL;
-	logErr = kPmLogErr_None;
+	if (!withContexts)
+	{
+		return;
+	}
 
-	// look for a match on the context name
-	for (i = -1; i < gGlobalsP->numUserContexts; i++)
+	numContexts = __atomic_load_n(&gGlobalsP->numUserContexts,
+		__ATOMIC_ACQUIRE);
+	for (index = 1; index <= numContexts; index++)
 	{
-		if (i == -1)
+		metaP = &gGlobalsP->contextMeta[ index ];
+		if (__atomic_load_n(&metaP->pinned, __ATOMIC_RELAXED))
 		{
-			contextP = &gGlobalsP->globalContext;
+			continue;
 		}
-		else
+
+		for (i = 0; i < PMLOG_CONTEXT_MAX_OWNERS; i++)
 		{
-			contextP = &gGlobalsP->userContexts[ i ];
+			PrvProbeOwner(probedP, &metaP->owners[ i ]);
 		}
+	}
+}
 
-		if (strcmp(contextName, contextP->component) == 0)
+
+/*********************************************************************/
+/* PrvIsOwnerDead */
+/**
+@brief  Returns true if the recorded owner was probed and found dead.
+		The context globals must be locked.
+**********************************************************************/
+static bool PrvIsOwnerDead(const PrvProbedOwners* probedP,
+	const PmLogContextOwner* ownerP)
+{
+	int		i;
+
+	if (ownerP->pid == 0)
+	{
+		return false;
+	}
+
+	for (i = 0; i < probedP->numOwners; i++)
+	{
+		if (!probedP->alive[ i ] &&
+			PrvIsSameOwner(&probedP->owners[ i ], ownerP))
 		{
-			//DbgPrint("found context %s\n", contextName);
-			theContextP = contextP;
-			break;
+			return true;
 		}
 	}
 
-	// if context not found, add it
-	if (theContextP == NULL)
+	return false;
+}
+
+
+/*********************************************************************/
+/* PrvContextPassLevel */
+/**
+@brief  Returns the pass level of the context slot with the given
+		index: the highest level any process checks in the library for
+		it, or the pass floor.  The context globals must be locked.
+**********************************************************************/
+static int PrvContextPassLevel(int index)
+{
+	int					passLevel;
+	int					i;
+	PmLogPassEntry*		entryP;
+
+	passLevel = __atomic_load_n(&gGlobalsP->passFloor, __ATOMIC_RELAXED);
+
+	for (i = 0; i < PMLOG_MAX_PASS_PROCESSES; i++)
 	{
-		if (gGlobalsP->numUserContexts >= gGlobalsP->maxUserContexts)
+		entryP = &gGlobalsP->passEntries[ i ];
+		if (__atomic_load_n(&entryP->ready, __ATOMIC_ACQUIRE) &&
+			(entryP->passLevels[ index ] > passLevel))
 		{
-			DbgPrint("no more contexts available\n");
-			logErr = kPmLogErr_TooManyContexts;
+			passLevel = entryP->passLevels[ index ];
 		}
-		else
-		{
-			DbgPrint("adding context %s\n", contextName);
-			theContextP = &gGlobalsP->userContexts[ gGlobalsP->numUserContexts ];
-			gGlobalsP->numUserContexts++;
+	}
 
-			mystrcpy(theContextP->component, sizeof(theContextP->component),
-				contextName);
+	return passLevel;
+}
 
-			defaultsP = PrvGetContextDefaults(contextName);
 
-			theContextP->info.enabledLevel = defaultsP->enabledLevel;
-			theContextP->info.flags = defaultsP->flags;
+/*********************************************************************/
+/* PrvRefreshCheckLevels */
+/**
+@brief  Brings the pass level in every context's checkLevels up to
+		date.  The context globals must be locked.
+**********************************************************************/
+static void PrvRefreshCheckLevels(void)
+{
+	int		index;
+
+	for (index = 0; index <= gGlobalsP->numUserContexts; index++)
+	{
+		PrvStoreCheckLevels(&gGlobalsP->contextInfo[ index ],
+			PrvContextPassLevel(index));
+	}
+}
+
+
+/*********************************************************************/
+/* PrvRaisePassFloor */
+/**
+@brief  Raises the pass floor to at least the given level.  Returns
+		true if it was raised, in which case the contexts' pass levels
+		need refreshing.  Lock-free.
+**********************************************************************/
+static bool PrvRaisePassFloor(int level)
+{
+	int		floor;
+
+	floor = __atomic_load_n(&gGlobalsP->passFloor, __ATOMIC_RELAXED);
+	while (level > floor)
+	{
+		if (__atomic_compare_exchange_n(&gGlobalsP->passFloor, &floor,
+			level, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		{
+			return true;
 		}
 	}
 
-	// release the globals lock
-	PmLogPrvUnlock();
+	return false;
+}
 
-	if (theContextP != NULL)
+
+/*********************************************************************/
+/* PrvProcessPassLevel */
+/**
+@brief  Returns the levels of the context slot with the given index
+		that this process checks in the library whatever the context's
+		level: all of them if it has an override, else those up to the
+		highest level of its threads.
+**********************************************************************/
+static int PrvProcessPassLevel(int index)
+{
+	if (PmLogLoadRelaxed_(&gProcessLevelsActive) &&
+		(__atomic_load_n(&gProcessLevels[ index ], __ATOMIC_RELAXED) !=
+			kNoProcessLevel))
 	{
-		*pContext = PrvExportContext(theContextP);
-		return kPmLogErr_None;
+		return kPmLogLevel_Debug;
 	}
 
-	// in case of error, return the global context pointer
-	*pContext = PrvExportContext(gGlobalContextP);
-	return logErr;
+	return PmLogLoadRelaxed_(&gThreadPassLevel);
 }
 
 
 /*********************************************************************/
-/* PmLogGetContextInline */
+/* PrvOwnPassEntry */
 /**
-@brief  Returns the logging context for the named context.
+@brief  Returns this process's entry in the pass entries, or NULL if it
+		has none.  A forked child has none until it takes its own.
 **********************************************************************/
-PmLogContext PmLogGetContextInline(const char* contextName)
+static PmLogPassEntry* PrvOwnPassEntry(void)
 {
-	PmLogErr		logErr;
-	PmLogContext	context;
+	if ((gPassEntry < 0) || (gPassEntryPid != getpid()))
+	{
+		return NULL;
+	}
 
-	context = NULL;
-	logErr = PmLogGetContext(contextName, &context);
-	if (logErr == kPmLogErr_None)
+	return &gGlobalsP->passEntries[ gPassEntry ];
+}
+
+
+/*********************************************************************/
+/* PrvTakePassEntry */
+/**
+@brief  Takes a free entry in the pass entries for this process, not
+		yet ready, or returns NULL if there is none.  As for attaching
+		to a context, the entry is taken by its pid, so this is safe
+		without the lock.
+**********************************************************************/
+static PmLogPassEntry* PrvTakePassEntry(void)
+{
+	int							i;
+	int32_t						freePid;
+	PmLogPassEntry*				entryP;
+	const PmLogContextOwner*	selfP;
+
+	selfP = PrvGetSelfOwner();
+
+	for (i = 0; i < PMLOG_MAX_PASS_PROCESSES; i++)
+	{
+		entryP = &gGlobalsP->passEntries[ i ];
+		freePid = 0;
+		if (__atomic_compare_exchange_n(&entryP->owner.pid, &freePid,
+			selfP->pid, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		{
+			__atomic_store_n(&entryP->owner.pidNs, selfP->pidNs,
+				__ATOMIC_RELAXED);
+			__atomic_store_n(&entryP->owner.startTime, selfP->startTime,
+				__ATOMIC_RELAXED);
+			gPassEntry = i;
+			gPassEntryPid = getpid();
+			return entryP;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*********************************************************************/
+/* PrvPrunePassEntries */
+/**
+@brief  Frees the pass entries of the processes found dead by
+		PrvProbeOwners, which exited without freeing them.  Returns
+		true if any was freed.  The context globals must be locked.
+**********************************************************************/
+static bool PrvPrunePassEntries(const PrvProbedOwners* probedP)
+{
+	int					i;
+	bool				pruned;
+	PmLogPassEntry*		entryP;
+
+	pruned = false;
+
+	for (i = 0; i < PMLOG_MAX_PASS_PROCESSES; i++)
+	{
+		entryP = &gGlobalsP->passEntries[ i ];
+		if ((entryP != PrvOwnPassEntry()) &&
+			PrvIsOwnerDead(probedP, &entryP->owner))
+		{
+			__atomic_store_n(&entryP->ready, 0, __ATOMIC_RELAXED);
+			PrvClearOwner(&entryP->owner);
+			pruned = true;
+		}
+	}
+
+	return pruned;
+}
+
+
+/*********************************************************************/
+/* PrvReleasePassEntry */
+/**
+@brief  Frees this process's pass entry, if it has one.  Returns true
+		if it had, in which case the contexts' pass levels need
+		refreshing.  The context globals must be locked.
+**********************************************************************/
+static bool PrvReleasePassEntry(void)
+{
+	PmLogPassEntry*		entryP;
+
+	entryP = PrvOwnPassEntry();
+	if (entryP == NULL)
+	{
+		return false;
+	}
+
+	__atomic_store_n(&entryP->ready, 0, __ATOMIC_RELAXED);
+	PrvClearOwner(&entryP->owner);
+	gPassEntry = -1;
+
+	return true;
+}
+
+
+/*********************************************************************/
+/* PrvFillPassEntry */
+/**
+@brief  Sets the levels of this process's pass entry and marks it
+		ready, taking one if it has none.  If there is no free entry,
+		the pass floor is raised to the highest of them instead, for
+		good.  Returns false if nothing changed.
+**********************************************************************/
+static bool PrvFillPassEntry(const int8_t* passLevels)
+{
+	int					index;
+	int					maxLevel;
+	PmLogPassEntry*		entryP;
+
+	entryP = PrvOwnPassEntry();
+	if ((entryP != NULL) &&
+		__atomic_load_n(&entryP->ready, __ATOMIC_RELAXED) &&
+		(memcmp(entryP->passLevels, passLevels,
+			sizeof(entryP->passLevels)) == 0))
+	{
+		return false;
+	}
+
+	if (entryP == NULL)
+	{
+		entryP = PrvTakePassEntry();
+	}
+
+	if (entryP == NULL)
+	{
+		maxLevel = kPmLogLevel_None;
+		for (index = 0; index <= PMLOG_MAX_NUM_CONTEXTS; index++)
+		{
+			if (passLevels[ index ] > maxLevel)
+			{
+				maxLevel = passLevels[ index ];
+			}
+		}
+
+		ErrPrint("no free pass entry, raising the pass floor to %d\n",
+			maxLevel);
+		return PrvRaisePassFloor(maxLevel);
+	}
+
+	memcpy(entryP->passLevels, passLevels, sizeof(entryP->passLevels));
+	__atomic_store_n(&entryP->ready, 1, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+/*********************************************************************/
+/* PrvPublishPassLevels */
+/**
+@brief  Records the levels this process checks in the library whatever
+		the context levels in its pass entry, freeing it if there are
+		none, and brings the contexts' pass levels up to date.  The
+		context globals must be locked.  If the entries are full, the
+		lock is dropped while their owners are probed, then the levels
+		are read again.
+**********************************************************************/
+static void PrvPublishPassLevels(void)
+{
+	int8_t				passLevels[ 1 + PMLOG_MAX_NUM_CONTEXTS ];
+	int					index;
+	bool				any;
+	bool				changed;
+	bool				probed;
+	PrvProbedOwners		probedOwners;
+
+	probed = false;
+
+Retry:
+	any = false;
+	for (index = 0; index <= PMLOG_MAX_NUM_CONTEXTS; index++)
+	{
+		passLevels[ index ] = (int8_t) PrvProcessPassLevel(index);
+		if (passLevels[ index ] != kPmLogLevel_None)
+		{
+			any = true;
+		}
+	}
+
+	if (!any)
+	{
+		changed = PrvReleasePassEntry();
+	}
+	else
+	{
+		// make room for it first if the entries are full
+		if ((PrvOwnPassEntry() == NULL) && (PrvTakePassEntry() == NULL) &&
+			!probed)
+		{
+			PmLogPrvUnlock();
+			PrvProbeOwners(&probedOwners, false);
+			PmLogPrvLock();
+
+			probed = true;
+			if (PrvPrunePassEntries(&probedOwners))
+			{
+				PrvRefreshCheckLevels();
+			}
+			goto Retry;
+		}
+
+		changed = PrvFillPassEntry(passLevels);
+	}
+
+	if (changed)
+	{
+		PrvRefreshCheckLevels();
+	}
+}
+
+
+/*********************************************************************/
+/* PrvForkPassEntry */
+/**
+@brief  Gives a forked child with overrides a pass entry of its own,
+		without the lock, as for attaching to its contexts.  The
+		parent's entry covers the same contexts meanwhile, so their
+		pass levels need no refreshing until the parent frees it.
+**********************************************************************/
+static void PrvForkPassEntry(void)
+{
+	int8_t		passLevels[ 1 + PMLOG_MAX_NUM_CONTEXTS ];
+	int			index;
+
+	if (!PmLogLoadRelaxed_(&gProcessLevelsActive))
+	{
+		return;
+	}
+
+	for (index = 0; index <= PMLOG_MAX_NUM_CONTEXTS; index++)
+	{
+		passLevels[ index ] = (int8_t) PrvProcessPassLevel(index);
+	}
+
+	(void) PrvFillPassEntry(passLevels);
+}
+
+
+/*********************************************************************/
+/* PrvReclaimContexts */
+/**
+@brief  Drops the recorded owners and pass entries of the processes
+		found dead by PrvProbeOwners, and frees the slots of the
+		unpinned contexts left with no attached process.
+		Returns the number freed.  The context globals must be locked.
+**********************************************************************/
+static int PrvReclaimContexts(const PrvProbedOwners* probedP)
+{
+	int					index;
+	int					i;
+	int					numReclaimed;
+	PmLogContextInfo*	contextP;
+	PmLogContextMeta*	metaP;
+
+	numReclaimed = 0;
+
+	// what the exited processes passed on to the library goes too
+	if (PrvPrunePassEntries(probedP))
+	{
+		PrvRefreshCheckLevels();
+	}
+
+	for (index = 1; index <= gGlobalsP->numUserContexts; index++)
+	{
+		contextP = &gGlobalsP->contextInfo[ index ];
+		metaP = &gGlobalsP->contextMeta[ index ];
+
+		if ((metaP->component[ 0 ] == 0) || metaP->pinned)
+		{
+			continue;
+		}
+
+		for (i = 0; i < PMLOG_CONTEXT_MAX_OWNERS; i++)
+		{
+			if (PrvIsOwnerDead(probedP, &metaP->owners[ i ]))
+			{
+				PrvClearOwner(&metaP->owners[ i ]);
+				PrvDropAttached(metaP);
+			}
+		}
+
+		if (__atomic_load_n(&metaP->numAttached, __ATOMIC_RELAXED) > 0)
+		{
+			continue;
+		}
+
+		DbgPrint("reclaiming context %s\n", metaP->component);
+
+		if (numReclaimed == 0)
+		{
+			PrvContextsChangeBegin();
+		}
+
+		// stale handles see nothing enabled, and are refused by the
+		// library as the generation no longer matches the one got
+		PrvStoreContextLevel(contextP, kPmLogLevel_None);
+		__atomic_store_n(&contextP->flags, 0, __ATOMIC_RELAXED);
+		metaP->component[ 0 ] = 0;
+		metaP->facility = 0;
+		__atomic_store_n(&metaP->numMessages, 0, __ATOMIC_RELAXED);
+		__atomic_store_n(&metaP->generation, metaP->generation + 1,
+			__ATOMIC_RELAXED);
+		PrvRefreshProcessLevel(index);
+
+		numReclaimed++;
+	}
+
+	if (numReclaimed > 0)
+	{
+		PrvContextsChangeEnd();
+	}
+
+	return numReclaimed;
+}
+
+
+/*********************************************************************/
+/* PrvFindFreeContext */
+/**
+@brief  Returns the index of a free context slot: the first reclaimed
+		one, else the next never used, or 0 if the table is full.
+		The context globals must be locked.
+**********************************************************************/
+static int PrvFindFreeContext(void)
+{
+	int		index;
+
+	for (index = 1; index <= gGlobalsP->numUserContexts; index++)
+	{
+		if (gGlobalsP->contextMeta[ index ].component[ 0 ] == 0)
+		{
+			return index;
+		}
+	}
+
+	if (gGlobalsP->numUserContexts < gGlobalsP->maxUserContexts)
+	{
+		return gGlobalsP->numUserContexts + 1;
+	}
+
+	return 0;
+}
+
+
+/*********************************************************************/
+/* PrvValidateContextName */
+/**
+@brief  Returns true if and only if the given string is a valid
+		context name, i.e. meets the requirements for length
+		and valid characters.
+**********************************************************************/
+static PmLogErr PrvValidateContextName(const char* contextName)
+{
+	size_t	n;
+	size_t	i;
+	char	c;
+
+	// the global context name is a special case
+	if (strcmp(contextName, kPmLogGlobalContextName) == 0)
+	{
+		return kPmLogErr_None;
+	}
+
+	n = strlen(contextName);
+	if ((n < 1) || (n > PMLOG_MAX_CONTEXT_NAME_LEN))
+	{
+		return kPmLogErr_InvalidContextName;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		c = contextName[ i ];
+
+		if ((c >= 'A') && (c <= 'Z'))
+			continue;
+
+		if ((c >= 'a') && (c <= 'z'))
+			continue;
+
+		if ((c >= '0') && (c <= '9'))
+			continue;
+
+		if ((c == '.') ||
+			(c == '-') ||
+			(c == '_'))
+			continue;
+
+		return kPmLogErr_InvalidContextName;
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvValidateLevelPattern */
+/**
+@brief  Returns kPmLogErr_None if the given string is a valid pattern
+		for PmLogSetContextLevels: as for a context name, but also
+		allowing the glob characters '*', '?', '[', ']' and '!'.
+**********************************************************************/
+static PmLogErr PrvValidateLevelPattern(const char* pattern)
+{
+	size_t	n;
+	size_t	i;
+	char	c;
+
+	n = strlen(pattern);
+	if ((n < 1) || (n > PMLOG_MAX_CONTEXT_NAME_LEN))
+	{
+		return kPmLogErr_InvalidContextName;
+	}
+
+	for (i = 0; i < n; i++)
+	{
+		c = pattern[ i ];
+
+		if (isalnum((unsigned char) c))
+			continue;
+
+		if (strchr(".-_*?[]!", c) != NULL)
+			continue;
+
+		return kPmLogErr_InvalidContextName;
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvFindLevelRule */
+/**
+@brief  Returns the newest level rule that matches the context name,
+		or NULL if none does.  The context globals must be locked.
+**********************************************************************/
+static const PmLogLevelRule* PrvFindLevelRule(const char* contextName)
+{
+	int						i;
+	const PmLogLevelRule*	ruleP;
+
+	for (i = gGlobalsP->numLevelRules - 1; i >= 0; i--)
+	{
+		ruleP = &gGlobalsP->levelRules[ i ];
+		if (fnmatch(ruleP->pattern, contextName, 0) == 0)
+		{
+			return ruleP;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*********************************************************************/
+/* PmLogGetNumContexts */
+/**
+@brief  Returns the number of defined contexts, including the global
+		context.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetNumContexts(int* pNumContexts)
+{
+	if (pNumContexts == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	*pNumContexts = 0;
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	*pNumContexts = 1 + __atomic_load_n(&gGlobalsP->numUserContexts,
+		__ATOMIC_ACQUIRE);
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogGetIndContext */
+/**
+@brief  Returns the context by index where index = 0..numContexts - 1.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetIndContext(int contextIndex, PmLogContext* pContext)
+{
+	PmLogContextInfo*	theContextP;
+
+	if (pContext != NULL)
+	{
+		*pContext = NULL;
+	}
+
+	if ((contextIndex < 0) || (contextIndex >
+		__atomic_load_n(&gGlobalsP->numUserContexts, __ATOMIC_ACQUIRE)))
+	{
+		return kPmLogErr_InvalidContextIndex;
+	}
+
+	if (pContext == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	theContextP = &gGlobalsP->contextInfo[ contextIndex ];
+
+	// the slot is kept while this process runs, as for PmLogGetContext
+	PmLogPrvLock();
+
+	if (PrvContextName(theContextP)[ 0 ] == 0)
+	{
+		PmLogPrvUnlock();
+		return kPmLogErr_ContextNotFound;
+	}
+
+	PrvAttachContext(theContextP);
+	PrvRefreshProcessLevel(contextIndex);
+	PrvPublishPassLevels();
+
+	PmLogPrvUnlock();
+
+	*pContext = PrvHandOutContext(theContextP);
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvCopyContexts */
+/**
+@brief  Copies up to maxEntries contexts into entries, and returns how
+		many there are.
+**********************************************************************/
+static int PrvCopyContexts(PmLogContextSnapshot* entries, int maxEntries)
+{
+	int						numSlots;
+	int						numContexts;
+	int						i;
+	PmLogContextSnapshot*	entryP;
+	const PmLogContextInfo*	contextP;
+	const PmLogContextMeta*	metaP;
+
+	numSlots = 1 + __atomic_load_n(&gGlobalsP->numUserContexts,
+		__ATOMIC_RELAXED);
+	if (numSlots > 1 + PMLOG_MAX_NUM_CONTEXTS)
+	{
+		numSlots = 1 + PMLOG_MAX_NUM_CONTEXTS;
+	}
+
+	numContexts = 0;
+	for (i = 0; i < numSlots; i++)
+	{
+		contextP = &gGlobalsP->contextInfo[ i ];
+		metaP = &gGlobalsP->contextMeta[ i ];
+
+		// skip reclaimed slots
+		if (metaP->component[ 0 ] == 0)
+		{
+			continue;
+		}
+
+		if (numContexts < maxEntries)
+		{
+			entryP = &entries[ numContexts ];
+
+			memcpy(entryP->name, metaP->component, sizeof(entryP->name));
+			entryP->name[ sizeof(entryP->name) - 1 ] = 0;
+			entryP->level = PmLogLoadRelaxed_(&contextP->enabledLevel);
+			entryP->flags = PmLogLoadRelaxed_(&contextP->flags);
+			entryP->facility = metaP->facility;
+			entryP->numAttached = __atomic_load_n(&metaP->numAttached,
+				__ATOMIC_RELAXED);
+			entryP->numMessages = __atomic_load_n(&metaP->numMessages,
+				__ATOMIC_RELAXED);
+		}
+
+		numContexts++;
+	}
+
+	return numContexts;
+}
+
+
+// attempts at a lock-free snapshot before taking the lock instead
+#define PMLOG_SNAPSHOT_MAX_TRIES	64
+
+
+/*********************************************************************/
+/* PmLogGetContextsSnapshot */
+/**
+@brief  Copies every context into entries, retrying until the copy is
+		taken with no change in progress and none made meanwhile.
+		After PMLOG_SNAPSHOT_MAX_TRIES, the copy is taken under the
+		lock instead, which also closes a change left open by a
+		process that died during it.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_BufferTooSmall
+**********************************************************************/
+PmLogErr PmLogGetContextsSnapshot(PmLogContextSnapshot* entries,
+	int maxEntries, int* numEntriesP, uint32_t* generationP)
+{
+	uint32_t	seq;
+	int			numContexts;
+	int			tries;
+	bool		done;
+
+	if (numEntriesP == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	*numEntriesP = 0;
+
+	if ((maxEntries < 0) || ((entries == NULL) && (maxEntries > 0)))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	numContexts = 0;
+	done = false;
+	for (tries = 0; !done && (tries < PMLOG_SNAPSHOT_MAX_TRIES); tries++)
+	{
+		seq = __atomic_load_n(&gGlobalsP->contextsSeq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+		{
+			// a change is in progress; it is short, so wait it out
+			sched_yield();
+			continue;
+		}
+
+		numContexts = PrvCopyContexts(entries, maxEntries);
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		done = (__atomic_load_n(&gGlobalsP->contextsSeq,
+			__ATOMIC_RELAXED) == seq);
+	}
+
+	if (!done)
+	{
+		// no change can be in progress while we hold the lock, so an
+		// odd sequence was left by a writer that died part way
+		PmLogPrvLock();
+
+		seq = __atomic_load_n(&gGlobalsP->contextsSeq, __ATOMIC_RELAXED);
+		if (seq & 1)
+		{
+			PrvContextsChangeEnd();
+			seq++;
+		}
+
+		// a level set without the lock during the copy moves the
+		// generation on past seq, so it is still not missed
+		numContexts = PrvCopyContexts(entries, maxEntries);
+
+		PmLogPrvUnlock();
+	}
+
+	*numEntriesP = numContexts;
+
+	if (generationP != NULL)
+	{
+		*generationP = seq >> 1;
+	}
+
+	return (numContexts > maxEntries) ? kPmLogErr_BufferTooSmall :
+		kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContextsGeneration */
+/**
+@brief  Returns the current contexts generation.  While a change is
+		in progress this is still the generation before it.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetContextsGeneration(uint32_t* generationP)
+{
+	if (generationP == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	if (gGlobalsP == NULL)
+	{
+		*generationP = 0;
+		return kPmLogErr_Unknown;
+	}
+
+	*generationP = __atomic_load_n(&gGlobalsP->contextsSeq,
+		__ATOMIC_ACQUIRE) >> 1;
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogReclaimContexts */
+/**
+@brief  Frees the slots of the contexts that no running process has
+		got, other than those pinned by PmLogSetContextPinned.
+
+@return Error code:
+			kPmLogErr_None
+**********************************************************************/
+PmLogErr PmLogReclaimContexts(int* numReclaimedP)
+{
+	int					numReclaimed;
+	PrvProbedOwners		probedOwners;
+
+	if (numReclaimedP != NULL)
+	{
+		*numReclaimedP = 0;
+	}
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	PrvProbeOwners(&probedOwners, true);
+
+	// lock the globals
+	PmLogPrvLock();
+
+	numReclaimed = PrvReclaimContexts(&probedOwners);
+
+	// release the globals lock
+	PmLogPrvUnlock();
+
+	if (numReclaimedP != NULL)
+	{
+		*numReclaimedP = numReclaimed;
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogFindContext */
+/**
+@brief  Returns the logging context for the named context, or
+		NULL if the context does not exist.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidContextName
+**********************************************************************/
+PmLogErr PmLogFindContext(const char* contextName, PmLogContext* pContext)
+{
+	PmLogErr			logErr;
+	int					i;
+	PmLogContextInfo*	theContextP;
+	PmLogContextInfo*	contextP;
+
+	if (pContext == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	*pContext = NULL;
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	if (contextName == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	logErr = PrvValidateContextName(contextName);
+	if (logErr != kPmLogErr_None)
+	{
+		return logErr;
+	}
+
+	// lock the globals
+	PmLogPrvLock();
+
+	theContextP = NULL;
+
+	// look for a match on the context name
+	for (i = 0; i <= gGlobalsP->numUserContexts; i++)
+	{
+		contextP = &gGlobalsP->contextInfo[ i ];
+
+		if (strcmp(contextName, PrvContextName(contextP)) == 0)
+		{
+			theContextP = contextP;
+			PrvAttachContext(theContextP);
+			PrvRefreshProcessLevel(i);
+			PrvPublishPassLevels();
+			break;
+		}
+	}
+
+	// release the globals lock
+	PmLogPrvUnlock();
+
+	if (theContextP != NULL)
+	{
+		*pContext = PrvHandOutContext(theContextP);
+		return kPmLogErr_None;
+	}
+
+	return kPmLogErr_ContextNotFound;
+}
+
+
+/*********************************************************************/
+/* PrvGetContextDefaults */
+/**
+@brief  Look up the default settings for the context.  If the
+		component is part of a hierarchy, search up the ancestor
+		chain and use the settings of the first ancestor found.
+		Otherwise, use the settings from the global context.
+**********************************************************************/
+static const PmLogContextInfo* PrvGetContextDefaults(const char* contextName)
+{
+	// Note: this function is called only by PmLogGetContext when
+	// the context globals are locked.
+
+	int						i;
+	const PmLogContextInfo*	contextP;
+	char					parent[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
+	char*					s;
+
+	// copy the context name to a scratch buffer
+	mystrcpy(parent, sizeof(parent), contextName);
+
+	for (;;)
+	{
+		// if there is no 'parent' path, we're done
+		s = strrchr(parent, '.');
+		if (s == NULL)
+		{
+			break;
+		}
+
+		// else trim off the child name to get the parent
+		*s = 0;
+
+		// if a registered context matches the parent path,
+		// use its level as the default for the child
+		for (i = 1; i <= gGlobalsP->numUserContexts; i++)
+		{
+			contextP = &gGlobalsP->contextInfo[ i ];
+			if (strcmp(parent, PrvContextName(contextP)) == 0)
+			{
+				return contextP;
+			}
+		}
+	}
+
+	// otherwise use the global level as the default
+	return gGlobalContextP;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContext */
+/**
+@brief  Returns/creates the logging context for the named context.
+
+		If contextName is NULL, returns the global context.
+
+		Context names must be 1..31 characters long, and each
+		character must be one of A-Z, a-z, 0-9, '_', '-', '.'.
+
+		Component hierarchies can be indicated using '.' as the path
+		separator.
+		E.g. "FOO.BAR" would indicate the "BAR" subcomponent
+		of the "FOO" component.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidContextName
+**********************************************************************/
+PmLogErr PmLogGetContext(const char* contextName, PmLogContext* pContext)
+{
+	PmLogErr				logErr;
+	int						i;
+	int						index;
+	PmLogContextInfo*		theContextP;
+	PmLogContextInfo*		contextP;
+	const PmLogContextInfo*	defaultsP;
+	const PmLogLevelRule*	ruleP;
+	PmLogContextMeta*		metaP;
+	bool					probed;
+	PrvProbedOwners			probedOwners;
+
+	if (pContext == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	*pContext = NULL;
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	if (contextName == NULL)
+	{
+		*pContext = PrvHandOutContext(gGlobalContextP);
+		return kPmLogErr_None;
+	}
+
+	logErr = PrvValidateContextName(contextName);
+	if (logErr != kPmLogErr_None)
+	{
+		return logErr;
+	}
+
+	probed = false;
+
+	// lock the globals
+	PmLogPrvLock();
+
+Lookup:
+	theContextP = NULL;
+	logErr = kPmLogErr_None;
+
+	// look for a match on the context name
+	for (i = 0; i <= gGlobalsP->numUserContexts; i++)
+	{
+		contextP = &gGlobalsP->contextInfo[ i ];
+
+		if (strcmp(contextName, PrvContextName(contextP)) == 0)
+		{
+			//DbgPrint("found context %s\n", contextName);
+			theContextP = contextP;
+			break;
+		}
+	}
+
+	// if context not found, add it, reclaiming unused ones if full
+	if (theContextP == NULL)
+	{
+		index = PrvFindFreeContext();
+		if ((index == 0) && !probed)
+		{
+			// probe the owners to reclaim from without the lock, then
+			// look again, as the context may have been added meanwhile
+			PmLogPrvUnlock();
+			PrvProbeOwners(&probedOwners, true);
+			PmLogPrvLock();
+
+			probed = true;
+			goto Lookup;
+		}
+
+		if ((index == 0) && (PrvReclaimContexts(&probedOwners) > 0))
+		{
+			index = PrvFindFreeContext();
+		}
+
+		if (index == 0)
+		{
+			DbgPrint("no more contexts available\n");
+			logErr = kPmLogErr_TooManyContexts;
+		}
+		else
+		{
+			DbgPrint("adding context %s\n", contextName);
+			PrvContextsChangeBegin();
+
+			theContextP = &gGlobalsP->contextInfo[ index ];
+			metaP = PrvContextMeta(theContextP);
+
+			mystrcpy(metaP->component, sizeof(metaP->component),
+				contextName);
+
+			defaultsP = PrvGetContextDefaults(contextName);
+
+			PrvStoreContextLevel(theContextP,
+				PmLogLoadRelaxed_(&defaultsP->enabledLevel));
+			__atomic_store_n(&theContextP->flags,
+				PmLogLoadRelaxed_(&defaultsP->flags), __ATOMIC_RELAXED);
+			metaP->facility = PrvContextMeta(defaultsP)->facility;
+			metaP->numMessages = 0;
+			metaP->numAttached = 0;
+			metaP->pinned = 0;
+			memset(metaP->owners, 0, sizeof(metaP->owners));
+
+			// a level set by rule overrides the inherited one
+			ruleP = PrvFindLevelRule(contextName);
+			if (ruleP != NULL)
+			{
+				PrvStoreContextLevel(theContextP, ruleP->level);
+				if (ruleP->facility != 0)
+				{
+					metaP->facility = ruleP->facility;
+				}
+			}
+
+			if (index > gGlobalsP->numUserContexts)
+			{
+				__atomic_store_n(&gGlobalsP->numUserContexts, index,
+					__ATOMIC_RELEASE);
+			}
+
+			PrvStoreCheckLevels(theContextP, PrvContextPassLevel(index));
+
+			PrvContextsChangeEnd();
+		}
+	}
+
+	if (theContextP != NULL)
+	{
+		PrvAttachContext(theContextP);
+		PrvRefreshProcessLevel(theContextP - gGlobalsP->contextInfo);
+		PrvPublishPassLevels();
+	}
+
+	// release the globals lock
+	PmLogPrvUnlock();
+
+	if (theContextP != NULL)
+	{
+		*pContext = PrvHandOutContext(theContextP);
+		return kPmLogErr_None;
+	}
+
+	// in case of error, return the global context pointer
+	*pContext = PrvHandOutContext(gGlobalContextP);
+	return logErr;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContextInline */
+/**
+@brief  Returns the logging context for the named context.
+**********************************************************************/
+PmLogContext PmLogGetContextInline(const char* contextName)
+{
+	PmLogErr		logErr;
+	PmLogContext	context;
+
+	context = NULL;
+	logErr = PmLogGetContext(contextName, &context);
+	if (logErr == kPmLogErr_None)
+	{
+		return context;
+	}
+
+	return kPmLogGlobalContext;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContextCached */
+/**
+@brief  Returns the logging context for the named context, and caches
+		it for the calling trace site.
+**********************************************************************/
+PmLogContext PmLogGetContextCached(const char* contextName,
+	PmLogContext* cacheP)
+{
+	PmLogContext	context;
+
+	context = NULL;
+	(void) PmLogGetContext(contextName, &context);
+
+	// if the context table is full, PmLogGetContext returns the global
+	// context, which is then cached so the site doesn't retry the
+	// lookup on every call (see the header)
+	if ((context != NULL) && (cacheP != NULL))
+	{
+		__atomic_store_n(cacheP, context, __ATOMIC_RELEASE);
+	}
+
+	return context;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContextName */
+/**
+@brief  Returns the name of the specified context into the specified
+		string buffer.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetContextName(PmLogContext context, char* contextName,
+	size_t contextNameBuffSize)
+{
+	PmLogContextInfo*	contextP;
+
+	// clear out result in case of error
+	if ((contextName != NULL) && (contextNameBuffSize > 0))
+	{
+		contextName[ 0 ] = 0;
+	}
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	if ((contextName == NULL) || (contextNameBuffSize <= 1))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	mystrcpy(contextName, contextNameBuffSize, PrvContextName(contextP));
+
+	if (contextNameBuffSize < strlen(PrvContextName(contextP)) + 1)
+	{
+		return kPmLogErr_BufferTooSmall;
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContextLevel */
+/**
+@brief  Gets the logging level for the specified context.
+		May be used for the global context.  This should generally not
+		be used by the components doing logging themselves.
+		Instead just use the PmLogPrint etc. APIs which will do
+		inline enabled checks.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogGetContextLevel(PmLogContext context, PmLogLevel* levelP)
+{
+	PmLogContextInfo*	contextP;
+
+	// clear out result in case of error
+	if (levelP != NULL)
+	{
+		*levelP = kPmLogLevel_Debug;
+	}
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	if (levelP == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	*levelP = PmLogLoadRelaxed_(&contextP->enabledLevel);
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogSetContextLevel */
+/**
+@brief  Sets the logging level for the specified context.
+		May be used for the global context.
+**********************************************************************/
+PmLogErr PmLogSetContextLevel(PmLogContext context, PmLogLevel level)
+{
+	PmLogContextInfo*	contextP;
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	if ((level != kPmLogLevel_None) && !PrvIsValidLevel(level))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	// dummy reference to avoid unused function warning
+	// when DbgPrint is compiled out
+	(void) &PrvGetLevelStr;
+	DbgPrint("SetContextLevel %s => %s\n", PrvContextName(contextP),
+		PrvGetLevelStr(level));
+
+	// readers test the level with a relaxed load, and don't wait for it
+	PrvStoreContextLevel(contextP, level);
+	PrvContextsChanged();
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvSetLevelRule */
+/**
+@brief  Records a level rule, with the facility too if not 0, and
+		applies it to the existing contexts matching the pattern.
+**********************************************************************/
+static PmLogErr PrvSetLevelRule(const char* pattern, PmLogLevel level,
+	int facility)
+{
+	PmLogErr			logErr;
+	int					i;
+	int					numRules;
+	PmLogLevelRule*		ruleP;
+	PmLogContextInfo*	contextP;
+
+	logErr = kPmLogErr_None;
+
+	// lock the globals
+	PmLogPrvLock();
+	PrvContextsChangeBegin();
+
+	// drop any old rule for the same pattern, so the new one is newest
+	numRules = gGlobalsP->numLevelRules;
+	for (i = 0; i < numRules; i++)
+	{
+		if (strcmp(gGlobalsP->levelRules[ i ].pattern, pattern) == 0)
+		{
+			memmove(&gGlobalsP->levelRules[ i ],
+				&gGlobalsP->levelRules[ i + 1 ],
+				(numRules - i - 1) * sizeof(PmLogLevelRule));
+			numRules--;
+			break;
+		}
+	}
+
+	if (numRules >= PMLOG_MAX_LEVEL_RULES)
+	{
+		logErr = kPmLogErr_TooManyRules;
+	}
+	else
+	{
+		ruleP = &gGlobalsP->levelRules[ numRules ];
+		mystrcpy(ruleP->pattern, sizeof(ruleP->pattern), pattern);
+		ruleP->level = level;
+		ruleP->facility = facility;
+		gGlobalsP->numLevelRules = numRules + 1;
+
+		for (i = 1; i <= gGlobalsP->numUserContexts; i++)
+		{
+			contextP = &gGlobalsP->contextInfo[ i ];
+			if ((PrvContextName(contextP)[ 0 ] != 0) &&
+				(fnmatch(pattern, PrvContextName(contextP), 0) == 0))
+			{
+				PrvStoreContextLevel(contextP, level);
+				if (facility != 0)
+				{
+					PrvContextMeta(contextP)->facility = facility;
+				}
+			}
+		}
+	}
+
+	// release the globals lock
+	PrvContextsChangeEnd();
+	PmLogPrvUnlock();
+
+	return logErr;
+}
+
+
+/*********************************************************************/
+/* PmLogSetContextLevels */
+/**
+@brief  Sets the logging level for all the contexts matching the glob
+		pattern, and records the pattern as a rule for the contexts
+		created later.
+**********************************************************************/
+PmLogErr PmLogSetContextLevels(const char* pattern, PmLogLevel level)
+{
+	PmLogErr			logErr;
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	if (pattern == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	logErr = PrvValidateLevelPattern(pattern);
+	if (logErr != kPmLogErr_None)
+	{
+		return logErr;
+	}
+
+	if ((level != kPmLogLevel_None) && !PrvIsValidLevel(level))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	DbgPrint("SetContextLevels %s => %s\n", pattern, PrvGetLevelStr(level));
+
+	return PrvSetLevelRule(pattern, level, 0);
+}
+
+
+/*********************************************************************/
+/* PmLogSetProcessLevels */
+/**
+@brief  Overrides the logging level, in this process only, of all the
+		contexts matching the glob pattern, now and as they are got.
+**********************************************************************/
+PmLogErr PmLogSetProcessLevels(const char* pattern, PmLogLevel level)
+{
+	PmLogErr			logErr;
+	int					i;
+	int					numRules;
+	PmLogLevelRule*		ruleP;
+
+	if (gGlobalsP == NULL)
+	{
+		return kPmLogErr_Unknown;
+	}
+
+	if (pattern == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	logErr = PrvValidateLevelPattern(pattern);
+	if (logErr != kPmLogErr_None)
+	{
+		return logErr;
+	}
+
+	if ((level != kPmLogLevel_None) && !PrvIsValidLevel(level))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	DbgPrint("SetProcessLevels %s => %s\n", pattern, PrvGetLevelStr(level));
+
+	// the overrides are only this process's, but the context names they
+	// are matched against are shared
+	PmLogPrvLock();
+
+	// drop any old override for the same pattern, so the new one is newest
+	numRules = gNumProcessRules;
+	for (i = 0; i < numRules; i++)
+	{
+		if (strcmp(gProcessRules[ i ].pattern, pattern) == 0)
+		{
+			memmove(&gProcessRules[ i ], &gProcessRules[ i + 1 ],
+				(numRules - i - 1) * sizeof(PmLogLevelRule));
+			numRules--;
+			break;
+		}
+	}
+
+	if (numRules >= PMLOG_MAX_LEVEL_RULES)
+	{
+		logErr = kPmLogErr_TooManyRules;
+	}
+	else
+	{
+		ruleP = &gProcessRules[ numRules ];
+		mystrcpy(ruleP->pattern, sizeof(ruleP->pattern), pattern);
+		ruleP->level = level;
+		ruleP->facility = 0;
+		numRules++;
+	}
+
+	gNumProcessRules = numRules;
+	PrvRefreshProcessLevels();
+
+	PmLogPrvUnlock();
+
+	return logErr;
+}
+
+
+/*********************************************************************/
+/* PmLogClearProcessLevels */
+/**
+@brief  Drops all this process's level overrides.
+**********************************************************************/
+PmLogErr PmLogClearProcessLevels(void)
+{
+	if (gGlobalsP == NULL)
+	{
+		gNumProcessRules = 0;
+		__atomic_store_n(&gProcessLevelsActive, 0, __ATOMIC_RELEASE);
+		return kPmLogErr_None;
+	}
+
+	PmLogPrvLock();
+	gNumProcessRules = 0;
+	PrvRefreshProcessLevels();
+	PmLogPrvUnlock();
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvThreadLevelExit */
+/**
+@brief  Thread exit destructor that stops counting the thread's level.
+**********************************************************************/
+static void PrvThreadLevelExit(void* p)
+{
+	(void) p;
+
+	gElevatedLevel = kPmLogLevel_None;
+	gElevateDepth = 0;
+	PrvUpdateThreadLevel();
+}
+
+
+/*********************************************************************/
+/* PrvThreadLevelKeyInit */
+/**
+@brief  Creates the key whose destructor stops counting a thread's
+		level when it exits.
+**********************************************************************/
+static void PrvThreadLevelKeyInit(void)
+{
+	(void) pthread_key_create(&gThreadLevelKey, PrvThreadLevelExit);
+}
+
+
+/*********************************************************************/
+/* PrvUpdateThreadLevel */
+/**
+@brief  Sets the calling thread's level from its elevated and backtrace
+		capture levels, and lets the inline check pass it on.
+**********************************************************************/
+static void PrvUpdateThreadLevel(void)
+{
+	int		level;
+	bool	changed;
+
+	level = gElevatedLevel;
+
+	if ((gBacktraceP != NULL) && (gBacktraceP->contextP != NULL) &&
+		(gBacktraceP->captureLevel > level))
+	{
+		level = gBacktraceP->captureLevel;
+	}
+
+	if (level == gThreadLevel)
+	{
+		return;
+	}
+
+	if (gThreadLevel == kPmLogLevel_None)
+	{
+		(void) pthread_once(&gThreadLevelKeyOnce, PrvThreadLevelKeyInit);
+		(void) pthread_setspecific(gThreadLevelKey, (void*) 1);
+	}
+
+	(void) pthread_mutex_lock(&gPassLock);
+	if (gThreadLevel != kPmLogLevel_None)
+	{
+		gThreadLevelCounts[ gThreadLevel ]--;
+	}
+	if (level != kPmLogLevel_None)
+	{
+		gThreadLevelCounts[ level ]++;
+	}
+	gThreadLevel = level;
+	changed = PrvUpdateThreadPassLevelLocked();
+	(void) pthread_mutex_unlock(&gPassLock);
+
+	// the thread's checks must be passed on before this returns
+	if (changed && (gGlobalsP != NULL) && (gSem != SEM_FAILED))
+	{
+		PmLogPrvLock();
+		PrvPublishPassLevels();
+		PmLogPrvUnlock();
+	}
+}
+
+
+/*********************************************************************/
+/* PmLogElevateThreadLevel */
+/**
+@brief  Raises the calling thread's elevated level to at least the
+		given level, saving the old one for PmLogRestoreThreadLevel,
+		both in *savedLevelP and on the thread's stack of elevations.
+**********************************************************************/
+PmLogErr PmLogElevateThreadLevel(PmLogLevel level, PmLogLevel* savedLevelP)
+{
+	if (savedLevelP == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	// a failed call leaves a saved level that restoring refuses, so
+	// that a scope can restore whatever happened
+	*savedLevelP = kPmLogLevel_None - 1;
+
+	if (!PrvIsValidLevel(level))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	if (gElevateDepth >= PMLOG_MAX_THREAD_ELEVATIONS)
+	{
+		return kPmLogErr_TooMuchData;
+	}
+
+	*savedLevelP = gElevatedLevel;
+	gElevateSaved[ gElevateDepth++ ] = gElevatedLevel;
+
+	if (level > gElevatedLevel)
+	{
+		gElevatedLevel = level;
+		PrvUpdateThreadLevel();
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogRestoreThreadLevel */
+/**
+@brief  Ends the calling thread's innermost elevation, whose saved
+		level must be the one given, and sets the elevated level back
+		to the one it saved.
+**********************************************************************/
+PmLogErr PmLogRestoreThreadLevel(PmLogLevel savedLevel)
+{
+	if ((savedLevel != kPmLogLevel_None) && !PrvIsValidLevel(savedLevel))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	if ((gElevateDepth == 0) ||
+		(gElevateSaved[ gElevateDepth - 1 ] != savedLevel))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	gElevatedLevel = gElevateSaved[ --gElevateDepth ];
+	PrvUpdateThreadLevel();
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvBacktraceFree */
+/**
+@brief  Thread exit destructor for the thread's backtrace buffer.
+**********************************************************************/
+static void PrvBacktraceFree(void* p)
+{
+	// anything logged later on the thread must not use it
+	gBacktraceP = NULL;
+	PrvUpdateThreadLevel();
+
+	free(p);
+}
+
+
+/*********************************************************************/
+/* PrvBacktraceKeyInit */
+/**
+@brief  Creates the key that frees backtrace buffers at thread exit.
+**********************************************************************/
+static void PrvBacktraceKeyInit(void)
+{
+	(void) pthread_key_create(&gBacktraceKey, PrvBacktraceFree);
+}
+
+
+/*********************************************************************/
+/* PmLogBeginBacktrace */
+/**
+@brief  Starts holding back the calling thread's messages for the
+		context at levels up to captureLevel that it disables.  Errors
+		are never held back, as they are what outputs the others.
+**********************************************************************/
+PmLogErr PmLogBeginBacktrace(PmLogContext context, PmLogLevel captureLevel)
+{
+	PmLogContextInfo*	contextP;
+	PrvBacktrace*		btP;
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	if (!PrvIsValidLevel(captureLevel) || (captureLevel <= kPmLogLevel_Error))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	btP = gBacktraceP;
+	if (btP == NULL)
+	{
+		(void) pthread_once(&gBacktraceKeyOnce, PrvBacktraceKeyInit);
+
+		btP = (PrvBacktrace*) malloc(sizeof(PrvBacktrace));
+		if (btP == NULL)
+		{
+			return kPmLogErr_Unknown;
+		}
+
+		(void) pthread_setspecific(gBacktraceKey, btP);
+		gBacktraceP = btP;
+	}
+
+	btP->contextP = contextP;
+	btP->captureLevel = captureLevel;
+	btP->len = 0;
+
+	PrvUpdateThreadLevel();
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogEndBacktrace */
+/**
+@brief  Discards the calling thread's held back messages, and stops
+		holding them.  The buffer is kept for the thread's next use.
+**********************************************************************/
+PmLogErr PmLogEndBacktrace(void)
+{
+	if (gBacktraceP != NULL)
+	{
+		gBacktraceP->contextP = NULL;
+		gBacktraceP->len = 0;
+		PrvUpdateThreadLevel();
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogGetContextFacility */
+/**
+@brief  Gets the syslog facility for the specified context, or 0 for
+		the process default.  May be used for the global context.
+**********************************************************************/
+PmLogErr PmLogGetContextFacility(PmLogContext context, int* facilityP)
+{
+	const PmLogContextInfo*	contextP;
+
+	if (facilityP == NULL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	*facilityP = 0;
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	*facilityP = PrvContextMeta(contextP)->facility;
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogSetContextFacility */
+/**
+@brief  Sets the syslog facility for the specified context, or 0 for
+		the process default.  May be used for the global context.
+**********************************************************************/
+PmLogErr PmLogSetContextFacility(PmLogContext context, int facility)
+{
+	PmLogContextInfo*	contextP;
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	if ((facility != 0) && (PmLogFacilityToString(facility) == NULL))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	DbgPrint("SetContextFacility %s => %d\n", PrvContextName(contextP),
+		facility);
+
+	PmLogPrvLock();
+	PrvContextsChangeBegin();
+	PrvContextMeta(contextP)->facility = facility;
+	PrvContextsChangeEnd();
+	PmLogPrvUnlock();
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogSetContextPinned */
+/**
+@brief  Pins the specified context, so that it is kept even with no
+		process attached, or unpins it.
+**********************************************************************/
+PmLogErr PmLogSetContextPinned(PmLogContext context, bool pinned)
+{
+	PmLogContextInfo*	contextP;
+
+	contextP = PrvResolveContext(context);
+	if (contextP == NULL)
+	{
+		return kPmLogErr_InvalidContext;
+	}
+
+	DbgPrint("SetContextPinned %s => %d\n", PrvContextName(contextP),
+		(int) pinned);
+
+	// reclaiming reads this under the lock
+	PmLogPrvLock();
+	PrvContextMeta(contextP)->pinned = pinned ? 1 : 0;
+	PmLogPrvUnlock();
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvCheckContext */
+/**
+@brief  Validate the context and check whether logging is enabled,
+		either for output per the context level, or for capture by
+		the flight recorder or the thread's backtrace.
+**********************************************************************/
+static PmLogErr PrvCheckContext(const PmLogContextInfo* contextP,
+	PmLogLevel level)
+{
+	// context should already have been resolved
+	assert(contextP != NULL);
+
+	if (!PrvIsValidLevel(level))
+	{
+		return kPmLogErr_InvalidLevel;
+	}
+
+	if (!PrvIsLevelPassed(contextP, level))
+	{
+		return kPmLogErr_LevelDisabled;
+	}
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PmLogIsEnabled_ */
+/**
+@brief  The library side of PmLogIsEnabled, for the levels that may be
+		taken whatever the shared context level.  Lock-free and
+		async-signal-safe.
+**********************************************************************/
+bool PmLogIsEnabled_(PmLogContext context, PmLogLevel level)
+{
+	const PmLogContextInfo*	contextP;
+
+	// let a bad call through to report the error
+	contextP = PrvResolveContext(context);
+	if ((contextP == NULL) || !PrvIsValidLevel(level))
+	{
+		return true;
+	}
+
+	return PrvIsLevelPassed(contextP, level);
+}
+
+
+/***********************************************************************
+ * HandleLogLibCommand
+ ***********************************************************************/
+static bool HandleLogLibCommand(const char* msg)
+{
+	const char*  kLogLibCmdPrefix    = "!loglib ";
+	const size_t kLogLibCmdPrefixLen = 8;
+
+	if (strncmp(msg, kLogLibCmdPrefix, kLogLibCmdPrefixLen) != 0)
+	{
+		return false;
+	}
+
+	msg += kLogLibCmdPrefixLen;
+
+	if (strcmp(msg, "loadconf") == 0)
+	{
+		DbgPrint("HandleLogLibCommand: re-loading global config\n");
+		(void) PrvReadGlobalConfig(gGlobalsP);
+		return true;
+	}
+
+	return false;
+}
+
+
+/*********************************************************************/
+/* PrvLogTimeNs */
+/**
+@brief  Returns the time stamp for a message being logged now, from the
+		configured source.
+**********************************************************************/
+static inline uint64_t PrvLogTimeNs(void)
+{
+	return PrvTimeNowNs(
+		(PrvGlobalsFlags(gGlobalsP) & kPmLogGlobalsFlag_TimeTsc) != 0);
+}
+
+
+/*********************************************************************/
+/* PrvLogSinks */
+/**
+@brief  Returns the set of sinks for a message at the given level in
+		the given context.
+**********************************************************************/
+static uint32_t PrvLogSinks(const PmLogContextInfo* contextP, PmLogLevel level)
+{
+	uint32_t	sinks;
+
+	sinks = PrvSinkGetDispatch(gGlobalsP, level);
+
+	// the message may have been let through only for the recorder
+	if (!PrvIsLevelEnabled(contextP, level))
+	{
+		sinks &= (1u << kPmLogSink_Ring);
+	}
+
+	return sinks;
+}
+
+
+/*********************************************************************/
+/* PrvLogDispatch */
+/**
+@brief  Passes sLen bytes of message to the given sinks.  timeNs is
+		the time stamp taken when the client made the call, and
+		msgFlags the kPmLogSinkMsgFlag_xxx flags, to which
+		kPmLogSinkMsgFlag_Elevated is added here if it applies.
+**********************************************************************/
+static void PrvLogDispatch(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, uint32_t sinks, const char* s, size_t sLen,
+	int msgFlags)
+{
+	PrvSinkMsg	msg;
+	pid_t		pid;
+	pid_t		tid;
+	int			globalsFlags;
+	char		ptidStr[ 32 ];
+	char		componentStr[ 1 + PMLOG_MAX_CONTEXT_NAME_LEN + 3 +1 ]; // one character before, 3 after, \0 terminator
+
+	globalsFlags = PrvGlobalsFlags(gGlobalsP);
+
+	if ((globalsFlags & kPmLogGlobalsFlag_LogProcessIds) ||
+		(globalsFlags & kPmLogGlobalsFlag_LogThreadIds))
+	{
+		pid = getpid();
+		tid = gettid();
+		if (globalsFlags & kPmLogGlobalsFlag_LogThreadIds &&
+			(tid != pid))
+		{
+			mysprintf(ptidStr, sizeof(ptidStr), "[%d:%d]: ", (int) pid,
+				(int) tid);
+		}
+		else
+		{
+			mysprintf(ptidStr, sizeof(ptidStr), "[%d]: ", (int) pid);
+		}
+	}
+	else
+	{
+		ptidStr[0] = 0;
+	}
+
+	if (PrvIsGlobalContext(contextP))
+	{
+		componentStr[0] = 0;
+	}
+	else
+	{
+		mysprintf(componentStr, sizeof(componentStr), "{%s}: ",
+			PrvContextName(contextP));
+	}
+
+	msg.pub.context = PrvExportContext(contextP);
+	msg.pub.component = PrvIsGlobalContext(contextP) ? NULL :
+		PrvContextName(contextP);
+	msg.pub.level = level;
+	msg.pub.msg = s;
+	msg.pub.msgLen = sLen;
+	msg.pub.timeNs = timeNs;
+	msg.pub.flags = msgFlags;
+	if ((level > PrvProcessLevel(contextP)) &&
+		(level <= gElevatedLevel))
+	{
+		msg.pub.flags |= kPmLogSinkMsgFlag_Elevated;
+	}
+	msg.facility = PrvContextMeta(contextP)->facility;
+	msg.identStr = __progname;
+	msg.pidStr = ptidStr;
+	msg.componentStr = componentStr;
+
+	PrvSinkDispatch(gGlobalsP, sinks, &msg);
+}
+
+
+/*********************************************************************/
+/* PrvBacktraceRecSize */
+/**
+@brief  Returns the size of a backtrace record with msgLen bytes of
+		text, padded to keep the next one aligned.
+**********************************************************************/
+static inline size_t PrvBacktraceRecSize(size_t msgLen)
+{
+	return (sizeof(PrvBacktraceRec) + msgLen + 7) & ~(size_t) 7;
+}
+
+
+/*********************************************************************/
+/* PrvBacktraceCapture */
+/**
+@brief  Holds back the message in the calling thread's backtrace.  If
+		the buffer is full, the oldest messages are dropped to free at
+		least a quarter of it, so that dropping is rare.
+**********************************************************************/
+static void PrvBacktraceCapture(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, const char* s, size_t sLen, int msgFlags)
+{
+	PrvBacktrace*		btP;
+	uint8_t*			dataP;
+	PrvBacktraceRec*	recP;
+	size_t				recSize;
+	size_t				want;
+	size_t				offset;
+
+	btP = gBacktraceP;
+	dataP = (uint8_t*) btP->data;
+
+	recSize = PrvBacktraceRecSize(sLen);
+	if (recSize > sizeof(btP->data))
+	{
+		return;
+	}
+
+	if (btP->len + recSize > sizeof(btP->data))
+	{
+		want = sizeof(btP->data) / 4;
+		if (want < recSize)
+		{
+			want = recSize;
+		}
+
+		offset = 0;
+		while ((offset < btP->len) &&
+			(btP->len - offset + want > sizeof(btP->data)))
+		{
+			recP = (PrvBacktraceRec*) (dataP + offset);
+			offset += PrvBacktraceRecSize(recP->msgLen);
+		}
+
+		memmove(dataP, dataP + offset, btP->len - offset);
+		btP->len -= offset;
+	}
+
+	recP = (PrvBacktraceRec*) (dataP + btP->len);
+	recP->timeNs = timeNs;
+	recP->contextP = contextP;
+	recP->level = (int16_t) level;
+	recP->msgFlags = (uint16_t) msgFlags;
+	recP->msgLen = (uint32_t) sLen;
+	memcpy(recP + 1, s, sLen);
+
+	btP->len += recSize;
+}
+
+
+/*********************************************************************/
+/* PrvBacktraceFlush */
+/**
+@brief  Outputs the messages held back in the calling thread's
+		backtrace, oldest first, and empties it.  They are not passed to
+		the flight recorder, which has already had what it records.
+**********************************************************************/
+static void PrvBacktraceFlush(void)
+{
+	PrvBacktrace*			btP;
+	const uint8_t*			dataP;
+	const PrvBacktraceRec*	recP;
+	size_t					offset;
+	uint32_t				sinks;
+
+	btP = gBacktraceP;
+	dataP = (const uint8_t*) btP->data;
+
+	for (offset = 0; offset < btP->len;
+		offset += PrvBacktraceRecSize(recP->msgLen))
+	{
+		recP = (const PrvBacktraceRec*) (dataP + offset);
+
+		// skip any from before a switch of namespace
+		if ((uintptr_t) recP->contextP - (uintptr_t) gGlobalsP->contextInfo >=
+			sizeof(gGlobalsP->contextInfo))
+		{
+			continue;
+		}
+
+		sinks = PrvSinkGetDispatch(gGlobalsP, recP->level) &
+			~(1u << kPmLogSink_Ring);
+		if (sinks != 0)
+		{
+			PrvLogDispatch(recP->contextP, recP->level, recP->timeNs, sinks,
+				(const char*) (recP + 1), recP->msgLen, recP->msgFlags);
+		}
+	}
+
+	btP->len = 0;
+}
+
+
+/*********************************************************************/
+/* PrvLogWriteMsg */
+/**
+@brief  Logs sLen bytes of message to the specified context, holding
+		it back for the thread's backtrace if that takes it.  timeNs is
+		the time stamp taken when the client made the call, and msgFlags
+		the kPmLogSinkMsgFlag_xxx flags for the message.
+**********************************************************************/
+static void PrvLogWriteMsg(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, const char* s, size_t sLen, int msgFlags)
+{
+	uint32_t	sinks;
+	int			savedErrNo;
+
+	// save and restore errno, so logging doesn't have side effects
+	savedErrNo = errno;
+
+	PrvCountMessage(contextP, PrvIsLevelEnabled(contextP, level));
+
+	if (gBacktraceP != NULL)
+	{
+		if (level <= kPmLogLevel_Error)
+		{
+			// an error: output what led up to it first
+			if (gBacktraceP->len > 0)
+			{
+				PrvBacktraceFlush();
+			}
+		}
+		else if (PrvIsCaptured(contextP, level))
+		{
+			PrvBacktraceCapture(contextP, level, timeNs, s, sLen, msgFlags);
+		}
+	}
+
+	sinks = PrvLogSinks(contextP, level);
+	if (sinks != 0)
+	{
+		PrvLogDispatch(contextP, level, timeNs, sinks, s, sLen, msgFlags);
+	}
+
+	errno = savedErrNo;
+}
+
+
+/*********************************************************************/
+/* PrvLogWrite */
+/**
+@brief  Logs the specified formatted text to the specified context.
+		timeNs is the time stamp taken when the client made the call.
+**********************************************************************/
+static PmLogErr PrvLogWrite(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, const char* s)
+{
+	size_t		sLen;
+	bool		handled;
+	int			savedErrNo;
+
+	// save and restore errno, so logging doesn't have side effects
+	savedErrNo = errno;
+	handled = HandleLogLibCommand(s);
+	errno = savedErrNo;
+
+	if (handled)
+	{
+		return kPmLogErr_None;
+	}
+
+	// sinks add their own line ends
+	sLen = strlen(s);
+	if ((sLen > 0) && (s[sLen - 1] == '\n'))
+	{
+		sLen--;
+	}
+
+	PrvLogWriteMsg(contextP, level, timeNs, s, sLen, 0);
+
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* PrvLogVPrint */
+/**
+@brief  Logs the specified formatted text to the specified context.
+**********************************************************************/
+static PmLogErr PrvLogVPrint(PmLogContextInfo* contextP, PmLogLevel level,
+	const char* fmt, va_list args)
+{
+	const size_t kLineBuffSize = 1024;
+
+	PmLogErr		logErr;
+	char			lineStr[ kLineBuffSize ];
+	uint64_t		timeNs;
+	int				n;
+	int				err;
+
+	if ((fmt == NULL) || (fmt[0] == 0))
+	{
+		return kPmLogErr_InvalidFormat;
+	}
+
+	timeNs = PrvLogTimeNs();
+
+	n = vsnprintf(lineStr, sizeof(lineStr), fmt, args);
+	if (n < 0)
+	{
+		err = errno;
+		ErrPrint("vsnprintf error %s\n", strerror(err));
+		logErr = kPmLogErr_FormatStringFailed;
+	}
+	else
 	{
-		return context;
+		if (n >= sizeof(lineStr))
+		{
+			DbgPrint("vsnprintf truncation\n");
+			lineStr[ sizeof(lineStr) - 1 ] = 0;
+		}
+
+		logErr = PrvLogWrite(contextP, level, timeNs, lineStr);
 	}
 
-	return kPmLogGlobalContext;
+	return logErr;
 }
 
 
 /*********************************************************************/
-/* PmLogGetContextName */
+/* PmLogPrint_ */
 /**
-@brief  Returns the name of the specified context into the specified
-		string buffer.
-
-@return Error code:
-			kPmLogErr_None
-			kPmLogErr_InvalidParameter
+@brief  Logs the specified formatted text to the specified context.
 **********************************************************************/
-PmLogErr PmLogGetContextName(PmLogContext context, char* contextName,
-	size_t contextNameBuffSize)
+PmLogErr PmLogPrint_(PmLogContext context, PmLogLevel level,
+	const char* fmt, ...)
 {
-	PmLogContext_*	contextP;
-
-	// clear out result in case of error
-	if ((contextName != NULL) && (contextNameBuffSize > 0))
-	{
-		contextName[ 0 ] = 0;
-	}
+	PmLogContextInfo*	contextP;
+	PmLogErr			logErr;
+	va_list				args;
 
 	contextP = PrvResolveContext(context);
 	if (contextP == NULL)
@@ -1794,44 +5516,42 @@ PmLogErr PmLogGetContextName(PmLogContext context, char* contextName,
 		return kPmLogErr_InvalidContext;
 	}
 
-	if ((contextName == NULL) || (contextNameBuffSize <= 1))
+	logErr = PrvCheckContext(contextP, level);
+	if (logErr != kPmLogErr_None)
 	{
-		return kPmLogErr_InvalidParameter;
+		return logErr;
 	}
 
-	mystrcpy(contextName, contextNameBuffSize, contextP->component);
+	va_start(args, fmt);
 
-	if (contextNameBuffSize < strlen(contextP->component) + 1)
-	{
-		return kPmLogErr_BufferTooSmall;
-	}
+	logErr = PrvLogVPrint(contextP, level, fmt, args);
 
-	return kPmLogErr_None;
+	va_end(args);
+
+	return logErr;
 }
 
 
 /*********************************************************************/
-/* PmLogGetContextLevel */
+/* PmLogVPrint_ */
 /**
-@brief  Gets the logging level for the specified context.
-		May be used for the global context.  This should generally not
-		be used by the components doing logging themselves.
-		Instead just use the PmLogPrint etc. APIs which will do
-		inline enabled checks.
+@brief  Logs the specified formatted text to the specified context.
+
+		For efficiency, this API should not be used directly, but
+		instead use the wrappers (PmLogVPrint, PmLogVPrintError, ...)
+		that bypass the library call if the logging is not enabled.
 
 @return Error code:
 			kPmLogErr_None
-			kPmLogErr_InvalidParameter
+			kPmLogErr_InvalidContext
+			kPmLogErr_InvalidLevel
+			kPmLogErr_InvalidFormat
 **********************************************************************/
-PmLogErr PmLogGetContextLevel(PmLogContext context, PmLogLevel* levelP)
+PmLogErr PmLogVPrint_(PmLogContext context, PmLogLevel level,
+	const char* fmt, va_list args)
 {
-	PmLogContext_*	contextP;
-
-	// clear out result in case of error
-	if (levelP != NULL)
-	{
-		*levelP = kPmLogLevel_Debug;
-	}
+	PmLogContextInfo*	contextP;
+	PmLogErr			logErr;
 
 	contextP = PrvResolveContext(context);
 	if (contextP == NULL)
@@ -1839,26 +5559,40 @@ PmLogErr PmLogGetContextLevel(PmLogContext context, PmLogLevel* levelP)
 		return kPmLogErr_InvalidContext;
 	}
 
-	if (levelP == NULL)
+	logErr = PrvCheckContext(contextP, level);
+	if (logErr != kPmLogErr_None)
 	{
-		return kPmLogErr_InvalidParameter;
+		return logErr;
 	}
 
-	*levelP = contextP->info.enabledLevel;
+	logErr = PrvLogVPrint(contextP, level, fmt, args);
 
-	return kPmLogErr_None;
+	return logErr;
 }
 
 
 /*********************************************************************/
-/* PmLogSetContextLevel */
+/* PmLogPrintSignalSafe_ */
 /**
-@brief  Sets the logging level for the specified context.
-		May be used for the global context.
+@brief  Logs the specified formatted text to the specified context.
+		Async-signal-safe: no locks, no stdio and no syslog().
 **********************************************************************/
-PmLogErr PmLogSetContextLevel(PmLogContext context, PmLogLevel level)
+PmLogErr PmLogPrintSignalSafe_(PmLogContext context, PmLogLevel level,
+	const char* fmt, ...)
 {
-	PmLogContext_*	contextP;
+	const size_t kLineBuffSize = 1024;
+
+	PmLogContextInfo*	contextP;
+	va_list				args;
+	char				lineStr[ kLineBuffSize ];
+	size_t				n;
+	int					savedErrNo;
+	int					consoleFd;
+	uint32_t			sinks;
+	const char*			component;
+	int					pri;
+	uint64_t			timeNs;
+	bool				enabled;
 
 	contextP = PrvResolveContext(context);
 	if (contextP == NULL)
@@ -1866,223 +5600,405 @@ PmLogErr PmLogSetContextLevel(PmLogContext context, PmLogLevel level)
 		return kPmLogErr_InvalidContext;
 	}
 
-	if ((level != kPmLogLevel_None) && !PrvIsValidLevel(level))
+	if (!PrvIsValidLevel(level))
 	{
 		return kPmLogErr_InvalidLevel;
 	}
 
-	// dummy reference to avoid unused function warning
-	// when DbgPrint is compiled out
-	(void) &PrvGetLevelStr;
-	DbgPrint("SetContextLevel %s => %s\n", contextP->component,
-		PrvGetLevelStr(level));
+	// unlike PrvCheckContext, the calling thread's elevated level and
+	// backtrace are left alone, as thread-local storage isn't safe here
+	enabled = PrvIsProcessLevelEnabled(contextP, level);
+	if (!enabled && (level > PmLogLoadRelaxed_(&PmLogRecordLevel_)))
+	{
+		return kPmLogErr_LevelDisabled;
+	}
 
-	contextP->info.enabledLevel = level;
-	return kPmLogErr_None;
-}
+	if ((fmt == NULL) || (fmt[0] == 0))
+	{
+		return kPmLogErr_InvalidFormat;
+	}
 
+	// save and restore errno, so logging doesn't have side effects
+	savedErrNo = errno;
 
-/*********************************************************************/
-/* PrvCheckContext */
-/**
-@brief  Validate the context and check whether logging is enabled.
-**********************************************************************/
-static PmLogErr PrvCheckContext(const PmLogContext_* contextP,
-	PmLogLevel level)
-{
-	// context should already have been resolved
-	assert(contextP != NULL);
+	timeNs = PrvLogTimeNs();
 
-	if (!PrvIsValidLevel(level))
+	va_start(args, fmt);
+	n = PrvSafeVFormat(lineStr, sizeof(lineStr), fmt, args);
+	va_end(args);
+
+	PrvCountMessage(contextP, enabled);
+
+	// no custom sinks here, as they can't be assumed to be safe
+	sinks = PrvSinkPeekDispatch(level);
+
+	if (!enabled)
 	{
-		return kPmLogErr_InvalidLevel;
+		sinks &= (1u << kPmLogSink_Ring);
 	}
 
-	if (level > contextP->info.enabledLevel)
+	if (sinks & (1u << kPmLogSink_Ring))
 	{
-		return kPmLogErr_LevelDisabled;
+		PrvRecorderWrite(timeNs, PrvContextName(contextP), level, lineStr, n,
+			0);
+	}
+
+	if (sinks & (1u << kPmLogSink_StdErr))
+	{
+		consoleFd = STDERR_FILENO;
+	}
+	else if (sinks & (1u << kPmLogSink_StdOut))
+	{
+		consoleFd = STDOUT_FILENO;
+	}
+	else
+	{
+		consoleFd = -1;
+	}
+
+	component = PrvIsGlobalContext(contextP) ? NULL : PrvContextName(contextP);
+
+	pri = PrvSyslogPri(PrvContextMeta(contextP)->facility, level);
+
+	if ((sinks & (1u << kPmLogSink_Syslog)) || (consoleFd >= 0))
+	{
+		(void) PrvSafeLogWrite(pri,
+			(PrvGlobalsFlags(gGlobalsP) &
+				kPmLogGlobalsFlag_SyslogTimestamps) ? timeNs : 0,
+			component, lineStr, n,
+			(sinks & (1u << kPmLogSink_Syslog)) ? PMLOG_SYSLOG_SOCKET_PATH : NULL,
+			consoleFd);
+	}
+
+	if (sinks & (1u << kPmLogSink_Socket))
+	{
+		(void) PrvSafeLogWrite(pri, timeNs, component, lineStr, n,
+			gGlobalsP->socketPath, -1);
 	}
 
+	errno = savedErrNo;
+
 	return kPmLogErr_None;
 }
 
 
+// the longest dump line: a 16-digit offset, 2 spaces, 3 columns per
+// byte plus a space between groups of 8, then " |ascii|"
+#define kDumpLineBuffSize	(16 + 2 + PMLOG_DUMP_MAX_BYTES_PER_LINE * 3 + \
+	PMLOG_DUMP_MAX_BYTES_PER_LINE / 8 + 3 + PMLOG_DUMP_MAX_BYTES_PER_LINE + 1)
+
+
 /*********************************************************************/
-/* PrvLogToConsole */
+/* DumpLine_OffsetHexAscii */
 /**
-@brief  Echos the logged info + message to the output.
+@brief  Formats one line of hex dump with ASCII view too.
+		This is similar to the "hexdump -C" output format, but that
+		is not a requirement.  One difference is we don't output a
+		trailing empty line with the final offset.  A short last line
+		is padded so the ASCII view lines up.
+
+	000030c0  02 02 00 00 06 00 00 00  02 06 00 00 06 00 00 41  \
+		|...............A|
+
+		Returns the line length.
 **********************************************************************/
-static void PrvLogToConsole(FILE* out, const char* identStr,
-	const char* ptidStr, const char* componentStr, const char* s)
+static size_t DumpLine_OffsetHexAscii(char* lineBuff, const uint8_t* srcP,
+	size_t lineBytes, size_t bytesPerLine, size_t offset)
 {
-	size_t		sLen;
-	const char* endStr;
+	uint8_t		b;
+	size_t		i;
+	char*		lineP;
 
-	sLen = strlen(s);
+	mysprintf(lineBuff, kDumpLineBuffSize, "%08zX", offset);
 
-	if ((sLen > 0) && (s[sLen - 1] == '\n'))
+	lineP = lineBuff + strlen(lineBuff);
+	*lineP++ = ' ';
+	*lineP++ = ' ';
+
+	for (i = 0; i < bytesPerLine; i++)
 	{
-		endStr = "";
+		if ((i > 0) && (i % 8 == 0))
+		{
+			*lineP++ = ' ';
+		}
+
+		if (i < lineBytes)
+		{
+			b = srcP[ i ];
+			*lineP++ = kHexChars[ b >> 4 ];
+			*lineP++ = kHexChars[ b & 0x0F ];
+		}
+		else
+		{
+			*lineP++ = ' ';
+			*lineP++ = ' ';
+		}
+
+		*lineP++ = ' ';
 	}
-	else
+
+	*lineP++ = ' ';
+
+	*lineP++ = '|';
+
+	for (i = 0; i < lineBytes; i++)
 	{
-		endStr = "\n";
+		b = srcP[ i ];
+		if (!((b >= 0x20) && (b <= 0x7E)))
+		{
+			b = '.';
+		}
+		*lineP++ = (char) b;
 	}
 
-	fprintf(out, "%s%s%s%s%s", identStr, ptidStr, componentStr, s, endStr);
+	*lineP++ = '|';
+
+	// sanity check that the buffer was sized correctly
+	assert(lineP - lineBuff < kDumpLineBuffSize);
+	*lineP = 0;
+
+	return (size_t) (lineP - lineBuff);
 }
 
 
-/***********************************************************************
- * HandleLogLibCommand
- ***********************************************************************/
-static bool HandleLogLibCommand(const char* msg)
+/*********************************************************************/
+/* DumpLine_OffsetHex */
+/**
+@brief  Formats one line of hex dump without the ASCII view or any
+		spacing between bytes.
+
+	000030c0  020200000600000002060000060000410A
+
+		Returns the line length.
+**********************************************************************/
+static size_t DumpLine_OffsetHex(char* lineBuff, const uint8_t* srcP,
+	size_t lineBytes, size_t offset)
 {
-	const char*  kLogLibCmdPrefix    = "!loglib ";
-	const size_t kLogLibCmdPrefixLen = 8;
+	size_t		i;
+	char*		lineP;
 
-	if (strncmp(msg, kLogLibCmdPrefix, kLogLibCmdPrefixLen) != 0)
-	{
-		return false;
-	}
+	mysprintf(lineBuff, kDumpLineBuffSize, "%08zX", offset);
 
-	msg += kLogLibCmdPrefixLen;
+	lineP = lineBuff + strlen(lineBuff);
+	*lineP++ = ' ';
+	*lineP++ = ' ';
 
-	if (strcmp(msg, "loadconf") == 0)
+	for (i = 0; i < lineBytes; i++)
 	{
-		DbgPrint("HandleLogLibCommand: re-loading global config\n");
-		(void) PrvReadGlobalConfig(gGlobalsP);
-		return true;
+		*lineP++ = kHexChars[ srcP[ i ] >> 4 ];
+		*lineP++ = kHexChars[ srcP[ i ] & 0x0F ];
 	}
 
-	return false;
+	*lineP = 0;
+
+	return (size_t) (lineP - lineBuff);
 }
 
 
 /*********************************************************************/
-/* PrvLogWrite */
+/* DumpLine_Base64 */
 /**
-@brief  Logs the specified formatted text to the specified context.
+@brief  Formats one line of base64.  Only the last line of a dump can
+		have padding, as bytesPerLine is a multiple of 3.
+		Returns the line length.
 **********************************************************************/
-static PmLogErr PrvLogWrite(PmLogContext_* contextP, PmLogLevel level,
-	const char* s)
+static size_t DumpLine_Base64(char* lineBuff, const uint8_t* srcP,
+	size_t lineBytes)
 {
-	const char*	identStr;
-	pid_t		pid;
-	pid_t		tid;
-	char		ptidStr[ 32 ];
-	int			savedErrNo;
-	char		componentStr[ 1 + PMLOG_MAX_CONTEXT_NAME_LEN + 3 +1 ]; // one character before, 3 after, \0 terminator
+	uint32_t	v;
+	size_t		i;
+	char*		lineP;
 
-	// save and restore errno, so logging doesn't have side effects
-	savedErrNo = errno;
+	lineP = lineBuff;
 
-	if (HandleLogLibCommand(s))
+	for (i = 0; i + 3 <= lineBytes; i += 3)
 	{
-		goto Exit;
+		v = ((uint32_t) srcP[ i ] << 16) | ((uint32_t) srcP[ i + 1 ] << 8) |
+			srcP[ i + 2 ];
+		*lineP++ = kBase64Chars[ (v >> 18) & 0x3F ];
+		*lineP++ = kBase64Chars[ (v >> 12) & 0x3F ];
+		*lineP++ = kBase64Chars[ (v >> 6) & 0x3F ];
+		*lineP++ = kBase64Chars[ v & 0x3F ];
 	}
 
-	identStr = __progname;
-
-	if ((gGlobalsP->flags & kPmLogGlobalsFlag_LogProcessIds) ||
-		(gGlobalsP->flags & kPmLogGlobalsFlag_LogThreadIds))
+	if (i < lineBytes)
 	{
-		pid = getpid();
-		tid = gettid();
-		if (gGlobalsP->flags & kPmLogGlobalsFlag_LogThreadIds &&
-			(tid != pid))
-		{
-			mysprintf(ptidStr, sizeof(ptidStr), "[%d:%d]: ", (int) pid,
-				(int) tid);
-		}
-		else
+		v = (uint32_t) srcP[ i ] << 16;
+		if (i + 1 < lineBytes)
 		{
-			mysprintf(ptidStr, sizeof(ptidStr), "[%d]: ", (int) pid);
+			v |= (uint32_t) srcP[ i + 1 ] << 8;
 		}
-	}
-	else
-	{
-		ptidStr[0] = 0;
-	}
 
-	if (PrvIsGlobalContext(contextP))
-	{
-		componentStr[0] = 0;
-	}
-	else
-	{
-		mysprintf(componentStr, sizeof(componentStr), "{%s}: ",
-			contextP->component);
+		*lineP++ = kBase64Chars[ (v >> 18) & 0x3F ];
+		*lineP++ = kBase64Chars[ (v >> 12) & 0x3F ];
+		*lineP++ = (i + 1 < lineBytes) ? kBase64Chars[ (v >> 6) & 0x3F ] : '=';
+		*lineP++ = '=';
 	}
 
-	syslog(level, "%s%s%s", ptidStr, componentStr, s);
+	*lineP = 0;
 
-	if (gGlobalsP->flags & kPmLogGlobalsFlag_LogToConsole)
-	{
-		const PmLogConsole* consoleConfP = &gGlobalsP->consoleConf;
+	return (size_t) (lineP - lineBuff);
+}
 
-		if (ptidStr[0] == 0)
-		{
-			mystrcpy(ptidStr, sizeof(ptidStr), ": ");
-		}
 
-		if ((level >= consoleConfP->stdErrMinLevel) &&
-			(level <= consoleConfP->stdErrMaxLevel))
+/*********************************************************************/
+/* DumpData_Lines */
+/**
+@brief  Dump the specified data to the given sinks as lines of text in
+		the given style, bytesPerLine bytes per line.  All the lines of
+		a dump get the time of the call.
+**********************************************************************/
+static PmLogErr DumpData_Lines(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, uint32_t sinks, const void* dataP, size_t dataSize,
+	PmLogDumpStyle style, size_t bytesPerLine, size_t offsetBase)
+{
+	const uint8_t*	srcP;
+	size_t			srcOffset;
+	char			lineBuff[ kDumpLineBuffSize ];
+	size_t			lineBytes;
+	size_t			lineLen;
+
+	srcP = (const uint8_t*) dataP;
+	srcOffset = 0;
+
+	while ((sinks != 0) && (srcOffset < dataSize))
+	{
+		lineBytes = dataSize - srcOffset;
+		if (lineBytes > bytesPerLine)
 		{
-			PrvLogToConsole(stderr, identStr, ptidStr, componentStr, s);
+			lineBytes = bytesPerLine;
 		}
 
-		if ((level >= consoleConfP->stdOutMinLevel) &&
-			(level <= consoleConfP->stdOutMaxLevel))
+		switch (style)
 		{
-			PrvLogToConsole(stdout, identStr, ptidStr, componentStr, s);
+			case kPmLogDumpStyle_Hex:
+				lineLen = DumpLine_OffsetHex(lineBuff, srcP, lineBytes,
+					offsetBase + srcOffset);
+				break;
+
+			case kPmLogDumpStyle_Base64:
+				lineLen = DumpLine_Base64(lineBuff, srcP, lineBytes);
+				break;
+
+			default:
+				lineLen = DumpLine_OffsetHexAscii(lineBuff, srcP, lineBytes,
+					bytesPerLine, offsetBase + srcOffset);
+				break;
 		}
+
+		PrvLogDispatch(contextP, level, timeNs, sinks, lineBuff, lineLen, 0);
+
+		srcP += lineBytes;
+		srcOffset += lineBytes;
 	}
 
-Exit:
-	// save and restore errno, so logging doesn't have side effects
-	errno = savedErrNo;
+	return kPmLogErr_None;
+}
+
+
+/*********************************************************************/
+/* DumpData_Raw */
+/**
+@brief  Dump the specified data as a single binary message to the
+		sinks that can take it, and as base64 lines to the rest.
+**********************************************************************/
+static PmLogErr DumpData_Raw(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, const void* dataP, size_t dataSize,
+	size_t bytesPerLine)
+{
+	uint32_t	sinks;
+	uint32_t	rawSinks;
+
+	sinks = PrvLogSinks(contextP, level);
+
+	rawSinks = sinks & PrvSinkRawMask(gGlobalsP);
+	if (rawSinks != 0)
+	{
+		PrvLogDispatch(contextP, level, timeNs, rawSinks,
+			(const char*) dataP, dataSize, kPmLogSinkMsgFlag_Raw);
+	}
 
-	return kPmLogErr_None;
+	return DumpData_Lines(contextP, level, timeNs, sinks & ~rawSinks,
+		dataP, dataSize, kPmLogDumpStyle_Base64, bytesPerLine, 0);
 }
 
 
 /*********************************************************************/
-/* PrvLogVPrint */
+/* DumpData_Style */
 /**
-@brief  Logs the specified formatted text to the specified context.
+@brief  Dump the specified data in the given style.
 **********************************************************************/
-static PmLogErr PrvLogVPrint(PmLogContext_* contextP, PmLogLevel level,
-	const char* fmt, va_list args)
+static PmLogErr DumpData_Style(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, const void* dataP, size_t dataSize,
+	PmLogDumpStyle style, size_t bytesPerLine, size_t offsetBase)
 {
-	const size_t kLineBuffSize = 1024;
+	if (style == kPmLogDumpStyle_Raw)
+	{
+		return DumpData_Raw(contextP, level, timeNs, dataP, dataSize,
+			bytesPerLine);
+	}
+
+	return DumpData_Lines(contextP, level, timeNs,
+		PrvLogSinks(contextP, level), dataP, dataSize, style, bytesPerLine,
+		offsetBase);
+}
+
 
+/*********************************************************************/
+/* DumpData_Bounded */
+/**
+@brief  Dump a summary of data longer than maxBytes: its length and
+		XXH64 hash, then its first and last bytes, maxBytes in all.
+		The first part is kept to whole lines where possible, so that
+		base64 lines can still be joined and decoded.
+
+	5242880 bytes, xxh64 5BD2A8A83A5E3E7B, first 8192 and last 8192 \
+		from offset 004FE000
+**********************************************************************/
+static PmLogErr DumpData_Bounded(PmLogContextInfo* contextP, PmLogLevel level,
+	uint64_t timeNs, const void* dataP, size_t dataSize, size_t maxBytes,
+	PmLogDumpStyle style, size_t bytesPerLine, size_t offsetBase)
+{
+	const uint8_t*	srcP;
+	size_t			headBytes;
+	size_t			tailBytes;
+	size_t			tailOffset;
+	uint32_t		sinks;
+	char			summaryStr[ 128 ];
 	PmLogErr		logErr;
-	char			lineStr[ kLineBuffSize ];
-	int				n;
-	int				err;
 
-	if ((fmt == NULL) || (fmt[0] == 0))
+	srcP = (const uint8_t*) dataP;
+
+	headBytes = maxBytes / 2;
+	if (headBytes >= bytesPerLine)
 	{
-		return kPmLogErr_InvalidFormat;
+		headBytes -= headBytes % bytesPerLine;
 	}
+	tailBytes = maxBytes - headBytes;
+	tailOffset = dataSize - tailBytes;
 
-	n = vsnprintf(lineStr, sizeof(lineStr), fmt, args);
-	if (n < 0)
+	sinks = PrvLogSinks(contextP, level);
+	if (sinks != 0)
 	{
-		err = errno;
-		ErrPrint("vsnprintf error %s\n", strerror(err));
-		logErr = kPmLogErr_FormatStringFailed;
+		mysprintf(summaryStr, sizeof(summaryStr),
+			"%zu bytes, xxh64 %016llX, first %zu and last %zu from offset %08zX",
+			dataSize, (unsigned long long) PrvHash64(dataP, dataSize),
+			headBytes, tailBytes, offsetBase + tailOffset);
+		PrvLogDispatch(contextP, level, timeNs, sinks, summaryStr,
+			strlen(summaryStr), 0);
 	}
-	else
+
+	logErr = kPmLogErr_None;
+	if (headBytes > 0)
 	{
-		if (n >= sizeof(lineStr))
-		{
-			DbgPrint("vsnprintf truncation\n");
-			lineStr[ sizeof(lineStr) - 1 ] = 0;
-		}
+		logErr = DumpData_Style(contextP, level, timeNs, srcP, headBytes,
+			style, bytesPerLine, offsetBase);
+	}
 
-		logErr = PrvLogWrite(contextP, level, lineStr);
+	if (logErr == kPmLogErr_None)
+	{
+		logErr = DumpData_Style(contextP, level, timeNs, srcP + tailOffset,
+			tailBytes, style, bytesPerLine, offsetBase + tailOffset);
 	}
 
 	return logErr;
@@ -2090,16 +6006,28 @@ static PmLogErr PrvLogVPrint(PmLogContext_* contextP, PmLogLevel level,
 
 
 /*********************************************************************/
-/* PmLogPrint_ */
+/* PmLogDumpData_ */
 /**
-@brief  Logs the specified formatted text to the specified context.
+@brief  Logs the specified binary data as text dump to the specified context.
+		Specify kPmLogDumpFormatDefault for the formatting parameter,
+		or a PmLogDumpFormat.
+		For efficiency, this API should not be used directly, but
+		instead use the wrappers (PmLogDumpData, ...) that
+		bypass the library call if the logging is not enabled.
 **********************************************************************/
-PmLogErr PmLogPrint_(PmLogContext context, PmLogLevel level,
-	const char* fmt, ...)
+PmLogErr PmLogDumpData_(PmLogContext context, PmLogLevel level,
+	const void* data, size_t numBytes, const PmLogDumpFormat* format)
 {
-	PmLogContext_*	contextP;
-	PmLogErr		logErr;
-	va_list 		args;
+
+	PmLogContextInfo*	contextP;
+	PmLogErr			logErr;
+	const uint8_t*		pData;
+	PmLogDumpStyle		style;
+	size_t				bytesPerLine;
+	size_t				offsetBase;
+	size_t				maxBytes;
+	uint64_t			timeNs;
+	int					savedErrNo;
 
 	contextP = PrvResolveContext(context);
 	if (contextP == NULL)
@@ -2113,174 +6041,276 @@ PmLogErr PmLogPrint_(PmLogContext context, PmLogLevel level,
 		return logErr;
 	}
 
-	va_start(args, fmt);
+	if (numBytes == 0)
+	{
+		return kPmLogErr_NoData;
+	}
 
-	logErr = PrvLogVPrint(contextP, level, fmt, args);
+	pData = (const uint8_t*) data;
+	if (pData == NULL)
+	{
+		return kPmLogErr_InvalidData;
+	}
 
-	va_end(args);
+	style = kPmLogDumpStyle_HexAscii;
+	bytesPerLine = 0;
+	offsetBase = 0;
+	maxBytes = 0;
+
+	if (format != kPmLogDumpFormatDefault)
+	{
+		style = format->style;
+		bytesPerLine = format->bytesPerLine;
+		offsetBase = format->offsetBase;
+		maxBytes = format->maxBytes;
+	}
+
+	if (maxBytes == 0)
+	{
+		maxBytes = (gGlobalsP->dumpMaxBytes > 0)
+			? (size_t) gGlobalsP->dumpMaxBytes
+			: PMLOG_DUMP_UNLIMITED;
+	}
+
+	if (bytesPerLine == 0)
+	{
+		bytesPerLine = ((style == kPmLogDumpStyle_Base64) ||
+			(style == kPmLogDumpStyle_Raw)) ? 48 : 16;
+	}
+
+	if ((style < kPmLogDumpStyle_HexAscii) ||
+		(style > kPmLogDumpStyle_Raw) ||
+		(bytesPerLine > PMLOG_DUMP_MAX_BYTES_PER_LINE) ||
+		(((style == kPmLogDumpStyle_Base64) ||
+			(style == kPmLogDumpStyle_Raw)) && (bytesPerLine % 3 != 0)))
+	{
+		return kPmLogErr_InvalidFormat;
+	}
+
+	if ((style == kPmLogDumpStyle_Raw) &&
+		(((numBytes < maxBytes) ? numBytes : maxBytes) > PMLOG_DUMP_MAX_RAW_SIZE))
+	{
+		return kPmLogErr_TooMuchData;
+	}
+
+	// save and restore errno, so logging doesn't have side effects
+	savedErrNo = errno;
+
+	// all the lines of a dump get the time of the call
+	timeNs = PrvLogTimeNs();
+
+	PrvCountMessage(contextP, PrvIsLevelEnabled(contextP, level));
+
+	if (numBytes > maxBytes)
+	{
+		logErr = DumpData_Bounded(contextP, level, timeNs, pData, numBytes,
+			maxBytes, style, bytesPerLine, offsetBase);
+	}
+	else
+	{
+		logErr = DumpData_Style(contextP, level, timeNs, pData, numBytes,
+			style, bytesPerLine, offsetBase);
+	}
+
+	errno = savedErrNo;
 
 	return logErr;
 }
 
 
+//#######################################################################
+
+
 /*********************************************************************/
-/* PmLogVPrint_ */
+/* PrvKVBuff */
 /**
-@brief  Logs the specified formatted text to the specified context.
+@brief  Bounded output buffer for building binary or text records.
+		Appends past the end are dropped and flagged.
+**********************************************************************/
+typedef struct
+{
+	uint8_t*	data;
+	size_t		size;
+	size_t		len;
+	bool		overflow;
+}
+PrvKVBuff;
 
-		For efficiency, this API should not be used directly, but
-		instead use the wrappers (PmLogVPrint, PmLogVPrintError, ...)
-		that bypass the library call if the logging is not enabled.
 
-@return Error code:
-			kPmLogErr_None
-			kPmLogErr_InvalidContext
-			kPmLogErr_InvalidLevel
-			kPmLogErr_InvalidFormat
+/*********************************************************************/
+/* PrvKVPut */
+/**
+@brief  Append bytes to the buffer.  Returns false on overflow, in
+		which case nothing is appended.
 **********************************************************************/
-PmLogErr PmLogVPrint_(PmLogContext context, PmLogLevel level,
-	const char* fmt, va_list args)
+static bool PrvKVPut(PrvKVBuff* buffP, const void* p, size_t n)
 {
-	PmLogContext_*	contextP;
-	PmLogErr		logErr;
-
-	contextP = PrvResolveContext(context);
-	if (contextP == NULL)
+	if (buffP->overflow || (n > buffP->size - buffP->len))
 	{
-		return kPmLogErr_InvalidContext;
+		buffP->overflow = true;
+		return false;
 	}
 
-	logErr = PrvCheckContext(contextP, level);
-	if (logErr != kPmLogErr_None)
+	memcpy(buffP->data + buffP->len, p, n);
+	buffP->len += n;
+	return true;
+}
+
+
+/*********************************************************************/
+/* PrvKVPutVarint */
+/**
+@brief  Append an unsigned LEB128 varint.
+**********************************************************************/
+static bool PrvKVPutVarint(PrvKVBuff* buffP, uint64_t v)
+{
+	uint8_t	bytes[ 10 ];
+	size_t	n;
+
+	n = 0;
+	do
 	{
-		return logErr;
+		bytes[ n ] = (uint8_t) (v & 0x7F);
+		v >>= 7;
+		if (v != 0)
+		{
+			bytes[ n ] |= 0x80;
+		}
+		n++;
 	}
+	while (v != 0);
 
-	logErr = PrvLogVPrint(contextP, level, fmt, args);
-
-	return logErr;
+	return PrvKVPut(buffP, bytes, n);
 }
 
 
 /*********************************************************************/
-/* DumpData_OffsetHexAscii */
+/* PrvKVPutBytes */
 /**
-@brief  Dump the specified data as hex dump with ASCII view too.
-		This is similar to the "hexdump -C" output format, but that
-		is not a requirement.  One difference is we don't output a
-		trailing empty line with the final offset.
-
-	000030c0  02 02 00 00 06 00 00 00  02 06 00 00 06 00 00 41  \
-		|...............A|
+@brief  Append a length-prefixed byte string.
 **********************************************************************/
-static PmLogErr DumpData_OffsetHexAscii(PmLogContext_* contextP,
-	PmLogLevel level, const void* dataP, size_t dataSize)
+static bool PrvKVPutBytes(PrvKVBuff* buffP, const void* p, size_t n)
 {
-	const size_t kMaxBytesPerLine = 16;
+	size_t	savedLen;
 
-	const size_t kMaxLineLen = 8 + 2 + kMaxBytesPerLine * 3 + 2 +
-		1 + kMaxBytesPerLine + 1;
+	savedLen = buffP->len;
 
-	const uint8_t*	srcP;
-	uint8_t			b;
-	size_t			srcOffset;
-	char			lineBuff[ kMaxLineLen + 1 ];
-	size_t			lineBytes;
-	size_t			i;
-	char*			lineP;
-	PmLogErr		logErr;
+	if (!PrvKVPutVarint(buffP, n) || !PrvKVPut(buffP, p, n))
+	{
+		buffP->len = savedLen;
+		return false;
+	}
+
+	return true;
+}
 
-	logErr = kPmLogErr_NoData;
 
-	srcP = (const uint8_t*) dataP;
-	srcOffset = 0;
+/*********************************************************************/
+/* PrvKVEncodeField */
+/**
+@brief  Append one field per the PmLogKV_ encoding.  On failure the
+		buffer is left as it was before the field.
+**********************************************************************/
+static PmLogErr PrvKVEncodeField(PrvKVBuff* buffP, const PmLogKVField* fieldP)
+{
+	size_t		savedLen;
+	uint8_t		type;
+	size_t		keyLen;
+	uint64_t	bits;
+	uint8_t		le[ 8 ];
+	int			i;
+	bool		ok;
 
-	while (srcOffset < dataSize)
+	if ((fieldP->key == NULL) || (fieldP->key[ 0 ] == 0))
 	{
-		lineBytes = dataSize - srcOffset;
-		if (lineBytes > kMaxBytesPerLine)
-		{
-			lineBytes = kMaxBytesPerLine;
-		}
+		return kPmLogErr_InvalidParameter;
+	}
 
-		mysprintf(lineBuff, sizeof(lineBuff), "%08zX", srcOffset);
+	keyLen = strlen(fieldP->key);
+	if (keyLen > PMLOG_KV_MAX_KEY_LEN)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
 
-		lineP = lineBuff + 8;
-		*lineP++ = ' ';
-		*lineP++ = ' ';
+	savedLen = buffP->len;
 
-		for (i = 0; i < kMaxBytesPerLine; i++)
-		{
-			if (i == 8)
-			{
-				*lineP++ = ' ';
-			}
+	type = (uint8_t) fieldP->type;
+	ok = PrvKVPut(buffP, &type, 1) &&
+		PrvKVPutBytes(buffP, fieldP->key, keyLen);
+
+	switch (fieldP->type)
+	{
+		case kPmLogKVType_Int64:
+			// zigzag so small negative values stay small
+			bits = ((uint64_t) fieldP->u.i64 << 1) ^
+				(uint64_t) (fieldP->u.i64 >> 63);
+			ok = ok && PrvKVPutVarint(buffP, bits);
+			break;
 
-			if (i < lineBytes)
+		case kPmLogKVType_Double:
+			memcpy(&bits, &fieldP->u.d, sizeof(bits));
+			for (i = 0; i < 8; i++)
 			{
-				b = srcP[ i ];
-				*lineP++ = kHexChars[ b >> 4 ];
-				*lineP++ = kHexChars[ b & 0x0F ];
+				le[ i ] = (uint8_t) (bits >> (8 * i));
 			}
-			else
+			ok = ok && PrvKVPut(buffP, le, sizeof(le));
+			break;
+
+		case kPmLogKVType_String:
+			if (fieldP->u.s == NULL)
 			{
-				*lineP++ = ' ';
-				*lineP++ = ' ';
+				buffP->len = savedLen;
+				return kPmLogErr_InvalidData;
 			}
+			ok = ok && PrvKVPutBytes(buffP, fieldP->u.s, strlen(fieldP->u.s));
+			break;
 
-			*lineP++ = ' ';
-		}
-
-		*lineP++ = ' ';
-
-		*lineP++ = '|';
-
-		for (i = 0; i < lineBytes; i++)
-		{
-			b = srcP[ i ];
-			if (!((b >= 0x20) && (b <= 0x7E)))
+		case kPmLogKVType_Bytes:
+			if ((fieldP->u.mem.p == NULL) && (fieldP->u.mem.n > 0))
 			{
-				b = '.';
+				buffP->len = savedLen;
+				return kPmLogErr_InvalidData;
 			}
-			*lineP++ = (char) b;
-		}
-
-		*lineP++ = '|';
-
-		// sanity check that the buffer was sized correctly
-		assert((lineBytes < kMaxBytesPerLine) || ((lineP - lineBuff) == (ptrdiff_t) kMaxLineLen));
-		*lineP = 0;
-
-		logErr = PrvLogWrite(contextP, level, lineBuff);
-		if (logErr != kPmLogErr_None)
-		{
+			ok = ok && PrvKVPutBytes(buffP, fieldP->u.mem.p, fieldP->u.mem.n);
 			break;
-		}
 
-		srcP += lineBytes;
-		srcOffset += lineBytes;
+		default:
+			buffP->len = savedLen;
+			return kPmLogErr_InvalidParameter;
 	}
 
-	return logErr;
+	if (!ok)
+	{
+		// drop the partial field, but leave the overflow flagged
+		buffP->len = savedLen;
+		return kPmLogErr_TooMuchData;
+	}
+
+	return kPmLogErr_None;
 }
 
 
 /*********************************************************************/
-/* PmLogDumpData_ */
+/* PmLogKV_ */
 /**
-@brief  Logs the specified binary data as text dump to the specified context.
-		Specify kPmLogDumpFormatDefault for the formatting parameter.
-		For efficiency, this API should not be used directly, but
-		instead use the wrappers (PmLogDumpData, ...) that
-		bypass the library call if the logging is not enabled.
+@brief  Logs the specified message id and typed fields to the specified
+		context.
 **********************************************************************/
-PmLogErr PmLogDumpData_(PmLogContext context, PmLogLevel level,
-	const void* data, size_t numBytes, const PmLogDumpFormat* format)
+PmLogErr PmLogKV_(PmLogContext context, PmLogLevel level,
+	const char* msgId, const PmLogKVField* fields, size_t numFields)
 {
-
-	PmLogContext_*	contextP;
-	PmLogErr		logErr;
-	const uint8_t*	pData;
+	// room kept for the truncation marker: type, key and a varint
+	const size_t kMarkSize = 2 + sizeof(PMLOG_KV_TRUNCATED_KEY) + 10;
+
+	PmLogContextInfo*	contextP;
+	PmLogErr			logErr;
+	PmLogErr			fieldErr;
+	uint8_t				recBuff[ PMLOG_KV_MAX_RECORD_SIZE ];
+	PrvKVBuff			rec;
+	PmLogKVField		mark;
+	uint64_t			timeNs;
+	size_t				i;
+	size_t				numDropped;
 
 	contextP = PrvResolveContext(context);
 	if (contextP == NULL)
@@ -2294,29 +6324,92 @@ PmLogErr PmLogDumpData_(PmLogContext context, PmLogLevel level,
 		return logErr;
 	}
 
-	if (numBytes == 0)
+	timeNs = PrvLogTimeNs();
+
+	if ((fields == NULL) && (numFields > 0))
 	{
-		return kPmLogErr_NoData;
+		return kPmLogErr_InvalidParameter;
 	}
 
-	pData = (const uint8_t*) data;
-	if (pData == NULL)
+	rec.data = recBuff;
+	rec.size = sizeof(recBuff) - kMarkSize;
+	rec.len = 0;
+	rec.overflow = false;
+
+	if (msgId == NULL)
 	{
-		return kPmLogErr_InvalidData;
+		msgId = "";
 	}
 
-	//?? TO DO: allow specifying format
-	if (format != kPmLogDumpFormatDefault)
+	if (!PrvKVPutBytes(&rec, msgId, strlen(msgId)))
 	{
-		return kPmLogErr_InvalidFormat;
+		return kPmLogErr_TooMuchData;
 	}
 
-	logErr = DumpData_OffsetHexAscii(contextP, level, data, numBytes);
+	// fields that can't be encoded are dropped, the rest are still
+	// logged and the first error is reported
+	fieldErr = kPmLogErr_None;
+	numDropped = 0;
+	for (i = 0; i < numFields; i++)
+	{
+		logErr = PrvKVEncodeField(&rec, &fields[ i ]);
+		if (logErr == kPmLogErr_TooMuchData)
+		{
+			numDropped++;
+		}
+		if ((logErr != kPmLogErr_None) && (fieldErr == kPmLogErr_None))
+		{
+			fieldErr = logErr;
+		}
+	}
 
-	return logErr;
+	// say in the record itself that it lost fields, in the room kept
+	if (numDropped > 0)
+	{
+		mark.key = PMLOG_KV_TRUNCATED_KEY;
+		mark.type = kPmLogKVType_Int64;
+		mark.u.i64 = (int64_t) numDropped;
+
+		rec.size = sizeof(recBuff);
+		rec.overflow = false;
+		(void) PrvKVEncodeField(&rec, &mark);
+	}
+
+	// the record is passed on encoded, and only rendered by the sinks
+	// that write text
+	PrvLogWriteMsg(contextP, level, timeNs, (const char*) rec.data, rec.len,
+		kPmLogSinkMsgFlag_KV);
+
+	return fieldErr;
+}
+
+
+/*********************************************************************/
+/* PmLogKVRender */
+/**
+@brief  Renders a structured record passed to a custom sink as logfmt
+		or JSON text.
+**********************************************************************/
+PmLogErr PmLogKVRender(const char* rec, size_t recLen, bool json,
+	char* buff, size_t buffSize)
+{
+	if (((rec == NULL) && (recLen > 0)) || (buff == NULL) || (buffSize == 0))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	if (!PmLogPrvKVRender(rec, recLen, json, buff, buffSize))
+	{
+		return kPmLogErr_InvalidData;
+	}
+
+	return kPmLogErr_None;
 }
 
 
+//#######################################################################
+
+
 /***********************************************************************
  * PmLogGetErrDbgString
  *
@@ -2346,6 +6439,9 @@ const char* PmLogGetErrDbgString(PmLogErr logErr)
 		/*  12 */ DEFINE_ERR_STR( InvalidContextName );
 		/*  13 */ DEFINE_ERR_STR( ContextNotFound );
 		/*  14 */ DEFINE_ERR_STR( BufferTooSmall );
+		/*  15 */ DEFINE_ERR_STR( TooManySinks );
+		/*  16 */ DEFINE_ERR_STR( TooManyRules );
+		/*  17 */ DEFINE_ERR_STR( InUse );
 		//---------------------------------------------
 		/* 999 */ DEFINE_ERR_STR( Unknown );
 	}
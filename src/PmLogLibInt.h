@@ -0,0 +1,400 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  This header file declares the routines shared between the
+*		  PmLogLib source files.  It is not installed.
+*
+* @file PmLogLibInt.h
+* <hr>
+**/
+
+#ifndef PMLOGLIBINT_H
+#define PMLOGLIBINT_H
+
+
+#include "PmLogLib.h"
+#include "PmLogLibPrv.h"
+
+#include <stdio.h>
+#include <sys/syslog.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+
+//#####################################################################
+
+
+/***********************************************************************
+ * COMPONENT_PREFIX
+ ***********************************************************************/
+#define COMPONENT_PREFIX	"PmLogLib: "
+
+
+// don't check in with this on!
+//#define DEBUG_ENABLED
+
+
+#ifdef DEBUG_ENABLED
+
+	/***********************************************************************
+	 * DbgPrint
+	 ***********************************************************************/
+	#define DbgPrint(...) \
+		{														\
+			fprintf(stdout, COMPONENT_PREFIX __VA_ARGS__);		\
+			syslog(LOG_DEBUG, COMPONENT_PREFIX __VA_ARGS__);	\
+		}
+
+
+	/***********************************************************************
+	 * ErrPrint
+	 ***********************************************************************/
+	#define ErrPrint(...) \
+		{														\
+			fprintf(stderr, COMPONENT_PREFIX __VA_ARGS__);		\
+			syslog(LOG_ERR, COMPONENT_PREFIX __VA_ARGS__);		\
+		}
+
+#else
+
+	/***********************************************************************
+	 * DbgPrint
+	 ***********************************************************************/
+	#define DbgPrint(...)
+
+
+	/***********************************************************************
+	 * ErrPrint
+	 ***********************************************************************/
+	#define ErrPrint(...) \
+		{														\
+			syslog(LOG_ERR, COMPONENT_PREFIX __VA_ARGS__);		\
+		}
+
+#endif // DEBUG_ENABLED
+
+
+//#####################################################################
+
+
+/*********************************************************************/
+/* gettid */
+/**
+@brief  Returns the kernel thread id of the calling thread.
+**********************************************************************/
+pid_t gettid(void);
+
+
+/*********************************************************************/
+/* PrvGlobalsFlags */
+/**
+@brief  Returns the kPmLogGlobalsFlag_xxx flags.  They may be changed
+		by a configuration reload in another process at any time, so
+		are read atomically.
+**********************************************************************/
+static inline int PrvGlobalsFlags(const PmLogGlobals* globalsP)
+{
+	return __atomic_load_n(&globalsP->flags, __ATOMIC_RELAXED);
+}
+
+
+/*********************************************************************/
+/* PmLogRecordLevel_ */
+/**
+@brief  The process-wide flight recorder level.  Messages at or below
+		this level are captured into the process's crash ring even if
+		the context level disables them.  It is kPmLogLevel_None unless
+		the flight recorder is configured and running.
+**********************************************************************/
+extern int PmLogRecordLevel_;
+
+
+//#####################################################################
+
+
+// Flight recorder (PmLogFlightRecorder.c)
+
+
+/*********************************************************************/
+/* PrvRecorderOpen */
+/**
+@brief  Creates and maps the flight recorder ring file for this process
+		per the given settings.  Returns true if the recorder is running.
+**********************************************************************/
+bool PrvRecorderOpen(const PmLogRecorderConf* confP);
+
+
+/*********************************************************************/
+/* PrvRecorderClose */
+/**
+@brief  Unmaps the flight recorder ring.  The ring file is removed,
+		as it is only of interest if the process did not exit cleanly.
+**********************************************************************/
+void PrvRecorderClose(void);
+
+
+/*********************************************************************/
+/* PrvRecorderWrite */
+/**
+@brief  Captures the message into the flight recorder ring.  This is
+		lock-free and async-signal-safe.  flags are the
+		kPmLogRingSlotFlag_xxx flags.
+**********************************************************************/
+void PrvRecorderWrite(uint64_t timeNs, const char* component,
+	PmLogLevel level, const char* s, size_t sLen, int flags);
+
+
+//#####################################################################
+
+
+// Async-signal-safe output (PmLogSignalSafe.c)
+
+
+/*********************************************************************/
+/* PrvSafeVFormat */
+/**
+@brief  Minimal async-signal-safe vsnprintf, supporting integers, hex,
+		pointers, strings and characters.  Returns the output length.
+**********************************************************************/
+size_t PrvSafeVFormat(char* buff, size_t buffSize, const char* fmt,
+	va_list args);
+
+
+// the syslog daemon's socket
+#define PMLOG_SYSLOG_SOCKET_PATH	"/dev/log"
+
+
+/*********************************************************************/
+/* PrvSafeLogWrite */
+/**
+@brief  Sends the message in syslog format, with an RFC 3339 time
+		stamp unless timeNs is 0, straight to the datagram socket at
+		sockPath unless that is NULL, and echoes it to consoleFd unless
+		that is -1.  This is lock-free and async-signal-safe.
+**********************************************************************/
+bool PrvSafeLogWrite(int pri, uint64_t timeNs, const char* component,
+	const char* s, size_t sLen, const char* sockPath, int consoleFd);
+
+
+/*********************************************************************/
+/* PrvSyslogPri */
+/**
+@brief  Returns the syslog priority for a message at the given level
+		from a context with the given facility, for the paths that write
+		the syslog format themselves.  The default facility (0) is
+		LOG_USER, as for syslog(3) without openlog().
+**********************************************************************/
+static inline int PrvSyslogPri(int facility, int level)
+{
+	return ((facility != 0) ? facility : LOG_USER) | level;
+}
+
+
+//#####################################################################
+
+
+// Time stamps (PmLogTime.c)
+
+
+/*********************************************************************/
+/* PrvTimeNowNs */
+/**
+@brief  Returns the time stamp for a message, as CLOCK_REALTIME
+		nanoseconds, extrapolated from the TSC if useTsc is set and the
+		CPU allows.  Lock-free and async-signal-safe.
+**********************************************************************/
+uint64_t PrvTimeNowNs(bool useTsc);
+
+
+/*********************************************************************/
+/* PrvTimeForkChild */
+/**
+@brief  Resets the time source state in a forked child.
+**********************************************************************/
+void PrvTimeForkChild(void);
+
+
+//#####################################################################
+
+
+// Hashing (PmLogHash.c)
+
+
+/*********************************************************************/
+/* PrvHash64 */
+/**
+@brief  Returns the XXH64 hash of len bytes at data, with seed 0.
+**********************************************************************/
+uint64_t PrvHash64(const void* data, size_t len);
+
+
+//#####################################################################
+
+
+// Direct file output (PmLogFileSink.c)
+
+
+/*********************************************************************/
+/* PrvFileSinkWrite */
+/**
+@brief  Appends the given pieces as one record to the shared log file,
+		opening it on first use, and rotates it when the size or age
+		limit is reached.  now is the current CLOCK_REALTIME seconds.
+**********************************************************************/
+void PrvFileSinkWrite(PmLogFileConf* confP, const struct iovec* iov,
+	int iovCount, int64_t now);
+
+
+/*********************************************************************/
+/* PrvFileSinkQueue */
+/**
+@brief  Block mode counterpart of PrvFileSinkWrite: copies the record
+		into the staging block for the writer thread, which compresses
+		and appends it.  Never waits for compression or I/O.  format and
+		codec are kPmLogBlockFormat_ and kPmLogBlockCodec_ values, timeNs
+		is the CLOCK_REALTIME of the record and contextId the
+		PmLogPrvContextId of its context.
+**********************************************************************/
+void PrvFileSinkQueue(PmLogFileConf* confP, int format, int codec,
+	const struct iovec* iov, int iovCount, uint64_t timeNs,
+	uint32_t contextId);
+
+
+/*********************************************************************/
+/* PrvFileSinkClose */
+/**
+@brief  Writes out any staged records, stops the writer thread, and
+		closes this process's file descriptor for the log file.
+**********************************************************************/
+void PrvFileSinkClose(void);
+
+
+/*********************************************************************/
+/* PrvFileSinkHasThread */
+/**
+@brief  Returns true if the block mode writer thread is running.
+**********************************************************************/
+bool PrvFileSinkHasThread(void);
+
+
+/*********************************************************************/
+/* PrvFileSinkReset */
+/**
+@brief  Lets the log file be written again after PrvFileSinkClose.
+**********************************************************************/
+void PrvFileSinkReset(void);
+
+
+/*********************************************************************/
+/* PrvFileSinkForkPrepare, PrvFileSinkForkParent, PrvFileSinkForkChild */
+/**
+@brief  fork() handlers: quiesce the staging of records before the
+		fork, and resume it in the parent, or reset it in the child,
+		which has no writer thread.
+**********************************************************************/
+void PrvFileSinkForkPrepare(void);
+void PrvFileSinkForkParent(void);
+void PrvFileSinkForkChild(void);
+
+
+//#####################################################################
+
+
+// Sinks (PmLogSinks.c)
+
+
+/*********************************************************************/
+/* PrvSinkMsg */
+/**
+@brief  A message on its way to the sinks: what custom sinks see, plus
+		what the built-in sinks share.  facility is the context's syslog
+		facility, or 0 for the default.  pidStr is "[pid]: ",
+		"[pid:tid]: " or empty, and componentStr is "{component}: " or
+		empty for the global context.
+**********************************************************************/
+typedef struct
+{
+	PmLogSinkMsg	pub;
+	int				facility;
+	const char*		identStr;
+	const char*		pidStr;
+	const char*		componentStr;
+}
+PrvSinkMsg;
+
+
+/*********************************************************************/
+/* PrvSinkGetDispatch */
+/**
+@brief  Returns the set of sinks that take the given level, as a bit
+		mask of sink ids, first bringing it up to date with the
+		configuration.
+**********************************************************************/
+uint32_t PrvSinkGetDispatch(const PmLogGlobals* globalsP, PmLogLevel level);
+
+
+/*********************************************************************/
+/* PrvSinkRebuild */
+/**
+@brief  Rebuilds the sink dispatch for the given globals, e.g. on
+		attaching to another namespace.
+**********************************************************************/
+void PrvSinkRebuild(const PmLogGlobals* globalsP);
+
+
+/*********************************************************************/
+/* PrvSinkRawMask */
+/**
+@brief  Returns the set of sinks that can take raw binary messages
+		(kPmLogSinkMsgFlag_Raw), as a bit mask of sink ids.
+**********************************************************************/
+uint32_t PrvSinkRawMask(const PmLogGlobals* globalsP);
+
+
+/*********************************************************************/
+/* PrvSinkPeekDispatch */
+/**
+@brief  Same as PrvSinkGetDispatch, but lock-free and without updating.
+		For use from signal handlers.
+**********************************************************************/
+uint32_t PrvSinkPeekDispatch(PmLogLevel level);
+
+
+/*********************************************************************/
+/* PrvSinkDispatch */
+/**
+@brief  Passes the message to each sink in the given set.
+**********************************************************************/
+void PrvSinkDispatch(PmLogGlobals* globalsP, uint32_t sinks,
+	const PrvSinkMsg* msgP);
+
+
+/*********************************************************************/
+/* PrvSinkForkPrepare, PrvSinkForkParent, PrvSinkForkChild */
+/**
+@brief  fork() handlers: wait for the calls to syslog(3) and sink
+		changes in progress before the fork, and resume them after.
+**********************************************************************/
+void PrvSinkForkPrepare(void);
+void PrvSinkForkParent(void);
+void PrvSinkForkChild(void);
+
+
+#endif // PMLOGLIBINT_H
@@ -0,0 +1,559 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Async-signal-safe formatting and output, for use by
+*		  PmLogPrintSignalSafe_.  Only routines listed as async-signal-safe
+*		  by POSIX are called here, and no locks are taken.
+*
+* @file PmLogSignalSafe.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLibInt.h"
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+
+// take advantage of glibc
+extern const char*	__progname;
+
+
+// unbound datagram socket for sending to the syslog daemon and other
+// receivers, opened on first use
+static int	gSafeSockFd	= -1;
+
+
+/*********************************************************************/
+/* PrvSafeBuff */
+/**
+@brief  Bounded output buffer.  Appends past the end are dropped.
+**********************************************************************/
+typedef struct
+{
+	char*	data;
+	size_t	size;
+	size_t	len;
+}
+PrvSafeBuff;
+
+
+/*********************************************************************/
+/* PrvSafePut */
+/**
+@brief  Append bytes to the buffer, keeping room for a terminator.
+**********************************************************************/
+static void PrvSafePut(PrvSafeBuff* buffP, const char* s, size_t n)
+{
+	size_t	avail;
+
+	avail = buffP->size - 1 - buffP->len;
+	if (n > avail)
+	{
+		n = avail;
+	}
+
+	memcpy(buffP->data + buffP->len, s, n);
+	buffP->len += n;
+}
+
+
+/*********************************************************************/
+/* PrvSafePutPadded */
+/**
+@brief  Append a converted field, padded to the given width.
+**********************************************************************/
+static void PrvSafePutPadded(PrvSafeBuff* buffP, const char* s, size_t n,
+	size_t width, bool zeroPad, bool leftAlign)
+{
+	char	pad;
+
+	pad = zeroPad ? '0' : ' ';
+
+	// zero padding goes after any sign
+	if (zeroPad && (n > 0) && (s[ 0 ] == '-'))
+	{
+		PrvSafePut(buffP, s, 1);
+		s++;
+		n--;
+		if (width > 0)
+		{
+			width--;
+		}
+	}
+
+	while (!leftAlign && (width > n))
+	{
+		PrvSafePut(buffP, &pad, 1);
+		width--;
+	}
+
+	PrvSafePut(buffP, s, n);
+
+	while (leftAlign && (width > n))
+	{
+		PrvSafePut(buffP, " ", 1);
+		width--;
+	}
+}
+
+
+/*********************************************************************/
+/* PrvSafeUIntToStr */
+/**
+@brief  Convert an unsigned value to text at the end of the given
+		buffer.  Returns a pointer to the first character.
+**********************************************************************/
+static char* PrvSafeUIntToStr(unsigned long long v, unsigned base,
+	bool upper, char* buffEnd)
+{
+	const char* digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+
+	char*	p;
+
+	p = buffEnd;
+	do
+	{
+		*--p = digits[ v % base ];
+		v /= base;
+	}
+	while (v != 0);
+
+	return p;
+}
+
+
+/*********************************************************************/
+/* PrvSafeVFormat */
+/**
+@brief  Minimal async-signal-safe vsnprintf.  Supports the flags '-'
+		and '0', a decimal field width, the length modifiers hh, h, l,
+		ll, z, j and t, and the conversions d i u x X o p s c %.
+		Any other conversion is copied to the output as is, without
+		consuming an argument.  The output is always terminated and
+		is truncated to fit.  Returns the output length.
+**********************************************************************/
+size_t PrvSafeVFormat(char* buff, size_t buffSize, const char* fmt,
+	va_list args)
+{
+	PrvSafeBuff			out;
+	const char*			specP;
+	char				numBuff[ 24 ];
+	char*				numEnd;
+	char*				s;
+	size_t				width;
+	bool				zeroPad;
+	bool				leftAlign;
+	int					longCount;
+	bool				sizeArg;
+	long long			sv;
+	unsigned long long	uv;
+	char				c;
+
+	if ((buff == NULL) || (buffSize < 1))
+	{
+		return 0;
+	}
+
+	out.data = buff;
+	out.size = buffSize;
+	out.len = 0;
+
+	numEnd = numBuff + sizeof(numBuff);
+
+	while (*fmt != 0)
+	{
+		if (*fmt != '%')
+		{
+			specP = fmt;
+			while ((*fmt != 0) && (*fmt != '%'))
+			{
+				fmt++;
+			}
+			PrvSafePut(&out, specP, (size_t) (fmt - specP));
+			continue;
+		}
+
+		specP = fmt++;
+
+		// flags
+		zeroPad = false;
+		leftAlign = false;
+		for (;; fmt++)
+		{
+			if (*fmt == '0')
+				zeroPad = true;
+			else if (*fmt == '-')
+				leftAlign = true;
+			else
+				break;
+		}
+
+		if (leftAlign)
+		{
+			zeroPad = false;
+		}
+
+		// width
+		width = 0;
+		while ((*fmt >= '0') && (*fmt <= '9'))
+		{
+			width = (width * 10) + (size_t) (*fmt++ - '0');
+		}
+
+		// length
+		longCount = 0;
+		sizeArg = false;
+		if (*fmt == 'h')
+		{
+			fmt++;
+			if (*fmt == 'h')
+			{
+				fmt++;
+			}
+		}
+		else if (*fmt == 'l')
+		{
+			fmt++;
+			longCount = 1;
+			if (*fmt == 'l')
+			{
+				fmt++;
+				longCount = 2;
+			}
+		}
+		else if ((*fmt == 'z') || (*fmt == 'j') || (*fmt == 't'))
+		{
+			fmt++;
+			sizeArg = true;
+		}
+
+		switch (*fmt)
+		{
+			case 'd':
+			case 'i':
+				if (sizeArg)
+					sv = (long long) va_arg(args, ptrdiff_t);
+				else if (longCount == 2)
+					sv = va_arg(args, long long);
+				else if (longCount == 1)
+					sv = va_arg(args, long);
+				else
+					sv = va_arg(args, int);
+
+				uv = (sv < 0) ? (0ULL - (unsigned long long) sv)
+					: (unsigned long long) sv;
+				s = PrvSafeUIntToStr(uv, 10, false, numEnd);
+				if (sv < 0)
+				{
+					*--s = '-';
+				}
+				PrvSafePutPadded(&out, s, (size_t) (numEnd - s), width,
+					zeroPad, leftAlign);
+				break;
+
+			case 'u':
+			case 'x':
+			case 'X':
+			case 'o':
+				if (sizeArg)
+					uv = (unsigned long long) va_arg(args, size_t);
+				else if (longCount == 2)
+					uv = va_arg(args, unsigned long long);
+				else if (longCount == 1)
+					uv = va_arg(args, unsigned long);
+				else
+					uv = va_arg(args, unsigned int);
+
+				s = PrvSafeUIntToStr(uv,
+					(*fmt == 'u') ? 10 : (*fmt == 'o') ? 8 : 16,
+					(*fmt == 'X'), numEnd);
+				PrvSafePutPadded(&out, s, (size_t) (numEnd - s), width,
+					zeroPad, leftAlign);
+				break;
+
+			case 'p':
+				uv = (unsigned long long) (uintptr_t) va_arg(args, void*);
+				s = PrvSafeUIntToStr(uv, 16, false, numEnd);
+				*--s = 'x';
+				*--s = '0';
+				PrvSafePutPadded(&out, s, (size_t) (numEnd - s), width,
+					false, leftAlign);
+				break;
+
+			case 's':
+				s = va_arg(args, char*);
+				if (s == NULL)
+				{
+					s = "(null)";
+				}
+				PrvSafePutPadded(&out, s, strlen(s), width, false, leftAlign);
+				break;
+
+			case 'c':
+				c = (char) va_arg(args, int);
+				PrvSafePutPadded(&out, &c, 1, width, false, leftAlign);
+				break;
+
+			case '%':
+				PrvSafePut(&out, "%", 1);
+				break;
+
+			case 0:
+				// dangling '%' at end of format
+				PrvSafePut(&out, specP, (size_t) (fmt - specP));
+				continue;
+
+			default:
+				PrvSafePut(&out, specP, (size_t) (fmt + 1 - specP));
+				break;
+		}
+
+		fmt++;
+	}
+
+	out.data[ out.len ] = 0;
+	return out.len;
+}
+
+
+/*********************************************************************/
+/* PrvSafeGetSocket */
+/**
+@brief  Returns the datagram socket for sending, creating it
+		on first use.  Concurrent first uses race to install their
+		socket; the losers close theirs.
+**********************************************************************/
+static int PrvSafeGetSocket(void)
+{
+	int		fd;
+	int		expected;
+
+	fd = __atomic_load_n(&gSafeSockFd, __ATOMIC_ACQUIRE);
+	if (fd >= 0)
+	{
+		return fd;
+	}
+
+	fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+	{
+		return -1;
+	}
+
+	expected = -1;
+	if (!__atomic_compare_exchange_n(&gSafeSockFd, &expected, fd, false,
+			__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	{
+		(void) close(fd);
+		fd = expected;
+	}
+
+	return fd;
+}
+
+
+/*********************************************************************/
+/* PrvSafePutInt */
+/**
+@brief  Append a decimal integer.
+**********************************************************************/
+static void PrvSafePutInt(PrvSafeBuff* buffP, long long v)
+{
+	char	numBuff[ 24 ];
+	char*	s;
+
+	s = PrvSafeUIntToStr((v < 0) ? (0ULL - (unsigned long long) v)
+		: (unsigned long long) v, 10, false, numBuff + sizeof(numBuff));
+	if (v < 0)
+	{
+		*--s = '-';
+	}
+
+	PrvSafePut(buffP, s, (size_t) (numBuff + sizeof(numBuff) - s));
+}
+
+
+/*********************************************************************/
+/* PrvSafePutUIntPadded */
+/**
+@brief  Append a decimal integer, zero padded to the given width.
+**********************************************************************/
+static void PrvSafePutUIntPadded(PrvSafeBuff* buffP, unsigned long long v,
+	size_t width)
+{
+	char	numBuff[ 24 ];
+	char*	s;
+
+	s = PrvSafeUIntToStr(v, 10, false, numBuff + sizeof(numBuff));
+	PrvSafePutPadded(buffP, s, (size_t) (numBuff + sizeof(numBuff) - s),
+		width, true, false);
+}
+
+
+/*********************************************************************/
+/* PrvSafePutTime */
+/**
+@brief  Append a CLOCK_REALTIME time in nanoseconds as an RFC 3339 UTC
+		time stamp, YYYY-MM-DDTHH:MM:SS.nnnnnnnnnZ.  gmtime_r is not
+		async-signal-safe, so the date is worked out here.
+**********************************************************************/
+static void PrvSafePutTime(PrvSafeBuff* buffP, uint64_t timeNs)
+{
+	uint64_t	secs;
+	uint64_t	days;
+	uint64_t	era;
+	uint64_t	dayOfEra;
+	uint64_t	yearOfEra;
+	uint64_t	dayOfYear;
+	uint64_t	mp;
+	uint64_t	year;
+	uint64_t	month;
+	uint64_t	day;
+
+	secs = timeNs / 1000000000ULL;
+	days = secs / 86400;
+
+	// days since 1970-01-01 to a civil date (the "days_from_civil"
+	// algorithm run backwards), with eras of 400 years from 0000-03-01
+	days += 719468;
+	era = days / 146097;
+	dayOfEra = days - era * 146097;
+	yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 -
+		dayOfEra / 146096) / 365;
+	dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+	mp = (5 * dayOfYear + 2) / 153;
+	day = dayOfYear - (153 * mp + 2) / 5 + 1;
+	month = (mp < 10) ? mp + 3 : mp - 9;
+	year = yearOfEra + era * 400 + ((month <= 2) ? 1 : 0);
+
+	PrvSafePutUIntPadded(buffP, year, 4);
+	PrvSafePut(buffP, "-", 1);
+	PrvSafePutUIntPadded(buffP, month, 2);
+	PrvSafePut(buffP, "-", 1);
+	PrvSafePutUIntPadded(buffP, day, 2);
+	PrvSafePut(buffP, "T", 1);
+	PrvSafePutUIntPadded(buffP, (secs % 86400) / 3600, 2);
+	PrvSafePut(buffP, ":", 1);
+	PrvSafePutUIntPadded(buffP, (secs % 3600) / 60, 2);
+	PrvSafePut(buffP, ":", 1);
+	PrvSafePutUIntPadded(buffP, secs % 60, 2);
+	PrvSafePut(buffP, ".", 1);
+	PrvSafePutUIntPadded(buffP, timeNs % 1000000000ULL, 9);
+	PrvSafePut(buffP, "Z", 1);
+}
+
+
+/*********************************************************************/
+/* PrvSafeLogWrite */
+/**
+@brief  Sends the message straight to the datagram socket at sockPath,
+		typically the syslog daemon's, as
+			<pri>TIME progname[pid]: {component}: text
+		unless sockPath is NULL, and optionally echoes it to the given
+		console file descriptor without the priority and time.  TIME is
+		timeNs as an RFC 3339 time stamp; if timeNs is 0 it is left out,
+		for the receiver to add.  component may be NULL for the global
+		context.  Returns false if the message couldn't be sent.
+**********************************************************************/
+bool PrvSafeLogWrite(int pri, uint64_t timeNs, const char* component,
+	const char* s, size_t sLen, const char* sockPath, int consoleFd)
+{
+	struct sockaddr_un	addr;
+	char				lineBuff[ 1200 ];
+	PrvSafeBuff			line;
+	size_t				headerLen;
+	size_t				sockPathLen;
+	int					fd;
+	ssize_t				n;
+
+	line.data = lineBuff;
+	line.size = sizeof(lineBuff);
+	line.len = 0;
+
+	PrvSafePut(&line, "<", 1);
+	PrvSafePutInt(&line, pri);
+	PrvSafePut(&line, ">", 1);
+
+	if (timeNs != 0)
+	{
+		PrvSafePutTime(&line, timeNs);
+		PrvSafePut(&line, " ", 1);
+	}
+
+	headerLen = line.len;
+
+	PrvSafePut(&line, __progname, strlen(__progname));
+	PrvSafePut(&line, "[", 1);
+	PrvSafePutInt(&line, (long long) getpid());
+	PrvSafePut(&line, "]: ", 3);
+
+	if (component != NULL)
+	{
+		PrvSafePut(&line, "{", 1);
+		PrvSafePut(&line, component, strlen(component));
+		PrvSafePut(&line, "}: ", 3);
+	}
+
+	if ((sLen > 0) && (s[ sLen - 1 ] == '\n'))
+	{
+		sLen--;
+	}
+
+	PrvSafePut(&line, s, sLen);
+
+	if (consoleFd >= 0)
+	{
+		// the console doesn't get the priority prefix
+		lineBuff[ line.len ] = '\n';
+		(void) write(consoleFd, lineBuff + headerLen, line.len - headerLen + 1);
+	}
+
+	if (sockPath == NULL)
+	{
+		return true;
+	}
+
+	sockPathLen = strlen(sockPath);
+	if (sockPathLen >= sizeof(addr.sun_path))
+	{
+		return false;
+	}
+
+	fd = PrvSafeGetSocket();
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, sockPath, sockPathLen + 1);
+
+	n = sendto(fd, lineBuff, line.len, MSG_NOSIGNAL,
+		(const struct sockaddr*) &addr, sizeof(addr));
+
+	return (n == (ssize_t) line.len);
+}
@@ -0,0 +1,819 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Message sinks.  Every output, built-in or registered by the
+*		  client, has a level mask.  The masks are folded into a per-level
+*		  dispatch word, with bit n set if sink n takes that level, so the
+*		  write path only has to walk the set bits.  The dispatch words are
+*		  rebuilt whenever the shared configuration is reloaded or a custom
+*		  sink is changed.
+*
+* @file PmLogSinks.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLibInt.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// total number of sinks, built-in and custom, up to one per dispatch bit
+#define kPrvMaxSinks	32
+
+
+/*********************************************************************/
+/* PrvCustomSink */
+/**
+@brief  A sink registered with PmLogRegisterSink.  The slot is free when
+		func is NULL.  busy counts the calls in progress, so that
+		PmLogUnregisterSink can wait for them.
+**********************************************************************/
+typedef struct
+{
+	PmLogSinkFunc	func;
+	void*			userData;
+	uint32_t		levelMask;
+	int				busy;
+}
+PrvCustomSink;
+
+
+// built-in sink callback
+typedef void (*PrvBuiltInSinkFunc)(PmLogGlobals* globalsP,
+	const PrvSinkMsg* msgP);
+
+
+// per-level dispatch words: bit n set if sink n takes that level
+static uint32_t			gSinkDispatch[ kPmLogLevel_Debug + 1 ];
+
+// the PmLogGlobals.configGeneration gSinkDispatch was built for
+static uint32_t			gSinkConfigGeneration	= 0;
+
+// custom sinks, indexed by sink id; the built-in ids are not used
+static PrvCustomSink	gSinks[ kPrvMaxSinks ];
+
+// serializes rebuilding gSinkDispatch and changing gSinks
+static pthread_mutex_t	gSinkLock		= PTHREAD_MUTEX_INITIALIZER;
+
+// the globals the dispatch words were last built from
+static const PmLogGlobals*	gSinkGlobalsP	= NULL;
+
+// set when a sink changed before the process was attached, so there
+// were no globals to rebuild the dispatch words from; the next
+// PrvSinkGetDispatch rebuilds them
+static int					gSinkStale		= 0;
+
+// held shared around syslog(3), whose internal lock a forked child could
+// otherwise inherit locked, and exclusively across fork().  Writers are
+// preferred so that a busy process can still fork.
+static pthread_rwlock_t	gSyslogLock		=
+	PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+
+
+/*********************************************************************/
+/* PrvSinkMsgText */
+/**
+@brief  Returns the text of the message for the sinks that write text,
+		with its length in *lenP.  An encoded structured record is
+		rendered into textBuff, which must be PMLOG_KV_TEXT_BUFF_SIZE
+		bytes; other messages are returned as they are.
+**********************************************************************/
+static const char* PrvSinkMsgText(const PmLogGlobals* globalsP,
+	const PrvSinkMsg* msgP, char* textBuff, size_t* lenP)
+{
+	bool	json;
+
+	if (!(msgP->pub.flags & kPmLogSinkMsgFlag_KV))
+	{
+		*lenP = msgP->pub.msgLen;
+		return msgP->pub.msg;
+	}
+
+	json = ((PrvGlobalsFlags(globalsP) & kPmLogGlobalsFlag_KVFormatJson) != 0);
+
+	// a malformed record can't come from PmLogKV_, so just show what
+	// could be rendered
+	(void) PmLogPrvKVRender(msgP->pub.msg, msgP->pub.msgLen, json, textBuff,
+		PMLOG_KV_TEXT_BUFF_SIZE);
+
+	*lenP = strlen(textBuff);
+	return textBuff;
+}
+
+
+/*********************************************************************/
+/* PrvSinkRingWrite */
+/**
+@brief  Built-in sink for the flight recorder.  Structured records are
+		kept encoded, for pmlogfr to render.
+**********************************************************************/
+static void PrvSinkRingWrite(PmLogGlobals* globalsP, const PrvSinkMsg* msgP)
+{
+	(void) globalsP;
+
+	PrvRecorderWrite(msgP->pub.timeNs, (msgP->pub.component != NULL)
+			? msgP->pub.component
+			: kPmLogGlobalContextName,
+		msgP->pub.level, msgP->pub.msg, msgP->pub.msgLen,
+		(msgP->pub.flags & kPmLogSinkMsgFlag_KV) ? kPmLogRingSlotFlag_KV : 0);
+}
+
+
+/*********************************************************************/
+/* PrvSinkSyslogWrite */
+/**
+@brief  Built-in sink for syslog, with the context's facility in the
+		priority.  With SyslogTimestamps set, the message is sent to
+		the daemon directly with its own RFC 3339 time stamp, instead
+		of through syslog(3), which stamps it with the current second.
+**********************************************************************/
+static void PrvSinkSyslogWrite(PmLogGlobals* globalsP, const PrvSinkMsg* msgP)
+{
+	char		textBuff[ PMLOG_KV_TEXT_BUFF_SIZE ];
+	const char*	textP;
+	size_t		textLen;
+
+	textP = PrvSinkMsgText(globalsP, msgP, textBuff, &textLen);
+
+	if (PrvGlobalsFlags(globalsP) & kPmLogGlobalsFlag_SyslogTimestamps)
+	{
+		(void) PrvSafeLogWrite(PrvSyslogPri(msgP->facility, msgP->pub.level),
+			msgP->pub.timeNs, msgP->pub.component, textP, textLen,
+			PMLOG_SYSLOG_SOCKET_PATH, -1);
+		return;
+	}
+
+	// a facility of 0 leaves syslog(3) to use the openlog() default
+	(void) pthread_rwlock_rdlock(&gSyslogLock);
+	syslog(msgP->facility | msgP->pub.level, "%s%s%.*s",
+		msgP->pidStr, msgP->componentStr, (int) textLen, textP);
+	(void) pthread_rwlock_unlock(&gSyslogLock);
+}
+
+
+/*********************************************************************/
+/* PrvSinkSocketWrite */
+/**
+@brief  Built-in sink for a syslog-style datagram socket other than the
+		syslog daemon's, e.g. a log collector.
+**********************************************************************/
+static void PrvSinkSocketWrite(PmLogGlobals* globalsP, const PrvSinkMsg* msgP)
+{
+	char		textBuff[ PMLOG_KV_TEXT_BUFF_SIZE ];
+	const char*	textP;
+	size_t		textLen;
+
+	textP = PrvSinkMsgText(globalsP, msgP, textBuff, &textLen);
+
+	(void) PrvSafeLogWrite(PrvSyslogPri(msgP->facility, msgP->pub.level),
+		msgP->pub.timeNs, msgP->pub.component, textP, textLen,
+		globalsP->socketPath, -1);
+}
+
+
+/*********************************************************************/
+/* PrvSinkFileWriteBinary */
+/**
+@brief  Stages the message as a PmLogBinRecord for the log file writer
+		thread.
+**********************************************************************/
+static void PrvSinkFileWriteBinary(PmLogGlobals* globalsP,
+	const PrvSinkMsg* msgP, uint64_t timeNs, uint32_t contextId, int codec)
+{
+	PmLogBinRecord	rec;
+	size_t			identLen;
+	size_t			componentLen;
+	struct iovec	iov[ 4 ];
+
+	identLen = strlen(msgP->identStr);
+	if (identLen > UINT8_MAX)
+	{
+		identLen = UINT8_MAX;
+	}
+
+	componentLen = (msgP->pub.component != NULL)
+		? strlen(msgP->pub.component)
+		: 0;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.recordLen = (uint32_t) (sizeof(rec) + identLen + componentLen +
+		msgP->pub.msgLen);
+	rec.contextId = contextId;
+	rec.timeNs = timeNs;
+	rec.pid = (int32_t) getpid();
+	rec.tid = (int32_t) gettid();
+	rec.level = (uint8_t) msgP->pub.level;
+	rec.identLen = (uint8_t) identLen;
+	rec.componentLen = (uint8_t) componentLen;
+	rec.flags = 0;
+	if (msgP->pub.flags & kPmLogSinkMsgFlag_Raw)
+	{
+		rec.flags |= kPmLogBinRecordFlag_Raw;
+	}
+	if (msgP->pub.flags & kPmLogSinkMsgFlag_Elevated)
+	{
+		rec.flags |= kPmLogBinRecordFlag_Elevated;
+	}
+	if (msgP->pub.flags & kPmLogSinkMsgFlag_KV)
+	{
+		rec.flags |= kPmLogBinRecordFlag_KV;
+	}
+
+	iov[ 0 ].iov_base = &rec;
+	iov[ 0 ].iov_len = sizeof(rec);
+	iov[ 1 ].iov_base = (void*) msgP->identStr;
+	iov[ 1 ].iov_len = identLen;
+	iov[ 2 ].iov_base = (void*) msgP->pub.component;
+	iov[ 2 ].iov_len = componentLen;
+	iov[ 3 ].iov_base = (void*) msgP->pub.msg;
+	iov[ 3 ].iov_len = msgP->pub.msgLen;
+
+	PrvFileSinkQueue(&globalsP->fileConf, kPmLogBlockFormat_Binary, codec,
+		iov, 4, timeNs, contextId);
+}
+
+
+/*********************************************************************/
+/* PrvSinkFileWrite */
+/**
+@brief  Built-in sink for the log file.  Appends
+			TIME LEVEL ident[pid]: {component}: message
+		with a UTC time stamp in nanoseconds, or stages it for the
+		writer thread in block mode, as text or as a binary record.
+**********************************************************************/
+static void PrvSinkFileWrite(PmLogGlobals* globalsP, const PrvSinkMsg* msgP)
+{
+	time_t			secs;
+	struct tm		tm;
+	char			timeStr[ 48 ];
+	size_t			n;
+	const char*		levelStr;
+	const char*		ptidStr;
+	const char*		contextName;
+	uint64_t		timeNs;
+	uint32_t		contextId;
+	int				codec;
+	char			textBuff[ PMLOG_KV_TEXT_BUFF_SIZE ];
+	const char*		textP;
+	size_t			textLen;
+	struct iovec	iov[ 8 ];
+
+	timeNs = msgP->pub.timeNs;
+	secs = (time_t) (timeNs / 1000000000);
+
+	contextName = (msgP->pub.component != NULL)
+		? msgP->pub.component
+		: kPmLogGlobalContextName;
+	contextId = PmLogPrvContextId(contextName, strlen(contextName));
+
+	codec = (PrvGlobalsFlags(globalsP) & kPmLogGlobalsFlag_FileCompress)
+		? kPmLogBlockCodec_LZ4
+		: kPmLogBlockCodec_None;
+
+	if (PrvGlobalsFlags(globalsP) & kPmLogGlobalsFlag_FileBinary)
+	{
+		PrvSinkFileWriteBinary(globalsP, msgP, timeNs, contextId, codec);
+		return;
+	}
+
+	if (gmtime_r(&secs, &tm) == NULL)
+	{
+		return;
+	}
+
+	n = strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%S", &tm);
+	(void) snprintf(timeStr + n, sizeof(timeStr) - n, ".%09uZ ",
+		(unsigned) (timeNs % 1000000000));
+
+	levelStr = PmLogLevelToString(msgP->pub.level);
+	if (levelStr == NULL)
+	{
+		levelStr = "?";
+	}
+
+	ptidStr = (msgP->pidStr[ 0 ] != 0) ? msgP->pidStr : ": ";
+
+	textP = PrvSinkMsgText(globalsP, msgP, textBuff, &textLen);
+
+	iov[ 0 ].iov_base = timeStr;
+	iov[ 0 ].iov_len = strlen(timeStr);
+	iov[ 1 ].iov_base = (void*) levelStr;
+	iov[ 1 ].iov_len = strlen(levelStr);
+	iov[ 2 ].iov_base = (void*) " ";
+	iov[ 2 ].iov_len = 1;
+	iov[ 3 ].iov_base = (void*) msgP->identStr;
+	iov[ 3 ].iov_len = strlen(msgP->identStr);
+	iov[ 4 ].iov_base = (void*) ptidStr;
+	iov[ 4 ].iov_len = strlen(ptidStr);
+	iov[ 5 ].iov_base = (void*) msgP->componentStr;
+	iov[ 5 ].iov_len = strlen(msgP->componentStr);
+	iov[ 6 ].iov_base = (void*) textP;
+	iov[ 6 ].iov_len = textLen;
+	iov[ 7 ].iov_base = (void*) "\n";
+	iov[ 7 ].iov_len = 1;
+
+	if (codec != kPmLogBlockCodec_None)
+	{
+		PrvFileSinkQueue(&globalsP->fileConf, kPmLogBlockFormat_Text, codec,
+			iov, 8, timeNs, contextId);
+	}
+	else
+	{
+		PrvFileSinkWrite(&globalsP->fileConf, iov, 8, (int64_t) secs);
+	}
+}
+
+
+/*********************************************************************/
+/* PrvSinkConsoleWrite */
+/**
+@brief  Echos the logged info + message to the output.
+**********************************************************************/
+static void PrvSinkConsoleWrite(const PmLogGlobals* globalsP, FILE* out,
+	const PrvSinkMsg* msgP)
+{
+	char		textBuff[ PMLOG_KV_TEXT_BUFF_SIZE ];
+	const char*	textP;
+	size_t		textLen;
+
+	textP = PrvSinkMsgText(globalsP, msgP, textBuff, &textLen);
+
+	fprintf(out, "%s%s%s%.*s\n", msgP->identStr,
+		(msgP->pidStr[ 0 ] != 0) ? msgP->pidStr : ": ",
+		msgP->componentStr, (int) textLen, textP);
+}
+
+
+/*********************************************************************/
+/* PrvSinkStdErrWrite */
+/**
+@brief  Built-in sink for stderr.
+**********************************************************************/
+static void PrvSinkStdErrWrite(PmLogGlobals* globalsP, const PrvSinkMsg* msgP)
+{
+	PrvSinkConsoleWrite(globalsP, stderr, msgP);
+}
+
+
+/*********************************************************************/
+/* PrvSinkStdOutWrite */
+/**
+@brief  Built-in sink for stdout.
+**********************************************************************/
+static void PrvSinkStdOutWrite(PmLogGlobals* globalsP, const PrvSinkMsg* msgP)
+{
+	PrvSinkConsoleWrite(globalsP, stdout, msgP);
+}
+
+
+/***********************************************************************
+ * kBuiltInSinks
+ *
+ * Indexed by kPmLogSink_xxx.
+ ***********************************************************************/
+static const PrvBuiltInSinkFunc kBuiltInSinks[ kPmLogSink_NumBuiltIn ] =
+{
+	PrvSinkRingWrite,
+	PrvSinkSyslogWrite,
+	PrvSinkSocketWrite,
+	PrvSinkFileWrite,
+	PrvSinkStdErrWrite,
+	PrvSinkStdOutWrite
+};
+
+
+/*********************************************************************/
+/* PrvSinkBuiltInLevels */
+/**
+@brief  Returns the level mask of a built-in sink, or 0 if the sink
+		is turned off.
+**********************************************************************/
+static uint32_t PrvSinkBuiltInLevels(const PmLogGlobals* globalsP, int sink)
+{
+	int		flag;
+
+	switch (sink)
+	{
+		case kPmLogSink_Ring:
+			// the recorder runs per process, and may have failed to start
+			if (PmLogLoadRelaxed_(&PmLogRecordLevel_) < kPmLogLevel_Emergency)
+			{
+				return 0;
+			}
+			return globalsP->sinkLevels[ sink ];
+
+		case kPmLogSink_Syslog:
+			flag = kPmLogGlobalsFlag_LogToSyslog;
+			break;
+
+		case kPmLogSink_Socket:
+			flag = kPmLogGlobalsFlag_LogToSocket;
+			break;
+
+		case kPmLogSink_File:
+			flag = kPmLogGlobalsFlag_LogToFile;
+			break;
+
+		default:
+			flag = kPmLogGlobalsFlag_LogToConsole;
+			break;
+	}
+
+	return (PrvGlobalsFlags(globalsP) & flag) ? globalsP->sinkLevels[ sink ] : 0;
+}
+
+
+/*********************************************************************/
+/* PrvSinkRebuildLocked */
+/**
+@brief  Recomputes the per-level dispatch words.  The caller must hold
+		gSinkLock.  Each word is stored atomically, so a concurrent
+		writer sees either the old or the new set for its level.
+		Without globals, the words are only marked stale.
+**********************************************************************/
+static void PrvSinkRebuildLocked(const PmLogGlobals* globalsP)
+{
+	uint32_t	dispatch[ kPmLogLevel_Debug + 1 ];
+	uint32_t	levels;
+	uint32_t	generation;
+	int			sink;
+	int			level;
+
+	if (globalsP == NULL)
+	{
+		__atomic_store_n(&gSinkStale, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	gSinkGlobalsP = globalsP;
+
+	generation = __atomic_load_n(&globalsP->configGeneration, __ATOMIC_ACQUIRE);
+
+	memset(dispatch, 0, sizeof(dispatch));
+
+	for (sink = 0; sink < kPrvMaxSinks; sink++)
+	{
+		if (sink < kPmLogSink_NumBuiltIn)
+		{
+			levels = PrvSinkBuiltInLevels(globalsP, sink);
+		}
+		else if (gSinks[ sink ].func != NULL)
+		{
+			levels = gSinks[ sink ].levelMask;
+		}
+		else
+		{
+			levels = 0;
+		}
+
+		for (level = kPmLogLevel_Emergency; level <= kPmLogLevel_Debug; level++)
+		{
+			if (levels & PMLOG_LEVEL_MASK(level))
+			{
+				dispatch[ level ] |= (1u << sink);
+			}
+		}
+	}
+
+	for (level = kPmLogLevel_Emergency; level <= kPmLogLevel_Debug; level++)
+	{
+		__atomic_store_n(&gSinkDispatch[ level ], dispatch[ level ],
+			__ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&gSinkStale, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&gSinkConfigGeneration, generation, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvSinkRebuild */
+/**
+@brief  Builds the dispatch words for the given globals, whatever they
+		were last built for.
+**********************************************************************/
+void PrvSinkRebuild(const PmLogGlobals* globalsP)
+{
+	(void) pthread_mutex_lock(&gSinkLock);
+	PrvSinkRebuildLocked(globalsP);
+	(void) pthread_mutex_unlock(&gSinkLock);
+}
+
+
+/*********************************************************************/
+/* PrvSinkGetDispatch */
+/**
+@brief  Returns the set of sinks that take the given level, first
+		bringing the dispatch words up to date with the configuration
+		and with any sink changed before the process was attached.
+**********************************************************************/
+uint32_t PrvSinkGetDispatch(const PmLogGlobals* globalsP, PmLogLevel level)
+{
+	if ((__atomic_load_n(&globalsP->configGeneration, __ATOMIC_RELAXED) !=
+		__atomic_load_n(&gSinkConfigGeneration, __ATOMIC_ACQUIRE)) ||
+		__atomic_load_n(&gSinkStale, __ATOMIC_RELAXED))
+	{
+		(void) pthread_mutex_lock(&gSinkLock);
+		PrvSinkRebuildLocked(globalsP);
+		(void) pthread_mutex_unlock(&gSinkLock);
+	}
+
+	return __atomic_load_n(&gSinkDispatch[ level ], __ATOMIC_RELAXED);
+}
+
+
+/*********************************************************************/
+/* PrvSinkPeekDispatch */
+/**
+@brief  Returns the set of sinks that take the given level as last
+		built, without taking any lock.  For use from signal handlers.
+**********************************************************************/
+uint32_t PrvSinkPeekDispatch(PmLogLevel level)
+{
+	return __atomic_load_n(&gSinkDispatch[ level ], __ATOMIC_RELAXED);
+}
+
+
+/*********************************************************************/
+/* PrvSinkRawMask */
+/**
+@brief  Returns the set of sinks that can take raw binary messages:
+		the custom sinks, and the log file when it holds binary records.
+**********************************************************************/
+uint32_t PrvSinkRawMask(const PmLogGlobals* globalsP)
+{
+	uint32_t	mask;
+
+	mask = ~((1u << kPmLogSink_NumBuiltIn) - 1u);
+
+	if (PrvGlobalsFlags(globalsP) & kPmLogGlobalsFlag_FileBinary)
+	{
+		mask |= (1u << kPmLogSink_File);
+	}
+
+	return mask;
+}
+
+
+/*********************************************************************/
+/* PrvSinkCallCustom */
+/**
+@brief  Calls a custom sink, unless it is being unregistered.
+**********************************************************************/
+static void PrvSinkCallCustom(PrvCustomSink* sinkP, const PrvSinkMsg* msgP)
+{
+	PmLogSinkFunc	func;
+
+	// pairs with PmLogUnregisterSink clearing func then checking busy
+	(void) __atomic_add_fetch(&sinkP->busy, 1, __ATOMIC_SEQ_CST);
+
+	func = __atomic_load_n(&sinkP->func, __ATOMIC_SEQ_CST);
+	if ((func != NULL) &&
+		(__atomic_load_n(&sinkP->levelMask, __ATOMIC_RELAXED) &
+			PMLOG_LEVEL_MASK(msgP->pub.level)))
+	{
+		func(sinkP->userData, &msgP->pub);
+	}
+
+	(void) __atomic_sub_fetch(&sinkP->busy, 1, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvSinkDispatch */
+/**
+@brief  Passes the message to each sink in the given set, in sink id
+		order.
+**********************************************************************/
+void PrvSinkDispatch(PmLogGlobals* globalsP, uint32_t sinks,
+	const PrvSinkMsg* msgP)
+{
+	int		sink;
+
+	while (sinks != 0)
+	{
+		sink = __builtin_ctz(sinks);
+		sinks &= sinks - 1;
+
+		if (sink < kPmLogSink_NumBuiltIn)
+		{
+			kBuiltInSinks[ sink ](globalsP, msgP);
+		}
+		else
+		{
+			PrvSinkCallCustom(&gSinks[ sink ], msgP);
+		}
+	}
+}
+
+
+/*********************************************************************/
+/* PrvSinkForkPrepare */
+/**
+@brief  Waits for the calls to syslog(3) and the sink changes in
+		progress, and holds off new ones until the fork is done.
+**********************************************************************/
+void PrvSinkForkPrepare(void)
+{
+	(void) pthread_rwlock_wrlock(&gSyslogLock);
+	(void) pthread_mutex_lock(&gSinkLock);
+}
+
+
+/*********************************************************************/
+/* PrvSinkForkParent */
+/**
+@brief  Lets the parent carry on after fork().
+**********************************************************************/
+void PrvSinkForkParent(void)
+{
+	(void) pthread_mutex_unlock(&gSinkLock);
+	(void) pthread_rwlock_unlock(&gSyslogLock);
+}
+
+
+/*********************************************************************/
+/* PrvSinkForkChild */
+/**
+@brief  Lets the child carry on after fork().  The calls to custom
+		sinks that were running on other threads never finish in the
+		child, so they are forgotten.  The locks are made anew, as the
+		child's thread is not the one that took them.
+**********************************************************************/
+void PrvSinkForkChild(void)
+{
+	int		sinkId;
+
+	for (sinkId = kPmLogSink_NumBuiltIn; sinkId < kPrvMaxSinks; sinkId++)
+	{
+		__atomic_store_n(&gSinks[ sinkId ].busy, 0, __ATOMIC_RELAXED);
+	}
+
+	(void) pthread_mutex_init(&gSinkLock, NULL);
+	gSyslogLock = (pthread_rwlock_t)
+		PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
+}
+
+
+/*********************************************************************/
+/* PrvSinkIsValidId */
+/**
+@brief  Returns true if sinkId refers to a registered custom sink.
+		The caller must hold gSinkLock.
+**********************************************************************/
+static bool PrvSinkIsValidId(int sinkId)
+{
+	return (sinkId >= kPmLogSink_NumBuiltIn) && (sinkId < kPrvMaxSinks) &&
+		(gSinks[ sinkId ].func != NULL);
+}
+
+
+/*********************************************************************/
+/* PmLogRegisterSink */
+/**
+@brief  Adds a sink that receives this process's messages at the
+		levels in levelMask, in addition to the configured outputs.
+		Returns an id for PmLogSetSinkLevels and PmLogUnregisterSink.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+			kPmLogErr_TooManySinks
+**********************************************************************/
+PmLogErr PmLogRegisterSink(uint32_t levelMask, PmLogSinkFunc sinkFunc,
+	void* userData, int* sinkIdP)
+{
+	int			sinkId;
+	PmLogErr	logErr;
+
+	if ((sinkFunc == NULL) || (sinkIdP == NULL) ||
+		(levelMask & ~PMLOG_LEVEL_MASK_ALL))
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	logErr = kPmLogErr_TooManySinks;
+
+	(void) pthread_mutex_lock(&gSinkLock);
+
+	for (sinkId = kPmLogSink_NumBuiltIn; sinkId < kPrvMaxSinks; sinkId++)
+	{
+		// skip slots whose previous callback may still be running
+		if ((gSinks[ sinkId ].func == NULL) &&
+			(__atomic_load_n(&gSinks[ sinkId ].busy, __ATOMIC_ACQUIRE) == 0))
+		{
+			gSinks[ sinkId ].userData = userData;
+			gSinks[ sinkId ].levelMask = levelMask;
+			__atomic_store_n(&gSinks[ sinkId ].func, sinkFunc,
+				__ATOMIC_RELEASE);
+
+			PrvSinkRebuildLocked(gSinkGlobalsP);
+
+			*sinkIdP = sinkId;
+			logErr = kPmLogErr_None;
+			break;
+		}
+	}
+
+	(void) pthread_mutex_unlock(&gSinkLock);
+
+	return logErr;
+}
+
+
+/*********************************************************************/
+/* PmLogSetSinkLevels */
+/**
+@brief  Changes the level mask of a registered sink.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogSetSinkLevels(int sinkId, uint32_t levelMask)
+{
+	PmLogErr	logErr;
+
+	if (levelMask & ~PMLOG_LEVEL_MASK_ALL)
+	{
+		return kPmLogErr_InvalidParameter;
+	}
+
+	logErr = kPmLogErr_InvalidParameter;
+
+	(void) pthread_mutex_lock(&gSinkLock);
+
+	if (PrvSinkIsValidId(sinkId))
+	{
+		__atomic_store_n(&gSinks[ sinkId ].levelMask, levelMask,
+			__ATOMIC_RELAXED);
+		PrvSinkRebuildLocked(gSinkGlobalsP);
+		logErr = kPmLogErr_None;
+	}
+
+	(void) pthread_mutex_unlock(&gSinkLock);
+
+	return logErr;
+}
+
+
+/*********************************************************************/
+/* PmLogUnregisterSink */
+/**
+@brief  Removes a registered sink.  On return the callback is no
+		longer running on any thread, so its userData may be freed.
+		Must not be called from the sink's own callback.
+
+@return Error code:
+			kPmLogErr_None
+			kPmLogErr_InvalidParameter
+**********************************************************************/
+PmLogErr PmLogUnregisterSink(int sinkId)
+{
+	PrvCustomSink*	sinkP;
+
+	(void) pthread_mutex_lock(&gSinkLock);
+
+	if (!PrvSinkIsValidId(sinkId))
+	{
+		(void) pthread_mutex_unlock(&gSinkLock);
+		return kPmLogErr_InvalidParameter;
+	}
+
+	sinkP = &gSinks[ sinkId ];
+	__atomic_store_n(&sinkP->func, NULL, __ATOMIC_SEQ_CST);
+	PrvSinkRebuildLocked(gSinkGlobalsP);
+
+	(void) pthread_mutex_unlock(&gSinkLock);
+
+	// wait out calls that had already picked up the sink
+	while (__atomic_load_n(&sinkP->busy, __ATOMIC_SEQ_CST) != 0)
+	{
+		(void) sched_yield();
+	}
+
+	return kPmLogErr_None;
+}
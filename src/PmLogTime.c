@@ -0,0 +1,345 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Message time stamps.  Normally CLOCK_REALTIME, which glibc reads
+*		  through the vDSO without a system call.  In TSC mode, on x86-64
+*		  CPUs with an invariant TSC, the time is extrapolated from the
+*		  TSC instead, along a line fitted to CLOCK_REALTIME.  The line is
+*		  refitted every second, starting no earlier than where the old
+*		  one ends, so time stamps never go backwards.
+*
+*		  Everything here is lock-free and async-signal-safe.
+*
+* @file PmLogTime.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLibInt.h"
+
+#include <time.h>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+
+/*********************************************************************/
+/* PrvClockNs */
+/**
+@brief  Returns the current CLOCK_REALTIME time in nanoseconds.
+**********************************************************************/
+static uint64_t PrvClockNs(void)
+{
+	struct timespec	ts;
+
+	if (clock_gettime(CLOCK_REALTIME, &ts) != 0)
+	{
+		return 0;
+	}
+
+	return ((uint64_t) ts.tv_sec * 1000000000ULL) + (uint64_t) ts.tv_nsec;
+}
+
+
+#if defined(__x86_64__)
+
+// how long the TSC is measured against the clock before it is used
+#define kTscCalibrateNs		50000000ULL
+
+// how often the line is refitted
+#define kTscRefitNs			1000000000ULL
+
+enum
+{
+	kTscState_Unknown = 0,
+	kTscState_Calibrating,
+	kTscState_Ready,
+	kTscState_Unavailable
+};
+
+
+/*********************************************************************/
+/* PrvTscLine */
+/**
+@brief  time = ns0 + ((tsc - tsc0) * mult) >> 32, for tsc - tsc0 < span.
+		clockNs0 is the clock reading taken at tsc0, which ns0 may be
+		ahead of, and which the next fit is measured from.
+**********************************************************************/
+typedef struct
+{
+	uint64_t	tsc0;
+	uint64_t	ns0;
+	uint64_t	clockNs0;
+	uint64_t	mult;
+	uint64_t	span;
+}
+PrvTscLine;
+
+
+// the current line is gTscLines[ gTscIndex ]; a refit fills the other
+static PrvTscLine	gTscLines[ 2 ];
+static int			gTscIndex		= 0;
+static int			gTscState		= kTscState_Unknown;
+
+// set while one thread fits a line
+static int			gTscFitting		= 0;
+
+
+/*********************************************************************/
+/* PrvReadTsc */
+/**
+@brief  Reads the time stamp counter.
+**********************************************************************/
+static inline uint64_t PrvReadTsc(void)
+{
+	uint32_t	lo;
+	uint32_t	hi;
+
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+
+	return ((uint64_t) hi << 32) | lo;
+}
+
+
+/*********************************************************************/
+/* PrvTscIsInvariant */
+/**
+@brief  Returns true if the TSC ticks at a constant rate in all
+		power states (CPUID 0x80000007, EDX bit 8).
+**********************************************************************/
+static bool PrvTscIsInvariant(void)
+{
+	unsigned int	eax;
+	unsigned int	ebx;
+	unsigned int	ecx;
+	unsigned int	edx;
+
+	if ((__get_cpuid_max(0x80000000, NULL) < 0x80000007) ||
+		!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+	{
+		return false;
+	}
+
+	return (edx & (1u << 8)) != 0;
+}
+
+
+/*********************************************************************/
+/* PrvTscLineAt */
+/**
+@brief  Returns the line's time for the given TSC value.  A TSC read
+		on another CPU may be a little behind the line's start.
+**********************************************************************/
+static inline uint64_t PrvTscLineAt(const PrvTscLine* lineP, uint64_t tsc)
+{
+	if ((int64_t) (tsc - lineP->tsc0) < 0)
+	{
+		return lineP->ns0;
+	}
+
+	return lineP->ns0 + (uint64_t) (((unsigned __int128)
+		(tsc - lineP->tsc0) * lineP->mult) >> 32);
+}
+
+
+/*********************************************************************/
+/* PrvTscRate */
+/**
+@brief  Returns the nanoseconds per TSC tick, in 32.32 fixed point,
+		measured between two points.
+**********************************************************************/
+static uint64_t PrvTscRate(uint64_t fromTsc, uint64_t fromNs, uint64_t tsc,
+	uint64_t clockNs)
+{
+	return (uint64_t) (((unsigned __int128) (clockNs - fromNs) << 32) /
+		(tsc - fromTsc));
+}
+
+
+/*********************************************************************/
+/* PrvTscFit */
+/**
+@brief  Starts a new line at the given point with the given rate, and
+		makes it current.  Called by one thread at a time.
+**********************************************************************/
+static void PrvTscFit(uint64_t tsc, uint64_t clockNs, uint64_t ns0,
+	uint64_t mult)
+{
+	PrvTscLine*	lineP;
+	int			index;
+
+	if (mult == 0)
+	{
+		mult = 1;
+	}
+
+	index = 1 - __atomic_load_n(&gTscIndex, __ATOMIC_RELAXED);
+	lineP = &gTscLines[ index ];
+
+	lineP->tsc0 = tsc;
+	lineP->ns0 = ns0;
+	lineP->clockNs0 = clockNs;
+	lineP->mult = mult;
+	lineP->span = (uint64_t) (((unsigned __int128) kTscRefitNs << 32) / mult);
+
+	__atomic_store_n(&gTscIndex, index, __ATOMIC_RELEASE);
+}
+
+
+/*********************************************************************/
+/* PrvTscTimeNs */
+/**
+@brief  Returns the time from the TSC, calibrating and refitting as
+		needed, or from the clock until the TSC can be used.
+**********************************************************************/
+static uint64_t PrvTscTimeNs(void)
+{
+	const PrvTscLine*	lineP;
+	uint64_t			tsc;
+	uint64_t			clockNs;
+	uint64_t			lineNs;
+	int					state;
+
+	state = __atomic_load_n(&gTscState, __ATOMIC_ACQUIRE);
+	lineP = NULL;
+
+	if (state == kTscState_Ready)
+	{
+		lineP = &gTscLines[ __atomic_load_n(&gTscIndex, __ATOMIC_ACQUIRE) ];
+		tsc = PrvReadTsc();
+		if (tsc - lineP->tsc0 < lineP->span)
+		{
+			return PrvTscLineAt(lineP, tsc);
+		}
+	}
+	else if (state == kTscState_Unavailable)
+	{
+		return PrvClockNs();
+	}
+
+	// calibrate or refit, unless another thread is already at it
+	if (__atomic_exchange_n(&gTscFitting, 1, __ATOMIC_ACQUIRE) != 0)
+	{
+		return (lineP != NULL) ? PrvTscLineAt(lineP, PrvReadTsc()) :
+			PrvClockNs();
+	}
+
+	clockNs = PrvClockNs();
+	tsc = PrvReadTsc();
+
+	state = __atomic_load_n(&gTscState, __ATOMIC_ACQUIRE);
+	switch (state)
+	{
+		case kTscState_Unknown:
+			if (!PrvTscIsInvariant())
+			{
+				__atomic_store_n(&gTscState, kTscState_Unavailable,
+					__ATOMIC_RELEASE);
+				break;
+			}
+
+			// the first point, to measure the rate from
+			gTscLines[ 0 ].tsc0 = tsc;
+			gTscLines[ 0 ].clockNs0 = clockNs;
+			__atomic_store_n(&gTscState, kTscState_Calibrating,
+				__ATOMIC_RELEASE);
+			break;
+
+		case kTscState_Calibrating:
+			lineP = &gTscLines[ 0 ];
+			if ((clockNs > lineP->clockNs0) &&
+				(clockNs - lineP->clockNs0 >= kTscCalibrateNs) &&
+				(tsc > lineP->tsc0))
+			{
+				PrvTscFit(tsc, clockNs, clockNs, PrvTscRate(lineP->tsc0,
+					lineP->clockNs0, tsc, clockNs));
+				__atomic_store_n(&gTscState, kTscState_Ready,
+					__ATOMIC_RELEASE);
+			}
+			break;
+
+		case kTscState_Ready:
+			lineP = &gTscLines[ __atomic_load_n(&gTscIndex,
+				__ATOMIC_RELAXED) ];
+			lineNs = PrvTscLineAt(lineP, tsc);
+			if (tsc - lineP->tsc0 < lineP->span)
+			{
+				// another thread refitted meanwhile
+				clockNs = lineNs;
+				break;
+			}
+
+			// start no earlier than the old line ends.  If the clock
+			// was set back, keep the old rate.
+			PrvTscFit(tsc, clockNs, (lineNs > clockNs) ? lineNs : clockNs,
+				((clockNs > lineP->clockNs0) && (tsc > lineP->tsc0))
+					? PrvTscRate(lineP->tsc0, lineP->clockNs0, tsc, clockNs)
+					: lineP->mult);
+			clockNs = (lineNs > clockNs) ? lineNs : clockNs;
+			break;
+
+		default:
+			break;
+	}
+
+	__atomic_store_n(&gTscFitting, 0, __ATOMIC_RELEASE);
+
+	return clockNs;
+}
+
+#endif // __x86_64__
+
+
+/*********************************************************************/
+/* PrvTimeNowNs */
+/**
+@brief  Returns the time stamp for a message, as CLOCK_REALTIME
+		nanoseconds, extrapolated from the TSC if useTsc is set and the
+		CPU allows.  Lock-free and async-signal-safe.
+**********************************************************************/
+uint64_t PrvTimeNowNs(bool useTsc)
+{
+#if defined(__x86_64__)
+	if (useTsc)
+	{
+		return PrvTscTimeNs();
+	}
+#else
+	(void) useTsc;
+#endif
+
+	return PrvClockNs();
+}
+
+
+/*********************************************************************/
+/* PrvTimeForkChild */
+/**
+@brief  Lets a forked child fit the TSC line, in case a thread of the
+		parent was fitting it at the time of the fork.
+**********************************************************************/
+void PrvTimeForkChild(void)
+{
+#if defined(__x86_64__)
+	__atomic_store_n(&gTscFitting, 0, __ATOMIC_RELAXED);
+#endif
+}
@@ -0,0 +1,164 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Forks children that log and get contexts of their own, one
+*		  exiting and one killed, then checks that their contexts are
+*		  reclaimed while the contexts the parent got are kept.
+*
+* @file PmLogForkTest.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLib.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+#define kNumChildContexts	20
+
+
+/*********************************************************************/
+/* RunChild */
+/**
+@brief  Forks a child that logs to the parent's context and gets
+		contexts of its own, then exits or kills itself.  Returns
+		whether the child got that far.
+**********************************************************************/
+static bool RunChild(PmLogContext shared, const char* prefix, bool killed)
+{
+	char			name[ PMLOG_MAX_CONTEXT_NAME_LEN + 1 ];
+	PmLogContext	context;
+	pid_t			pid;
+	int				status;
+	int				i;
+
+	pid = fork();
+	if (pid < 0)
+	{
+		perror("fork");
+		return false;
+	}
+
+	if (pid == 0)
+	{
+		if (PmLogPrint(shared, kPmLogLevel_Error, "child %d",
+			(int) getpid()) != kPmLogErr_None)
+		{
+			_exit(1);
+		}
+
+		if (PmLogGetContext("fork.shared", &context) != kPmLogErr_None)
+		{
+			_exit(1);
+		}
+
+		for (i = 0; i < kNumChildContexts; i++)
+		{
+			snprintf(name, sizeof(name), "%s.%d", prefix, i);
+			if (PmLogGetContext(name, &context) != kPmLogErr_None)
+			{
+				_exit(1);
+			}
+		}
+
+		if (killed)
+		{
+			raise(SIGKILL);
+		}
+		exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) != pid)
+	{
+		perror("waitpid");
+		return false;
+	}
+
+	if (killed)
+	{
+		return WIFSIGNALED(status) && (WTERMSIG(status) == SIGKILL);
+	}
+
+	return WIFEXITED(status) && (WEXITSTATUS(status) == 0);
+}
+
+
+/*********************************************************************/
+/* main */
+/**
+@brief  Runs the children, reclaims, and checks what is left.
+**********************************************************************/
+int main(void)
+{
+	PmLogContext	shared;
+	PmLogContext	context;
+	PmLogLevel		level;
+	int				numReclaimed;
+
+	if ((PmLogGetContext("fork.shared", &shared) != kPmLogErr_None) ||
+		(PmLogSetContextLevel(shared, kPmLogLevel_Error) != kPmLogErr_None))
+	{
+		fprintf(stderr, "can't get the context\n");
+		return 1;
+	}
+
+	if (!RunChild(shared, "fork.exited", false) ||
+		!RunChild(shared, "fork.killed", true))
+	{
+		fprintf(stderr, "child failed\n");
+		return 1;
+	}
+
+	// a run before this one may have left contexts to reclaim as well
+	if ((PmLogReclaimContexts(&numReclaimed) != kPmLogErr_None) ||
+		(numReclaimed < 2 * kNumChildContexts))
+	{
+		fprintf(stderr, "children's contexts not reclaimed\n");
+		return 1;
+	}
+
+	if ((PmLogFindContext("fork.exited.0", &context) !=
+			kPmLogErr_ContextNotFound) ||
+		(PmLogFindContext("fork.killed.0", &context) !=
+			kPmLogErr_ContextNotFound))
+	{
+		fprintf(stderr, "child's context left\n");
+		return 1;
+	}
+
+	// the parent still has its context, and its handle still works
+	if ((PmLogFindContext("fork.shared", &context) != kPmLogErr_None) ||
+		(context != shared) ||
+		(PmLogGetContextLevel(shared, &level) != kPmLogErr_None) ||
+		(level != kPmLogLevel_Error) ||
+		(PmLogPrint(shared, kPmLogLevel_Error, "parent") != kPmLogErr_None))
+	{
+		fprintf(stderr, "parent's context not kept\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Races the lock-free level checks against changes to the
+*		  context levels, the process overrides and the thread
+*		  elevations.  Built with the library sources under
+*		  ThreadSanitizer, which fails the test on any data race.
+*
+* @file PmLogRaceTest.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLib.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+
+#define kNumRounds		20000
+#define kNumReaders		2
+
+
+static PmLogContext		gContext;
+static int				gStop;
+
+
+/*********************************************************************/
+/* SetterThread */
+/**
+@brief  Flips the context's level.
+**********************************************************************/
+static void* SetterThread(void* arg)
+{
+	int		i;
+
+	for (i = 0; i < kNumRounds; i++)
+	{
+		(void) PmLogSetContextLevel(gContext,
+			(i & 1) ? kPmLogLevel_Debug : kPmLogLevel_Error);
+	}
+
+	return arg;
+}
+
+
+/*********************************************************************/
+/* ElevatorThread */
+/**
+@brief  Elevates and restores its own level, which changes the pass
+		levels of every context.
+**********************************************************************/
+static void* ElevatorThread(void* arg)
+{
+	PmLogLevel	saved;
+	int			i;
+
+	for (i = 0; i < kNumRounds / 10; i++)
+	{
+		if (PmLogElevateThreadLevel(kPmLogLevel_Debug, &saved) ==
+			kPmLogErr_None)
+		{
+			(void) PmLogIsEnabled(gContext, kPmLogLevel_Debug);
+			(void) PmLogRestoreThreadLevel(saved);
+		}
+	}
+
+	return arg;
+}
+
+
+/*********************************************************************/
+/* OverrideThread */
+/**
+@brief  Sets and clears an override of the context for the process.
+**********************************************************************/
+static void* OverrideThread(void* arg)
+{
+	int		i;
+
+	for (i = 0; i < kNumRounds / 10; i++)
+	{
+		(void) PmLogSetProcessLevels("race.*", kPmLogLevel_Debug);
+		(void) PmLogClearProcessLevels();
+	}
+
+	return arg;
+}
+
+
+/*********************************************************************/
+/* ReaderThread */
+/**
+@brief  Checks the levels until told to stop.
+**********************************************************************/
+static void* ReaderThread(void* arg)
+{
+	long	n;
+
+	n = 0;
+	while (!__atomic_load_n(&gStop, __ATOMIC_RELAXED))
+	{
+		n += PmLogIsEnabled(gContext, kPmLogLevel_Info);
+		n += PmLogIsEnabled(gContext, kPmLogLevel_Debug);
+	}
+
+	return (void*) n;
+}
+
+
+/*********************************************************************/
+/* main */
+/**
+@brief  Runs the threads, then checks the levels are still seen.
+**********************************************************************/
+int main(void)
+{
+	pthread_t	writers[ 3 ];
+	pthread_t	readers[ kNumReaders ];
+	int			i;
+
+	if (PmLogGetContext("race.context", &gContext) != kPmLogErr_None)
+	{
+		fprintf(stderr, "can't get the context\n");
+		return 1;
+	}
+
+	for (i = 0; i < kNumReaders; i++)
+	{
+		pthread_create(&readers[ i ], NULL, ReaderThread, NULL);
+	}
+
+	pthread_create(&writers[ 0 ], NULL, SetterThread, NULL);
+	pthread_create(&writers[ 1 ], NULL, ElevatorThread, NULL);
+	pthread_create(&writers[ 2 ], NULL, OverrideThread, NULL);
+
+	for (i = 0; i < 3; i++)
+	{
+		pthread_join(writers[ i ], NULL);
+	}
+
+	__atomic_store_n(&gStop, 1, __ATOMIC_RELAXED);
+
+	for (i = 0; i < kNumReaders; i++)
+	{
+		pthread_join(readers[ i ], NULL);
+	}
+
+	// the flight recorder may take any level, so only what must be
+	// enabled is checked
+	(void) PmLogSetContextLevel(gContext, kPmLogLevel_Warning);
+	if (!PmLogIsEnabled(gContext, kPmLogLevel_Warning))
+	{
+		fprintf(stderr, "context level not seen\n");
+		return 1;
+	}
+
+	(void) PmLogSetProcessLevels("race.*", kPmLogLevel_Debug);
+	if (!PmLogIsEnabled(gContext, kPmLogLevel_Debug))
+	{
+		fprintf(stderr, "override not passed on\n");
+		return 1;
+	}
+
+	(void) PmLogClearProcessLevels();
+
+	return 0;
+}
@@ -0,0 +1,268 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  Round-trips the encodings: structured records from PmLogKV_
+*		  through a custom sink and PmLogKVRender, and data through the
+*		  log file compression.  Built with the library sources, as the
+*		  compression isn't exported.
+*
+* @file PmLogRoundTripTest.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLib.h"
+#include "PmLogLibPrv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static char		gText[ PMLOG_KV_TEXT_BUFF_SIZE ];
+static bool		gJson;
+static int		gNumRecords;
+
+
+/*********************************************************************/
+/* TestSink */
+/**
+@brief  Renders the structured records it is passed into gText.
+**********************************************************************/
+static void TestSink(void* userData, const PmLogSinkMsg* msgP)
+{
+	if (msgP->flags & kPmLogSinkMsgFlag_KV)
+	{
+		if (PmLogKVRender(msgP->msg, msgP->msgLen, gJson, gText,
+			sizeof(gText)) == kPmLogErr_None)
+		{
+			gNumRecords++;
+		}
+	}
+
+	(void) userData;
+}
+
+
+/*********************************************************************/
+/* CheckRecord */
+/**
+@brief  Logs the fields, and checks the sink got them back as expected.
+**********************************************************************/
+static bool CheckRecord(PmLogContext context, bool json,
+	const PmLogKVField* fields, size_t numFields, PmLogErr expectedErr,
+	const char* expected)
+{
+	PmLogErr	logErr;
+	int			numRecords;
+
+	gJson = json;
+	gText[ 0 ] = 0;
+	numRecords = gNumRecords;
+
+	logErr = PmLogKV_(context, kPmLogLevel_Info, "test.kv", fields,
+		numFields);
+	if (logErr != expectedErr)
+	{
+		fprintf(stderr, "PmLogKV_ returned %s\n",
+			PmLogGetErrDbgString(logErr));
+		return false;
+	}
+
+	if (gNumRecords != numRecords + 1)
+	{
+		fprintf(stderr, "record not rendered\n");
+		return false;
+	}
+
+	if (strcmp(gText, expected) != 0)
+	{
+		fprintf(stderr, "got:      %s\nexpected: %s\n", gText, expected);
+		return false;
+	}
+
+	return true;
+}
+
+
+/*********************************************************************/
+/* TestKV */
+/**
+@brief  Every field type, as logfmt and JSON, and a record that drops
+		fields that don't fit.
+**********************************************************************/
+static bool TestKV(void)
+{
+	char			big[ 400 ];
+	char			expected[ PMLOG_KV_TEXT_BUFF_SIZE ];
+	PmLogContext	context;
+	int				sinkId;
+	bool			ok;
+
+	const PmLogKVField fields[] =
+	{
+		PMLOG_KV_INT64("n", -300),
+		PMLOG_KV_DOUBLE("d", 1.5),
+		PMLOG_KV_STRING("s", "a b\"c"),
+		PMLOG_KV_BYTES("b", "\x01\xff", 2)
+	};
+
+	const PmLogKVField bigFields[] =
+	{
+		PMLOG_KV_STRING("a", big),
+		PMLOG_KV_STRING("b", big),
+		PMLOG_KV_STRING("c", big),
+		PMLOG_KV_INT64("d", 1)
+	};
+
+	if ((PmLogGetContext("test.kv", &context) != kPmLogErr_None) ||
+		(PmLogSetContextLevel(context, kPmLogLevel_Info) != kPmLogErr_None) ||
+		(PmLogRegisterSink(PMLOG_LEVEL_MASK_ALL, TestSink, NULL,
+			&sinkId) != kPmLogErr_None))
+	{
+		fprintf(stderr, "can't set up the sink\n");
+		return false;
+	}
+
+	ok = CheckRecord(context, false, fields, 4, kPmLogErr_None,
+			"msg=test.kv n=-300 d=1.5 s=\"a b\\\"c\" b=01ff") &&
+		CheckRecord(context, true, fields, 4, kPmLogErr_None,
+			"{\"msg\":\"test.kv\",\"n\":-300,\"d\":1.5,"
+			"\"s\":\"a b\\\"c\",\"b\":\"01ff\"}");
+
+	// the third string and the field after it don't fit
+	memset(big, 'x', sizeof(big) - 1);
+	big[ sizeof(big) - 1 ] = 0;
+	snprintf(expected, sizeof(expected), "msg=test.kv a=%s b=%s "
+		PMLOG_KV_TRUNCATED_KEY "=2", big, big);
+
+	ok = ok && CheckRecord(context, false, bigFields, 4,
+		kPmLogErr_TooMuchData, expected);
+
+	(void) PmLogUnregisterSink(sinkId);
+
+	return ok;
+}
+
+
+/*********************************************************************/
+/* CheckCompress */
+/**
+@brief  Compresses and expands the data, and checks it comes back.
+**********************************************************************/
+static bool CheckCompress(const char* what, const uint8_t* data,
+	size_t dataLen)
+{
+	uint32_t	hashTable[ PMLOG_COMPRESS_HASH_SIZE ];
+	uint8_t*	packed;
+	uint8_t*	unpacked;
+	size_t		packedLen;
+	size_t		unpackedLen;
+	bool		ok;
+
+	packed = malloc(PMLOG_COMPRESS_BOUND(dataLen));
+	unpacked = malloc(dataLen + 1);
+	if ((packed == NULL) || (unpacked == NULL))
+	{
+		free(packed);
+		free(unpacked);
+		return false;
+	}
+
+	packedLen = PmLogPrvCompress(data, dataLen, packed,
+		PMLOG_COMPRESS_BOUND(dataLen), hashTable);
+
+	ok = ((packedLen > 0) || (dataLen == 0)) &&
+		PmLogPrvDecompress(packed, packedLen, unpacked, dataLen + 1,
+			&unpackedLen) &&
+		(unpackedLen == dataLen) &&
+		(memcmp(unpacked, data, dataLen) == 0);
+
+	// expanding into too little room must fail, not overrun
+	if (ok && (dataLen > 0) &&
+		PmLogPrvDecompress(packed, packedLen, unpacked, dataLen - 1,
+			&unpackedLen))
+	{
+		ok = false;
+	}
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s data didn't round-trip (%zu bytes)\n", what,
+			dataLen);
+	}
+
+	free(packed);
+	free(unpacked);
+
+	return ok;
+}
+
+
+/*********************************************************************/
+/* TestCompress */
+/**
+@brief  Log-like text, which compresses, and noise, which doesn't.
+**********************************************************************/
+static bool TestCompress(void)
+{
+	static uint8_t	data[ 64 * 1024 ];
+	size_t			len;
+	uint32_t		seed;
+	size_t			i;
+
+	len = 0;
+	for (i = 0; len + 100 < sizeof(data); i++)
+	{
+		len += (size_t) snprintf((char*) data + len, sizeof(data) - len,
+			"2012-01-01T00:00:%02zuZ user.info test[%zu]: {test} line %zu\n",
+			i % 60, i % 7, i);
+	}
+
+	seed = 1;
+	for (i = 0; i < sizeof(data) / 2; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		data[ sizeof(data) / 2 + i ] = (uint8_t) (seed >> 16);
+	}
+
+	return CheckCompress("empty", data, 0) &&
+		CheckCompress("short", data, 10) &&
+		CheckCompress("text", data, sizeof(data) / 2) &&
+		CheckCompress("noise", data + sizeof(data) / 2, sizeof(data) / 2) &&
+		CheckCompress("mixed", data, sizeof(data));
+}
+
+
+/*********************************************************************/
+/* main */
+/**
+@brief  Runs the round trips.
+**********************************************************************/
+int main(void)
+{
+	bool	ok;
+
+	ok = TestKV();
+	ok = TestCompress() && ok;
+
+	return ok ? 0 : 1;
+}
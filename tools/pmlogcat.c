@@ -0,0 +1,682 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  pmlogcat prints PmLogLib log files written in block mode
+*		  (LogFileCompress or LogFileFormat=binary), expanding compressed
+*		  blocks, rendering binary records as text, and copying plain text
+*		  lines as they are.
+*
+*		  usage: pmlogcat [-h] [-c CONTEXT] [-s TIME] [-e TIME] FILE...
+*
+*		  -c, -s and -e print only the messages of the given context, or
+*		  logged at or after / at or before the given time (UTC, as
+*		  YYYY-MM-DDTHH:MM:SS[.fraction][Z], or seconds since the epoch).
+*		  Blocks that the header rules out are skipped without being read
+*		  or expanded.  With -h, a summary line is printed for each block
+*		  that is read.
+*
+* @file pmlogcat.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLib.h"
+#include "PmLogLibPrv.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+
+
+/***********************************************************************
+ * kLevelNames
+ *
+ * Same labels as PmLogLevelToString.
+ ***********************************************************************/
+static const char* const kLevelNames[] =
+{
+	"emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+
+/***********************************************************************
+ * CatOptions
+ ***********************************************************************/
+typedef struct
+{
+	bool		showHeaders;
+	const char*	context;		/* NULL for all */
+	uint32_t	contextId;
+	char		contextTag[ PMLOG_MAX_CONTEXT_NAME_LEN + 5 ];	/* {name}: */
+	uint64_t	startNs;
+	uint64_t	endNs;
+}
+CatOptions;
+
+
+static CatOptions	gOpts;
+
+
+/***********************************************************************
+ * FormatTime
+ ***********************************************************************/
+static void FormatTime(uint64_t timeNs, char* buff, size_t buffSize)
+{
+	time_t		t;
+	struct tm	tm;
+	size_t		n;
+
+	t = (time_t) (timeNs / 1000000000ULL);
+	if (gmtime_r(&t, &tm) == NULL)
+	{
+		snprintf(buff, buffSize, "?");
+		return;
+	}
+
+	n = strftime(buff, buffSize, "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buff + n, buffSize - n, ".%09uZ",
+		(unsigned) (timeNs % 1000000000ULL));
+}
+
+
+/***********************************************************************
+ * ParseTime
+ *
+ * Parses YYYY-MM-DDTHH:MM:SS[.fraction][Z] (UTC) at the start of s.
+ * Returns false if s doesn't start with a time stamp.
+ ***********************************************************************/
+static bool ParseTime(const char* s, size_t sLen, uint64_t* timeNsP)
+{
+	char		buff[ 40 ];
+	struct tm	tm;
+	const char*	p;
+	time_t		t;
+	uint64_t	fracNs;
+	uint64_t	scale;
+
+	if (sLen >= sizeof(buff))
+	{
+		sLen = sizeof(buff) - 1;
+	}
+	memcpy(buff, s, sLen);
+	buff[ sLen ] = 0;
+
+	memset(&tm, 0, sizeof(tm));
+	p = strptime(buff, "%Y-%m-%dT%H:%M:%S", &tm);
+	if (p == NULL)
+	{
+		return false;
+	}
+
+	t = timegm(&tm);
+	if (t < 0)
+	{
+		return false;
+	}
+
+	fracNs = 0;
+	if (*p == '.')
+	{
+		p++;
+		for (scale = 100000000; (*p >= '0') && (*p <= '9'); p++)
+		{
+			fracNs += (uint64_t) (*p - '0') * scale;
+			scale /= 10;
+		}
+	}
+
+	*timeNsP = (uint64_t) t * 1000000000ULL + fracNs;
+	return true;
+}
+
+
+/***********************************************************************
+ * ParseTimeArg
+ ***********************************************************************/
+static bool ParseTimeArg(const char* s, uint64_t* timeNsP)
+{
+	char*				end;
+	unsigned long long	secs;
+
+	if ((s[ 0 ] >= '0') && (s[ 0 ] <= '9'))
+	{
+		secs = strtoull(s, &end, 10);
+		if (*end == 0)
+		{
+			*timeNsP = (uint64_t) secs * 1000000000ULL;
+			return true;
+		}
+	}
+
+	return ParseTime(s, strlen(s), timeNsP);
+}
+
+
+/***********************************************************************
+ * TimeInRange
+ ***********************************************************************/
+static bool TimeInRange(uint64_t timeNs)
+{
+	return (timeNs >= gOpts.startNs) && (timeNs <= gOpts.endNs);
+}
+
+
+/***********************************************************************
+ * BlockMatches
+ *
+ * Returns true if the block header allows for matching records.
+ ***********************************************************************/
+static bool BlockMatches(const PmLogBlockHeader* headerP)
+{
+	uint32_t	bit;
+
+	if ((headerP->lastTimeNs < gOpts.startNs) ||
+		(headerP->firstTimeNs > gOpts.endNs))
+	{
+		return false;
+	}
+
+	// older headers have no context bitmap
+	if ((gOpts.context != NULL) && (headerP->headerSize >= sizeof(*headerP)))
+	{
+		bit = gOpts.contextId % PMLOG_BLOCK_CONTEXT_BITS;
+		if ((headerP->contextBits[ bit / 64 ] & (1ull << (bit % 64))) == 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/***********************************************************************
+ * CatText
+ *
+ * Prints the text lines that match the options.
+ ***********************************************************************/
+static void CatText(const uint8_t* p, size_t len)
+{
+	const uint8_t*	end;
+	const uint8_t*	nl;
+	size_t			lineLen;
+	uint64_t		timeNs;
+
+	if ((gOpts.context == NULL) && (gOpts.startNs == 0) &&
+		(gOpts.endNs == UINT64_MAX))
+	{
+		(void) fwrite(p, 1, len, stdout);
+		return;
+	}
+
+	for (end = p + len; p < end; p = nl)
+	{
+		nl = memchr(p, '\n', (size_t) (end - p));
+		nl = (nl != NULL) ? nl + 1 : end;
+		lineLen = (size_t) (nl - p);
+
+		if ((gOpts.startNs != 0) || (gOpts.endNs != UINT64_MAX))
+		{
+			if (!ParseTime((const char*) p, lineLen, &timeNs) ||
+				!TimeInRange(timeNs))
+			{
+				continue;
+			}
+		}
+
+		if ((gOpts.context != NULL) &&
+			(memmem(p, lineLen, gOpts.contextTag,
+				strlen(gOpts.contextTag)) == NULL))
+		{
+			continue;
+		}
+
+		(void) fwrite(p, 1, lineLen, stdout);
+	}
+}
+
+
+/***********************************************************************
+ * PrintRaw
+ *
+ * Prints the data from a raw dump as hex and ASCII, 16 bytes per line,
+ * each line starting with the record's prefix.
+ ***********************************************************************/
+static void PrintRaw(const char* prefixStr, const uint8_t* p, size_t len)
+{
+	size_t	offset;
+	size_t	lineBytes;
+	size_t	i;
+	char	hexStr[ 16 * 3 + 2 ];
+	char	asciiStr[ 16 + 1 ];
+	char*	hexP;
+
+	for (offset = 0; offset < len; offset += lineBytes)
+	{
+		lineBytes = (len - offset < 16) ? len - offset : 16;
+
+		hexP = hexStr;
+		for (i = 0; i < 16; i++)
+		{
+			if (i == 8)
+			{
+				*hexP++ = ' ';
+			}
+
+			if (i < lineBytes)
+			{
+				sprintf(hexP, "%02X ", p[ offset + i ]);
+			}
+			else
+			{
+				strcpy(hexP, "   ");
+			}
+			hexP += 3;
+
+			if (i < lineBytes)
+			{
+				asciiStr[ i ] = ((p[ offset + i ] >= 0x20) &&
+					(p[ offset + i ] <= 0x7E)) ? (char) p[ offset + i ] : '.';
+			}
+		}
+		*hexP = 0;
+		asciiStr[ lineBytes ] = 0;
+
+		printf("%s%08zX  %s |%s|\n", prefixStr, offset, hexStr, asciiStr);
+	}
+}
+
+
+/***********************************************************************
+ * CatBinary
+ *
+ * Renders the binary records that match the options in the file sink
+ * text layout:  TIME LEVEL ident[pid:tid]: {component}: message
+ * Returns false if the records are malformed.
+ ***********************************************************************/
+static bool CatBinary(const uint8_t* p, size_t len)
+{
+	const uint8_t*	end;
+	PmLogBinRecord	rec;
+	const char*		identP;
+	const char*		componentP;
+	const char*		msgP;
+	size_t			msgLen;
+	const char*		levelStr;
+	const char*		markStr;
+	char			timeStr[ 64 ];
+	char			kvStr[ PMLOG_KV_TEXT_BUFF_SIZE ];
+	char			ptidStr[ 32 ];
+	char			prefixStr[ 640 ];
+
+	for (end = p + len; p < end; p += rec.recordLen)
+	{
+		if ((size_t) (end - p) < sizeof(rec))
+		{
+			return false;
+		}
+
+		memcpy(&rec, p, sizeof(rec));
+		if ((rec.recordLen < sizeof(rec) + rec.identLen + rec.componentLen) ||
+			(rec.recordLen > (size_t) (end - p)))
+		{
+			return false;
+		}
+
+		if (!TimeInRange(rec.timeNs))
+		{
+			continue;
+		}
+
+		identP = (const char*) p + sizeof(rec);
+		componentP = identP + rec.identLen;
+		msgP = componentP + rec.componentLen;
+		msgLen = rec.recordLen - sizeof(rec) - rec.identLen - rec.componentLen;
+
+		if (gOpts.context != NULL)
+		{
+			if (rec.contextId != gOpts.contextId)
+			{
+				continue;
+			}
+
+			// the global context is recorded without a name
+			if ((rec.componentLen != 0) &&
+				((rec.componentLen != strlen(gOpts.context)) ||
+				 (memcmp(componentP, gOpts.context, rec.componentLen) != 0)))
+			{
+				continue;
+			}
+		}
+
+		FormatTime(rec.timeNs, timeStr, sizeof(timeStr));
+
+		levelStr = (rec.level <= kPmLogLevel_Debug)
+			? kLevelNames[ rec.level ]
+			: "?";
+
+		// mark messages logged only for the thread's elevated level
+		markStr = (rec.flags & kPmLogBinRecordFlag_Elevated) ? "*" : "";
+
+		if (rec.tid != rec.pid)
+		{
+			snprintf(ptidStr, sizeof(ptidStr), "[%d:%d]", (int) rec.pid,
+				(int) rec.tid);
+		}
+		else
+		{
+			snprintf(ptidStr, sizeof(ptidStr), "[%d]", (int) rec.pid);
+		}
+
+		if (rec.componentLen == 0)
+		{
+			snprintf(prefixStr, sizeof(prefixStr), "%s %s%s %.*s%s: ", timeStr,
+				levelStr, markStr, (int) rec.identLen, identP, ptidStr);
+		}
+		else
+		{
+			snprintf(prefixStr, sizeof(prefixStr), "%s %s%s %.*s%s: {%.*s}: ",
+				timeStr, levelStr, markStr, (int) rec.identLen, identP, ptidStr,
+				(int) rec.componentLen, componentP);
+		}
+
+		if (rec.flags & kPmLogBinRecordFlag_Raw)
+		{
+			PrintRaw(prefixStr, (const uint8_t*) msgP, msgLen);
+		}
+		else if (rec.flags & kPmLogBinRecordFlag_KV)
+		{
+			if (!PmLogPrvKVRender(msgP, msgLen, false, kvStr, sizeof(kvStr)))
+			{
+				strncat(kvStr, " ...", sizeof(kvStr) - strlen(kvStr) - 1);
+			}
+			printf("%s%s\n", prefixStr, kvStr);
+		}
+		else
+		{
+			printf("%s%.*s\n", prefixStr, (int) msgLen, msgP);
+		}
+	}
+
+	return true;
+}
+
+
+/***********************************************************************
+ * IsBlockHeader
+ *
+ * Returns true if a plausible block header starts at p.
+ ***********************************************************************/
+static bool IsBlockHeader(const uint8_t* p, size_t avail)
+{
+	uint32_t	magic;
+	uint16_t	headerSize;
+
+	if (avail < offsetof(PmLogBlockHeader, contextBits))
+	{
+		return false;
+	}
+
+	memcpy(&magic, p + offsetof(PmLogBlockHeader, magic), sizeof(magic));
+	memcpy(&headerSize, p + offsetof(PmLogBlockHeader, headerSize),
+		sizeof(headerSize));
+
+	return (magic == PMLOG_BLOCK_MAGIC) &&
+		(p[ offsetof(PmLogBlockHeader, version) ] == PMLOG_BLOCK_VERSION) &&
+		(headerSize >= offsetof(PmLogBlockHeader, contextBits)) &&
+		(headerSize <= avail);
+}
+
+
+/***********************************************************************
+ * CatFile
+ ***********************************************************************/
+static int CatFile(const char* path, uint8_t* rawBuf)
+{
+	int					fd;
+	struct stat			st;
+	void*				p;
+	const uint8_t*		pos;
+	const uint8_t*		end;
+	const uint8_t*		nl;
+	const uint8_t*		rawP;
+	PmLogBlockHeader	header;
+	size_t				rawLen;
+	uint16_t			headerSize;
+	long long			offset;
+	char				firstStr[ 64 ];
+	char				lastStr[ 64 ];
+	int					result;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "pmlogcat: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	if (fstat(fd, &st) != 0)
+	{
+		fprintf(stderr, "pmlogcat: %s: %s\n", path, strerror(errno));
+		(void) close(fd);
+		return 1;
+	}
+
+	if (st.st_size == 0)
+	{
+		(void) close(fd);
+		return 0;
+	}
+
+	// only the pages of the blocks that are read get faulted in
+	p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	(void) close(fd);
+	if (p == MAP_FAILED)
+	{
+		fprintf(stderr, "pmlogcat: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	result = 0;
+	pos = (const uint8_t*) p;
+	end = pos + st.st_size;
+
+	while (pos < end)
+	{
+		if (!IsBlockHeader(pos, (size_t) (end - pos)))
+		{
+			// a plain text line
+			nl = memchr(pos, '\n', (size_t) (end - pos));
+			nl = (nl != NULL) ? nl + 1 : end;
+			CatText(pos, (size_t) (nl - pos));
+			pos = nl;
+			continue;
+		}
+
+		offset = (long long) (pos - (const uint8_t*) p);
+
+		// a short (older) header has no context bitmap
+		memcpy(&headerSize, pos + offsetof(PmLogBlockHeader, headerSize),
+			sizeof(headerSize));
+		memset(&header, 0, sizeof(header));
+		memcpy(&header, pos,
+			(headerSize < sizeof(header)) ? headerSize : sizeof(header));
+
+		if (header.dataLen > (size_t) (end - pos) - header.headerSize)
+		{
+			fprintf(stderr, "pmlogcat: %s: truncated block at offset %lld\n",
+				path, offset);
+			result = 1;
+			break;
+		}
+
+		pos += header.headerSize;
+
+		if (!BlockMatches(&header))
+		{
+			pos += header.dataLen;
+			continue;
+		}
+
+		if (gOpts.showHeaders)
+		{
+			FormatTime(header.firstTimeNs, firstStr, sizeof(firstStr));
+			FormatTime(header.lastTimeNs, lastStr, sizeof(lastStr));
+			printf("# block at %lld: %s, %u records, %s .. %s, "
+				"%u => %u bytes\n", offset,
+				(header.format == kPmLogBlockFormat_Binary) ? "binary" : "text",
+				header.numRecords, firstStr, lastStr, header.rawLen,
+				header.dataLen);
+		}
+
+		rawP = NULL;
+		rawLen = 0;
+		if (header.codec == kPmLogBlockCodec_None)
+		{
+			rawP = pos;
+			rawLen = header.dataLen;
+		}
+		else if ((header.codec == kPmLogBlockCodec_LZ4) &&
+			PmLogPrvDecompress(pos, header.dataLen, rawBuf,
+				PMLOG_BLOCK_MAX_RAW_SIZE, &rawLen) &&
+			(rawLen == header.rawLen))
+		{
+			rawP = rawBuf;
+		}
+
+		if ((rawP == NULL) ||
+			((header.format != kPmLogBlockFormat_Text) &&
+			 (header.format != kPmLogBlockFormat_Binary)))
+		{
+			fprintf(stderr, "pmlogcat: %s: bad block at offset %lld\n",
+				path, offset);
+			result = 1;
+		}
+		else if (header.format == kPmLogBlockFormat_Text)
+		{
+			CatText(rawP, rawLen);
+		}
+		else if (!CatBinary(rawP, rawLen))
+		{
+			fprintf(stderr, "pmlogcat: %s: bad record in block at offset "
+				"%lld\n", path, offset);
+			result = 1;
+		}
+
+		pos += header.dataLen;
+	}
+
+	(void) munmap(p, (size_t) st.st_size);
+
+	return result;
+}
+
+
+/***********************************************************************
+ * Usage
+ ***********************************************************************/
+static int Usage(void)
+{
+	fprintf(stderr, "usage: pmlogcat [-h] [-c CONTEXT] [-s TIME] [-e TIME] "
+		"FILE...\n");
+	return 2;
+}
+
+
+/***********************************************************************
+ * main
+ ***********************************************************************/
+int main(int argc, char* argv[])
+{
+	uint8_t*	rawBuf;
+	int			opt;
+	int			i;
+	int			result;
+
+	gOpts.endNs = UINT64_MAX;
+
+	while ((opt = getopt(argc, argv, "hc:s:e:")) != -1)
+	{
+		switch (opt)
+		{
+			case 'h':
+				gOpts.showHeaders = true;
+				break;
+
+			case 'c':
+				if (strlen(optarg) > PMLOG_MAX_CONTEXT_NAME_LEN)
+				{
+					fprintf(stderr, "pmlogcat: context name too long\n");
+					return 2;
+				}
+				gOpts.context = optarg;
+				gOpts.contextId = PmLogPrvContextId(optarg, strlen(optarg));
+				snprintf(gOpts.contextTag, sizeof(gOpts.contextTag), "{%s}: ",
+					optarg);
+				break;
+
+			case 's':
+			case 'e':
+				if (!ParseTimeArg(optarg,
+						(opt == 's') ? &gOpts.startNs : &gOpts.endNs))
+				{
+					fprintf(stderr, "pmlogcat: bad time '%s'\n", optarg);
+					return 2;
+				}
+				break;
+
+			default:
+				return Usage();
+		}
+	}
+
+	if (optind >= argc)
+	{
+		return Usage();
+	}
+
+	rawBuf = malloc(PMLOG_BLOCK_MAX_RAW_SIZE);
+	if (rawBuf == NULL)
+	{
+		fprintf(stderr, "pmlogcat: out of memory\n");
+		return 1;
+	}
+
+	result = 0;
+	for (i = optind; i < argc; i++)
+	{
+		if (CatFile(argv[ i ], rawBuf) != 0)
+		{
+			result = 1;
+		}
+	}
+
+	free(rawBuf);
+
+	return result;
+}
@@ -0,0 +1,265 @@
+// @@@LICENSE
+//
+//      Copyright (c) 2007-2012 Hewlett-Packard Development Company, L.P.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// LICENSE@@@
+
+
+/**
+* @brief  pmlogfr prints the messages captured in PmLogLib flight recorder
+*		  ring files (<progname>.<pid>.pmlogfr), oldest first.
+*
+*		  usage: pmlogfr FILE...
+*
+* @file pmlogfr.c
+* <hr>
+**/
+
+#define _GNU_SOURCE
+
+#include "PmLogLib.h"
+#include "PmLogLibPrv.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+
+/***********************************************************************
+ * kLevelNames
+ *
+ * Same labels as PmLogLevelToString.  The library is not linked in,
+ * so that reading a ring doesn't start a recorder of our own.
+ ***********************************************************************/
+static const char* const kLevelNames[] =
+{
+	"emerg", "alert", "crit", "err", "warning", "notice", "info", "debug"
+};
+
+
+/***********************************************************************
+ * FormatTime
+ ***********************************************************************/
+static void FormatTime(uint64_t timeNs, char* buff, size_t buffSize)
+{
+	time_t		t;
+	struct tm	tm;
+	size_t		n;
+
+	t = (time_t) (timeNs / 1000000000ULL);
+	if (gmtime_r(&t, &tm) == NULL)
+	{
+		snprintf(buff, buffSize, "?");
+		return;
+	}
+
+	n = strftime(buff, buffSize, "%Y-%m-%dT%H:%M:%S", &tm);
+	snprintf(buff + n, buffSize - n, ".%09uZ",
+		(unsigned) (timeNs % 1000000000ULL));
+}
+
+
+/***********************************************************************
+ * CompareSlots
+ ***********************************************************************/
+static int CompareSlots(const void* a, const void* b)
+{
+	uint64_t seqA = (*(const PmLogRingSlot* const*) a)->seq;
+	uint64_t seqB = (*(const PmLogRingSlot* const*) b)->seq;
+
+	return (seqA < seqB) ? -1 : (seqA > seqB) ? 1 : 0;
+}
+
+
+/***********************************************************************
+ * DumpRing
+ ***********************************************************************/
+static int DumpRing(const char* path)
+{
+	int						fd;
+	struct stat				st;
+	void*					p;
+	const PmLogRingHeader*	ringP;
+	const PmLogRingSlot*	slotsP;
+	const PmLogRingSlot**	sortedP;
+	const PmLogRingSlot*	slotP;
+	uint64_t				head;
+	uint64_t				oldest;
+	uint32_t				numSlots;
+	uint32_t				numSorted;
+	uint32_t				i;
+	size_t					componentLen;
+	size_t					textLen;
+	const char*				textP;
+	const char*				levelStr;
+	char					timeStr[ 64 ];
+	char					kvStr[ PMLOG_KV_TEXT_BUFF_SIZE ];
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "pmlogfr: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	if ((fstat(fd, &st) != 0) || (st.st_size < PMLOG_RING_HEADER_SIZE))
+	{
+		fprintf(stderr, "pmlogfr: %s: not a flight recorder file\n", path);
+		(void) close(fd);
+		return 1;
+	}
+
+	p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	(void) close(fd);
+	if (p == MAP_FAILED)
+	{
+		fprintf(stderr, "pmlogfr: %s: %s\n", path, strerror(errno));
+		return 1;
+	}
+
+	ringP = (const PmLogRingHeader*) p;
+	numSlots = ringP->numSlots;
+
+	if ((ringP->magic != PMLOG_RING_MAGIC) ||
+		(ringP->version != PMLOG_RING_VERSION) ||
+		(ringP->slotSize != PMLOG_RING_SLOT_SIZE) ||
+		(ringP->headerSize != PMLOG_RING_HEADER_SIZE) ||
+		(numSlots == 0) ||
+		((uint64_t) st.st_size < (uint64_t) PMLOG_RING_HEADER_SIZE +
+			(uint64_t) numSlots * PMLOG_RING_SLOT_SIZE))
+	{
+		fprintf(stderr, "pmlogfr: %s: not a flight recorder file\n", path);
+		(void) munmap(p, (size_t) st.st_size);
+		return 1;
+	}
+
+	slotsP = (const PmLogRingSlot*) ((const uint8_t*) p + PMLOG_RING_HEADER_SIZE);
+	head = ringP->head;
+	oldest = (head > numSlots) ? (head - numSlots) : 0;
+
+	sortedP = calloc(numSlots, sizeof(*sortedP));
+	if (sortedP == NULL)
+	{
+		fprintf(stderr, "pmlogfr: out of memory\n");
+		(void) munmap(p, (size_t) st.st_size);
+		return 1;
+	}
+
+	numSorted = 0;
+	for (i = 0; i < numSlots; i++)
+	{
+		slotP = &slotsP[ i ];
+		if ((slotP->seq > oldest) && (slotP->seq <= head))
+		{
+			sortedP[ numSorted++ ] = slotP;
+		}
+	}
+
+	qsort(sortedP, numSorted, sizeof(*sortedP), CompareSlots);
+
+	FormatTime(ringP->startTimeNs, timeStr, sizeof(timeStr));
+	printf("# %.*s[%d] started %s, %u of %llu messages\n",
+		(int) sizeof(ringP->progName), ringP->progName, (int) ringP->pid,
+		timeStr, numSorted, (unsigned long long) head);
+
+	for (i = 0; i < numSorted; i++)
+	{
+		slotP = sortedP[ i ];
+
+		componentLen = slotP->componentLen;
+		textLen = slotP->textLen;
+		if (componentLen + textLen > sizeof(slotP->data))
+		{
+			continue;
+		}
+
+		if (!(slotP->flags & kPmLogRingSlotFlag_KV) && (textLen > 0) &&
+			(slotP->data[ componentLen + textLen - 1 ] == '\n'))
+		{
+			textLen--;
+		}
+
+		levelStr = ((slotP->level >= 0) && (slotP->level <= kPmLogLevel_Debug))
+			? kLevelNames[ slotP->level ]
+			: "?";
+
+		FormatTime(slotP->timeNs, timeStr, sizeof(timeStr));
+
+		// structured records are kept encoded, and may have been cut
+		// short to fit the slot
+		textP = slotP->data + componentLen;
+		if (slotP->flags & kPmLogRingSlotFlag_KV)
+		{
+			if (!PmLogPrvKVRender(textP, textLen, false, kvStr, sizeof(kvStr)))
+			{
+				strncat(kvStr, " ...", sizeof(kvStr) - strlen(kvStr) - 1);
+			}
+			textP = kvStr;
+			textLen = strlen(kvStr);
+		}
+
+		if ((componentLen == 0) ||
+			((componentLen == strlen(kPmLogGlobalContextName)) &&
+			 (memcmp(slotP->data, kPmLogGlobalContextName, componentLen) == 0)))
+		{
+			printf("%s [%d] %s: %.*s\n", timeStr, (int) slotP->tid, levelStr,
+				(int) textLen, textP);
+		}
+		else
+		{
+			printf("%s [%d] %s: {%.*s}: %.*s\n", timeStr, (int) slotP->tid,
+				levelStr, (int) componentLen, slotP->data,
+				(int) textLen, textP);
+		}
+	}
+
+	free(sortedP);
+	(void) munmap(p, (size_t) st.st_size);
+
+	return 0;
+}
+
+
+/***********************************************************************
+ * main
+ ***********************************************************************/
+int main(int argc, char* argv[])
+{
+	int		i;
+	int		result;
+
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: pmlogfr FILE...\n");
+		return 2;
+	}
+
+	result = 0;
+	for (i = 1; i < argc; i++)
+	{
+		if (DumpRing(argv[ i ]) != 0)
+		{
+			result = 1;
+		}
+	}
+
+	return result;
+}